@@ -25,26 +25,298 @@
  */
 
 #include "wifi.h"
+#if !defined(WIFI_HOST)
 #include <github.com/mikejac/misc.esp8266-nonos.cpp/espmissingincludes.h>
 #include <github.com/mikejac/timer.esp8266-nonos.cpp/timer.h>
 #include <github.com/mikejac/date_time.esp8266-nonos.cpp/system_time.h>
 #include <osapi.h>
+#include <mem.h>
 #include <espconn.h>
 #include <ip_addr.h>
+#if defined(WITH_IP_CACHE) || defined(WITH_MESH_UDP)
+#include <lwip/netif.h>
 
-#define DTXT(...)   os_printf(__VA_ARGS__)
+struct netif* eagle_lwip_getif(uint8 index);
+#endif
+#if defined(WITH_IP_CACHE)
+#include <netif/etharp.h>
+#endif
+#if defined(WITH_MESH_UDP)
+#include <lwip/pbuf.h>
+#include <lwip/udp.h>
+#endif
+#endif
+
+#define WIFI_LOG_NONE           0
+#define WIFI_LOG_INFO           1
+#define WIFI_LOG_DEBUG          2                                               // per BSS / per station / per event output
+
+#if !defined(WIFI_LOG_LEVEL)
+#define WIFI_LOG_LEVEL          WIFI_LOG_INFO
+#endif
+
+#if !defined(WIFI_LOG_RING_SIZE)
+#define WIFI_LOG_RING_SIZE      32                                              // records
+#endif
+#define WIFI_LOG_DRAIN_MAX      8                                               // records formatted per WIFI_Run()
+
+// log calls take at most 4 arguments so that WITH_LOG_RING can store them as a fixed size record
+#if defined(WITH_LOG_RING)
+#define WIFI_LOG_(fmt, a, b, c, d, ...) wifi_log_put(fmt, (uintptr_t)(a), (uintptr_t)(b), (uintptr_t)(c), (uintptr_t)(d))
+#define WIFI_LOG(...)           WIFI_LOG_(__VA_ARGS__, 0, 0, 0, 0)
+#else
+#define WIFI_LOG(...)           os_printf(__VA_ARGS__)
+#endif
+
+// below the configured level the call is compiled out (the arguments still count as used)
+#define WIFI_NO_LOG(...)        do { if(0) { os_printf(__VA_ARGS__); } } while(0)
+
+#if WIFI_LOG_LEVEL >= WIFI_LOG_INFO
+#define DTXT(...)               WIFI_LOG(__VA_ARGS__)
+#else
+#define DTXT(...)               WIFI_NO_LOG(__VA_ARGS__)
+#endif
+
+#if WIFI_LOG_LEVEL >= WIFI_LOG_DEBUG
+#define DDBG(...)               WIFI_LOG(__VA_ARGS__)
+#else
+#define DDBG(...)               WIFI_NO_LOG(__VA_ARGS__)
+#endif
+
+#define BSSIDSTR                "%06x%06x"
+#define BSSID2STR(a)            (((a)[0] << 16) | ((a)[1] << 8) | (a)[2]), (((a)[3] << 16) | ((a)[4] << 8) | (a)[5])
 
 #define CONNECT_CHECK_INTERVAL_SECONDS      15
+#define CONNECT_CHECK_FALLBACK_SECONDS      60                                  // polling interval when SDK events drive the state machine
 #define CONNECT_TIMEOUT_SECONDS             30
+#define FAST_CONNECT_TIMEOUT_SECONDS        5                                   // give up on the cached BSSID/channel after this
 #define MESH_CHECK_INTERVAL_SECONDS         10
+#define MESH_CONNECT_TIMEOUT_SECONDS        15                                  // per parent
+#define MESH_MAX_HOPS                       9                                   // one digit in the softAP SSID
+#define MESH_HOP_PENALTY                    8                                   // dB a parent one hop further from the root must be stronger by
+#define MESH_LOAD_PENALTY                   4                                   // dB per station a parent already has
+#define MESH_MIN_RSSI                       -85                                 // weaker parents only when there is nothing better
+#define MESH_ROUTE_RECONCILE_SECONDS        60                                  // softAP station list compared against the routing table
+#define MESH_ROUTE_EXPIRE_SECONDS           300                                 // a node further down not heard from is dropped
+#define IP_CACHE_VERIFY_MS                  500                                 // the gateway must answer ARP within this
+
+#define IP_CACHE_NONE                       0                                   // WIFI.m_StaticIp
+#define IP_CACHE_APPLIED                    1                                   // DHCP client stopped, cached lease set
+#define IP_CACHE_VERIFYING                  2                                   // ARP request sent to the gateway
+#define IP_CACHE_VERIFIED                   3
+
+#if !defined(WIFI_RTC_ADDR)
+#define WIFI_RTC_ADDR                       64                                  // first RTC user memory block (64..191) we use
+#endif
+#define WIFI_RTC_MAGIC                      0x57494649
+#define WIFI_RESUME_MAGIC                   0x57495245
+#if !defined(WIFI_RESUME_RTC_ADDR)
+#define WIFI_RESUME_RTC_ADDR                (WIFI_RTC_ADDR + (sizeof(WIFIRtc) + 3) / 4) // right after WIFIRtc
+#endif
+
+#if !defined(WIFI_MAX_AP)
+#define WIFI_MAX_AP                         64                                  // WIFI_AP entries indexed for the scan callback (<= 255)
+#endif
+#define WIFI_RTC_NO_INDEX                   0xFF
+
+#if !defined(WIFI_MAX_PARENTS)
+#define WIFI_MAX_PARENTS                    4                                   // best mesh parents kept from a scan
+#endif
+#if !defined(WIFI_MAX_ROUTES)
+#define WIFI_MAX_ROUTES                     64                                  // nodes below us, all hops; a power of 2, filled to 3/4 at most
+#endif
+#if !defined(WIFI_MAX_CHILDREN)
+#define WIFI_MAX_CHILDREN                   8                                   // stations on our softAP; the SDK takes no more
+#endif
+#if !defined(WIFI_MAX_CANDIDATES)
+#define WIFI_MAX_CANDIDATES                 4                                   // strongest BSSs kept from a scan round
+#endif
+#define CANDIDATES_STALE_SECONDS            60                                  // rescan instead of trying older ones
+
+#if defined(WITH_AP_STATS)
+#if !defined(WIFI_STATS_SECTOR)
+#error "WITH_AP_STATS needs WIFI_STATS_SECTOR, the first of the 3 flash sectors used by system_param_save_with_protect()"
+#endif
+#if !defined(WIFI_MAX_STATS)
+#define WIFI_MAX_STATS                      8                                   // BSSIDs remembered
+#endif
+#define WIFI_STATS_MAGIC                    0x57495354
+#define STATS_SAVE_SECONDS                  3600                                // at most one flash write per hour, plus one per boot
+#endif
+
+#if defined(WITH_MESH_UDP)
+#if !defined(WIFI_MESH_FRAMES)
+#define WIFI_MESH_FRAMES                    4                                   // pbufs allocated once for our own batches
+#endif
+#define MESH_BATCH_MS                       20                                  // default; WIFI_MeshSetBatching()
+#define MESH_FRAME_MAGIC                    0xE5
+#define MESH_FRAME_UP                       1                                   // towards the root
+#define MESH_FRAME_DOWN                     2                                   // from the root to every node
+#define MESH_FRAME_TO                       3                                   // down to one node, along the routing tables
+#define MESH_FRAME_HEADER                   4                                   // magic, direction, hops, message count
+#define MESH_FRAME_TO_HEADER                10                                  // ... and the destination MAC
+#define MESH_RECORD_HEADER                  8                                   // origin MAC, length (big endian)
+
+#if WIFI_MESH_SEND_MAX != WIFI_MESH_FRAME_SIZE - MESH_FRAME_HEADER - MESH_RECORD_HEADER || WIFI_MESH_SEND_TO_MAX != WIFI_MESH_FRAME_SIZE - MESH_FRAME_TO_HEADER - MESH_RECORD_HEADER
+#error "WIFI_MESH_SEND_MAX, WIFI_MESH_SEND_TO_MAX: out of step with the frame format"
+#endif
+#endif
+
+#if defined(WITH_STATE_STATS)
+#define TIMING_SCAN                         0                                   // WIFI_Ctx.m_TimingAt[]
+#define TIMING_IP                           1
+#define TIMING_RECONNECT                    2
+#define TIMING_KINDS                        3
+#endif
+
+#define ROAM_IDLE                           0                                   // WIFIRoam.m_Scan
+#define ROAM_SCANNING                       1
+#define ROAM_SCAN_DONE                      2
+
+#define DEADLINE_CONNECT_CHECK              0                                   // WIFI_Ctx.m_Deadline[]: do_wifi_check() while connecting and in wifi_ready
+#define DEADLINE_CONNECT_TIMEOUT            1                                   // the attempt, the retry backoff, WITH_IP_CACHE's ARP answer
+#define DEADLINE_SCAN_RETRY                 2                                   // wifi_scan_fail
+#define DEADLINE_MESH_CHECK                 3                                   // parent timeout, backoff, link check
+#define DEADLINE_ROAM_SAMPLE                4
+#define DEADLINE_MESH_BATCH                 5                                   // WITH_MESH_UDP
+#define DEADLINE_RUN                        6                                   // see run_poll()
+#define DEADLINE_ROAM_DWELL                 7                                   // windows from here on: looked at, never waited for
+#define DEADLINE_CANDIDATES                 8
+#define DEADLINE_ROUTE_RECONCILE            9                                   // piggybacks on the mesh link check
+#define DEADLINE_STATS_SAVE                 10                                  // WITH_AP_STATS
+#define DEADLINES                           11
+#define DEADLINE_WAKE                       ((1 << DEADLINE_ROAM_DWELL) - 1)    // the ones WIFI_Run() returns the time to
+#define DEADLINE_LAZY                       8                                   // deadline_lazy(): up to 1/8 of the interval late
+
+#if WIFI_EVENT_SUBSCRIBERS > 16
+#error "WIFI_EVENT_SUBSCRIBERS: at most 16, one bit each in WIFI_Ctx.m_EventMask[]"
+#endif
+
+#define SCAN_RETRY_SECONDS                  2                                   // the SDK refused or dropped a scan
+#define SCAN_CHANNELS                       0x7FFE                              // WIFIScan.m_Known bits that can be scanned: channels 1 to 14
+#define RUN_POLL_MS                         100                                 // WIFI_Run() at least this often without a wakeup, or while ARP is awaited
+#define RUN_MAX_MS                          3600000                             // WITH_STATE_STATS, WITH_TRACE: system_get_time() wraps after 71 minutes
 
 /******************************************************************************************************************
  * local var's
  *
  */
 
-static WIFI_AP*             wifi_list;
-static WIFI_AP*             wifi_best_ssid;
+// wifi_list sorted by SSID hash; built by WIFI_InitializeEx()
+typedef struct WIFISsid
+{
+    uint32_t                m_Hash;
+    uint8_t                 m_Length;
+    uint8_t                 m_Index;                                            // into wifi_list
+} WIFISsid;
+
+#if defined(WITH_LOG_RING)
+// deferred log output; the format string doubles as the record's code
+typedef struct WIFILog
+{
+    const char*             m_Format;
+    uintptr_t               m_Arg[4];
+} WIFILog;
+
+static WIFILog              log_ring[WIFI_LOG_RING_SIZE];
+static uint16_t             log_head;
+static uint16_t             log_tail;
+static uint16_t             log_dropped;
+#endif
+
+#if defined(WITH_TRACE)
+// one WIFI_TraceEvent; WIFI_TraceDump() writes it out field by field
+typedef struct WIFITrace
+{
+    uint32_t                m_Time;                                             // ms, see trace_now()
+    uint8_t                 m_Event;
+    uint8_t                 m_A;
+    uint16_t                m_B;
+} WIFITrace;
+#endif
+
+// a BSS carrying one of our SSIDs, from the last scan round
+typedef struct WIFICandidate
+{
+    WIFI_AP*                m_Ap;
+    uint8_t                 m_Bssid[6];
+    uint8_t                 m_Channel;
+    sint8                   m_Rssi;
+    sint16                  m_Score;                                            // RSSI, adjusted by WITH_AP_STATS
+} WIFICandidate;
+
+// another node's softAP, from the last mesh scan
+typedef struct WIFIParent
+{
+    uint8_t                 m_Ssid[32];
+    uint8_t                 m_SsidLen;
+    uint8_t                 m_Bssid[6];
+    uint8_t                 m_Channel;
+    uint8_t                 m_Hops;                                             // from the root; the root's softAP is 0
+    uint8_t                 m_Load;                                             // stations it had when it started its softAP
+    sint8                   m_Rssi;
+    sint16                  m_Score;
+} WIFIParent;
+
+// a station on our softAP
+typedef struct WIFIChild
+{
+    uint8_t                 m_Mac[6];
+    uint8_t                 m_Used;
+    uint8_t                 m_Routes;                                           // route_table entries through it, its own included
+    struct ip_addr          m_Ip;                                               // 0 until our DHCP server leased it one
+} WIFIChild;
+
+// a node below us, open addressed by MAC; either a child or one that reached us through a child
+typedef struct WIFIRoute
+{
+    uint8_t                 m_Mac[6];
+    uint8_t                 m_Used;
+    uint8_t                 m_Child;                                            // index into m_Children; the next hop down
+    uint32_t                m_LastSeen;                                         // system_get_time()
+} WIFIRoute;
+
+#if defined(WITH_AP_STATS)
+// one BSSID; the counters halve together when one of them would overflow
+typedef struct WIFIStat
+{
+    uint32_t                m_SsidHash;
+    uint8_t                 m_Bssid[6];
+    uint8_t                 m_Attempts;
+    uint8_t                 m_Successes;
+    uint16_t                m_TimeToIp;                                         // ms, moving average
+    uint8_t                 m_Disconnects;
+    uint8_t                 m_Age;                                              // 0 = last used; the oldest is replaced
+} WIFIStat;
+
+// kept in flash
+typedef struct WIFIStats
+{
+    uint32_t                m_Magic;
+    uint32_t                m_Checksum;
+    WIFIStat                m_Stat[WIFI_MAX_STATS];
+} WIFIStats;
+#endif
+
+#if defined(WITH_MESH_UDP)
+// one of our batch buffers
+typedef struct WIFIMeshFrame
+{
+    struct pbuf*            m_Pbuf;                                             // free when its only reference is ours
+    uint8_t*                m_Data;                                             // where the payload starts; lwIP moves p->payload to the headers
+    uint16_t                m_Used;
+} WIFIMeshFrame;
+
+typedef struct WIFIMeshUdp
+{
+    struct udp_pcb*         m_Pcb;
+    WIFIMeshFrame           m_Frame[WIFI_MESH_FRAMES];
+    WIFIMeshFrame*          m_Batch;                                            // being filled
+    uint8_t                 m_Mac[6];
+    WIFI_MeshReceive        m_Receive;
+    void*                   m_ReceivePtr;
+} WIFIMeshUdp;
+#endif
 
 typedef struct WIFI 
 {
@@ -55,6 +327,12 @@ typedef struct WIFI
     WIFI_Callback           m_OnConnectCallback;
     WIFI_Callback           m_OnDisconnectCallback;
     void*                   m_CallbackPtr;
+    uint8_t                 m_EventDriven;
+    uint8_t                 m_LastReason;
+    uint8_t                 m_FastConnect;                                      // connecting straight to the cached BSSID/channel
+    uint8_t                 m_Bssid[6];                                         // AP we are (or were last) associated with
+    uint8_t                 m_Channel;
+    uint8_t                 m_StaticIp;                                         // IP_CACHE_*
 } WIFI;
 
 typedef struct WIFIMesh
@@ -62,12 +340,118 @@ typedef struct WIFIMesh
     struct softap_config    m_ApConfig;
 } WIFIMesh;
 
-static WIFI     wifi;
-static WIFIMesh wifi_mesh;
+// survives deep sleep and soft resets in RTC user memory
+typedef struct WIFIRtc
+{
+    uint32_t                m_Magic;
+    uint32_t                m_Checksum;
+    uint32_t                m_SsidHash;
+    uint8_t                 m_Bssid[6];
+    uint8_t                 m_Channel;
+    uint8_t                 m_Index;                                            // into wifi_list; WIFI_RTC_NO_INDEX for WIFI_Initialize()
+    uint16_t                m_Channels;                                         // see WIFIScan.m_Known
+    uint16_t                m_Reserved;
+    struct ip_info          m_Info;                                             // last lease on m_Bssid (WITH_IP_CACHE), else zero
+} WIFIRtc;
+
+// what WIFI_*Initialize() was given, so that WIFI_Resume() can restore it after deep sleep; RTC user memory too
+typedef struct WIFIResume
+{
+    uint32_t                m_Magic;
+    uint32_t                m_Checksum;
+    uint8_t                 m_WIFIMode;
+    uint8_t                 m_EventDriven;
+    uint8_t                 m_RetryCause;                                       // wifi_retry, so backoff goes on across wakes
+    uint8_t                 m_Reserved;
+    uint16_t                m_RetryAttempts;
+    char                    m_Mac[20];
+    char                    m_MeshPrefix[14];
+    char                    m_MeshPostfix[16];
+    struct station_config   m_StationConfig;                                    // ssid/password; empty for ap_fixed_auto
+    struct softap_config    m_ApConfig;                                         // mesh modes
+} WIFIResume;
+
+// targeted scans: visit the channels where our SSIDs were seen before, sweep all channels only when that finds nothing
+typedef struct WIFIScan
+{
+    uint16_t                m_Known;                                            // bit n set = a configured SSID was seen on channel n
+    uint16_t                m_Pending;                                          // channels left in the current round
+    uint16_t                m_Found;                                            // channels a configured SSID answered on in the current round
+    uint8_t                 m_Active;                                           // a round is in progress
+    uint8_t                 m_Full;                                             // the current scan sweeps all channels
+    uint8_t                 m_MeshChannel;                                      // where the mesh SSIDs were last seen
+    uint8_t                 m_MeshFull;
+} WIFIScan;
+
+// what the SDK has in flash, so that we only write it when it really changes
+typedef struct WIFIFlash
+{
+    uint8_t                 m_Loaded;
+    uint8_t                 m_OpMode;
+    uint8_t                 m_AutoConnect;
+    struct station_config   m_StationConfig;
+    struct softap_config    m_ApConfig;
+    uint32_t                m_Writes;
+    uint32_t                m_Avoided;
+} WIFIFlash;
+
+// consecutive failures; WIFI_RetryPolicy picks the delay
+typedef struct WIFIRetry
+{
+    uint16_t                m_Attempts;
+    uint8_t                 m_Cause;                                            // WIFI_RetryCause of the last failure
+} WIFIRetry;
+
+// ap_fixed_auto background scans while in wifi_ready
+typedef struct WIFIRoam
+{
+    sint16                  m_Rssi;                                             // smoothed; 0 = no sample yet
+    uint8_t                 m_Scan;                                             // ROAM_*
+    uint16_t                m_Pending;                                          // channels left in the background round
+    WIFI_AP*                m_Best;                                             // strongest other AP from wifi_list
+    sint8                   m_BestRssi;
+    uint8_t                 m_BestBssid[6];
+    uint8_t                 m_BestChannel;
+    uint8_t                 m_Switched;                                         // left for m_Best; event_roamed once it has an IP
+} WIFIRoam;
+
+// WIFI_Subscribe()
+typedef struct WIFISubscriber
+{
+    WIFI_EventHandler       m_Handler;
+    void*                   m_Ptr;
+} WIFISubscriber;
+
+static const WIFI_RetryPolicy retry_defaults = {
+    {
+        { 30000, 600000, 0 },                                                   // retry_wrong_password; only a config change fixes it
+        { 1000,  30000,  0 },                                                   // retry_no_ap_found
+        { 1000,  30000,  0 }                                                    // retry_connect_fail
+    },
+    50
+};
+
+static const WIFI_RoamPolicy roam_defaults = {
+    -75,                                                                        // threshold
+    10,                                                                         // hysteresis
+    5,                                                                          // sample_s
+    60                                                                          // dwell_s
+};
 
-static Timer connect_check_timer;
-static Timer connect_timeout_timer;
-static Timer mesh_check_timer;
+
+// one per WIFI_PowerPolicy
+typedef struct WIFIPower
+{
+    uint8_t     m_SleepType;
+    uint8_t     m_ListenInterval;                                               // DTIM periods between wakes; 0 = every DTIM
+    uint16_t    m_CheckSeconds;                                                 // link polling in wifi_ready; 0 = connect_check_interval()
+} WIFIPower;
+
+static const WIFIPower power_profiles[power_policies] = {
+    { NONE_SLEEP_T,  0, 5 },                                                    // power_low_latency
+    { MODEM_SLEEP_T, 0, 0 },                                                    // power_balanced
+    { LIGHT_SLEEP_T, 3, 120 }                                                   // power_low
+};
 
 typedef enum {
     none = 0,
@@ -76,6 +460,7 @@ typedef enum {
     wifi_connect_in_progress,
     wifi_connect_done,
     wifi_connect_fail,
+    wifi_connect_wait,                                                          // backing off before the next attempt
     wifi_disconnect,
     wifi_disconnect_in_progress,
     wifi_disconnect_done,
@@ -83,6 +468,9 @@ typedef enum {
     wifi_scan_in_progress,
     wifi_scan_done,
     wifi_scan_fail,
+#if defined(WITH_IP_CACHE)
+    wifi_connect_verify,
+#endif
 #if defined(WITH_SMARTLINK)        
     wifi_smartlink,
     wifi_smartlink_scan_in_progress,
@@ -102,8 +490,6 @@ typedef enum {
     wifi_ready
 } WIFI_state_t;
 
-static WIFI_state_t WIFI_state;
-
 typedef enum {
     mesh_none = 0,
     mesh_connect,
@@ -115,13 +501,106 @@ typedef enum {
     mesh_disabled
 } WIFI_Mesh_state_t;
 
-static WIFI_Mesh_state_t WIFI_Mesh_state;
+#if defined(WITH_STATE_STATS)
+typedef char timing_states_fit[(wifi_ready < WIFI_STATS_STATES && mesh_disabled < WIFI_STATS_MESH_STATES) ? 1 : -1];
+#endif
 
-// ssid length = 32
-static char mesh_prefix[14];
-static char mesh_postfix[16];
-static char mesh_status;
+// everything one node keeps; WIFI_Ctx* in wifi.h
+struct WIFI_Ctx
+{
+    uint8_t                 m_Ready;                                            // defaults set, see ctx_select()
+    WIFI                    m_Wifi;
+    WIFIMesh                m_Mesh;
+    WIFI_state_t            m_State;
+    WIFI_Mesh_state_t       m_MeshState;
+    
+    WIFI_AP*                m_List;
+    WIFI_AP*                m_BestSsid;
+    uint8_t                 m_BestBssid[6];
+    uint8_t                 m_BestChannel;
+    sint8                   m_BestRssi;
+    WIFISsid                m_SsidIndex[WIFI_MAX_AP];
+    uint8_t                 m_SsidIndexCount;
+    uint8_t                 m_SsidIndexOverflow;                                // list too long; wifi_find_ssid() walks it instead
+    
+    WIFICandidate           m_Candidates[WIFI_MAX_CANDIDATES];                  // best score first
+    uint8_t                 m_CandidateCount;
+    uint8_t                 m_CandidateNext;                                    // next one to try
+    
+    char                    m_MeshPrefix[14];                                   // ssid length = 32
+    char                    m_MeshPostfix[16];
+    char                    m_MeshStatus;
+    uint8_t                 m_MeshHops;                                         // ours; advertised in our softAP SSID
+    WIFIParent              m_Parents[WIFI_MAX_PARENTS];                        // best score first
+    uint8_t                 m_ParentCount;
+    uint8_t                 m_ParentNext;
+    WIFIRoute               m_Routes[WIFI_MAX_ROUTES];
+    uint8_t                 m_RouteCount;
+    WIFIChild               m_Children[WIFI_MAX_CHILDREN];
+    uint8_t                 m_ChildCount;
+    
+    WIFIRtc                 m_Rtc;
+    WIFIResume              m_Resume;
+    WIFIRoam                m_Roam;
+    WIFIScan                m_ScanPlan;
+    WIFIFlash               m_Flash;
+    WIFIRetry               m_Retry;
+    WIFIRetry               m_MeshRetry;
+    
+    WIFI_RetryPolicy        m_RetryUser;
+    const WIFI_RetryPolicy* m_RetryPolicy;
+    WIFI_RoamPolicy         m_RoamUser;
+    const WIFI_RoamPolicy*  m_RoamPolicy;
+    WIFI_PowerPolicy        m_PowerPolicy;
+    uint8_t                 m_PowerSleep;                                       // what the SDK was last told
+    uint8_t                 m_PowerListen;
+    
+    Timer                   m_Deadline[DEADLINES];                              // DEADLINE_*
+    uint16_t                m_DeadlineSet;                                      // bit per running one
+    uint8_t                 m_DeadlineNext;                                     // the soonest DEADLINE_WAKE one, if any runs
+    
+    WIFI_Wakeup             m_RunWakeup;
+    void*                   m_RunWakeupPtr;
+    uint8_t                 m_RunWake;                                          // an SDK callback since; WIFI_Run() looks at everything
+    uint8_t                 m_RunState;                                         // what WIFI_Run() left
+    uint8_t                 m_RunMeshState;
+    
+    WIFISubscriber          m_Subscriber[WIFI_EVENT_SUBSCRIBERS];
+    uint16_t                m_SubscriberSet;                                    // bit per slot in use
+    uint16_t                m_EventMask[event_types];                           // bit per slot that wants the WIFI_EventType
+    uint8_t                 m_EventLink;                                        // event_got_ip sent, event_lost_ip not yet
+    
+#if defined(WITH_AP_STATS)
+    WIFIStats               m_Stats;
+    WIFIStat*               m_StatsCurrent;                                     // the AP being connected to, or connected
+    uint32_t                m_StatsStarted;                                     // system_get_time() at the attempt
+    uint8_t                 m_StatsDirty;
+    uint8_t                 m_StatsSaved;                                       // written since boot
+#endif
+#if defined(WITH_STATE_STATS)
+    WIFI_Stats              m_Timing;                                           // .state/.mesh_state: as WIFI_Run() last saw them
+    uint32_t                m_TimingSince;                                      // system_get_time() the state times are counted up to
+    uint32_t                m_TimingAt[TIMING_KINDS];                           // system_get_time() at the start of a scan, connect, outage
+    uint8_t                 m_TimingPending;                                    // bit per TIMING_* that has started
+#endif
+#if defined(WITH_TRACE)
+    WIFITrace               m_Trace[WIFI_TRACE_SIZE];
+    uint16_t                m_TraceNext;                                        // where the next record goes
+    uint16_t                m_TraceCount;
+    uint32_t                m_TraceLost;                                        // overwritten
+    uint32_t                m_TraceMs;                                          // the trace clock
+    uint32_t                m_TraceAt;                                          // system_get_time() m_TraceMs was brought up to
+    uint8_t                 m_TraceState;                                       // as WIFI_Run() last saw them
+    uint8_t                 m_TraceMeshState;
+#endif
+#if defined(WITH_MESH_UDP)
+    WIFIMeshUdp             m_MeshUdp;
+    uint16_t                m_MeshBatchMs;
+#endif
+};
 
+static WIFI_Ctx             wifi_default;
+static WIFI_Ctx*            ctx = &wifi_default;                                // the node being run; the SDK callbacks carry no pointer of their own
 
 #define MESH_STATUS_NONE        '0'
 #define MESH_STATUS_CONNECTED   '1'
@@ -131,6 +610,17 @@ static char mesh_status;
  *
  */
 
+/**
+ * 
+ * @param c
+ */
+static void ctx_select(WIFI_Ctx* c);
+/**
+ * what every WIFI_*Initialize() and WIFI_Resume() start from
+ * 
+ * @param flash     1 = also leave the SDK's flash config empty; WIFI_Resume() finds it that way
+ */
+static void ctx_reset(uint8_t flash);
 /**
  * 
  * @return 
@@ -166,11 +656,97 @@ static WIFI_Mesh_state_t do_wifi_mesh_connect(void);
  * @return 
  */
 static WIFI_Mesh_state_t do_wifi_mesh_check(void);
+/**
+ * 
+ * @return 
+ */
+static WIFI_Mesh_state_t do_wifi_mesh_connect_done(void);
+/**
+ * 
+ * @param arg
+ * @param status
+ */
+static void mesh_scan_callback(void* arg, STATUS status);
+/**
+ * 
+ * @param bss
+ * @param hops
+ * @param load
+ * @return 
+ */
+static int mesh_parse_ssid(const struct bss_info* bss, uint8_t* hops, uint8_t* load);
+/**
+ * 
+ * @param bss
+ * @param hops
+ * @param load
+ */
+static void parent_add(const struct bss_info* bss, uint8_t hops, uint8_t load);
+/**
+ * 
+ * @return 
+ */
+static WIFI_Mesh_state_t parent_connect(void);
+/**
+ * 
+ * @param mac
+ * @return 
+ */
+static WIFIRoute* route_find(const uint8_t* mac);
+/**
+ * 
+ * @param mac
+ * @param child
+ * @return 
+ */
+static WIFIRoute* route_learn(const uint8_t* mac, uint8_t child);
+/**
+ * 
+ * @param r
+ */
+static void route_remove(WIFIRoute* r);
+/**
+ * 
+ * @param mac
+ * @return 
+ */
+static int route_child_find(const uint8_t* mac);
+/**
+ * 
+ * @param mac
+ * @param ip
+ */
+static void route_child_add(const uint8_t* mac, uint32_t ip);
+/**
+ * 
+ * @param child
+ */
+static void route_child_remove(int child);
+/**
+ * 
+ */
+static void route_reconcile(void);
+/**
+ * 
+ */
+static void route_reset(void);
+/**
+ * 
+ * @param evt
+ */
+static void route_event(System_Event_t* evt);
 /**
  * 
  * @return 
  */
 static WIFI_state_t do_wifi_scan(void);
+/**
+ * take the lowest channel out of a scan plan
+ * 
+ * @param pending   bit n = channel n
+ * @return 0 when none is left
+ */
+static uint8_t scan_next_channel(uint16_t* pending);
 /**
  * 
  * @return 
@@ -199,907 +775,5094 @@ static int build_mesh_ap_ssid(char status);
 /**
  * 
  * @param ssid
+ * @param length
  * @return 
  */
-static WIFI_AP* wifi_find_ssid(const char* ssid);
-
-/******************************************************************************************************************
- * public functions
- *
+static WIFI_AP* wifi_find_ssid(const uint8_t* ssid, uint8_t length);
+/**
+ * 
  */
-
+static void wifi_build_index(void);
 /**
  * 
- * @param p1
- * @param p2
+ * @param evt
+ */
+static void wifi_event_callback(System_Event_t* evt);
+/**
+ * 
+ * @param mode
+ * @param persist
  * @return 
  */
-int ICACHE_FLASH_ATTR WIFI_Initialize(const void* p1, const void* p2)
-{
-    DTXT("WIFI_Initialize(): begin\n");
-    
-    int rc = 0;
-    
-    WIFI_state                  = none;
-    WIFI_Mesh_state             = none;
-    wifi.m_OnConnectCallback    = 0;
-    wifi.m_OnDisconnectCallback = 0;
-    wifi.m_CallbackPtr          = 0;
-
-    wifi.m_StationConfig.ssid[0]     = '\0';
-    wifi.m_StationConfig.password[0] = '\0';
-    
-    wifi_set_opmode(NULL_MODE);
-    wifi_station_set_config(&wifi.m_StationConfig);
-    wifi_station_set_auto_connect(0);
-    
-    uint8_t hwaddr[6];
-    
-    // get our MAC address and convert it to text for future use
-    wifi_get_macaddr(STATION_IF, hwaddr);
-    os_sprintf(wifi.m_Mac, MACSTR, MAC2STR(hwaddr));
-    
-    DTXT("WIFI_Initialize(): MAC = %s\n", wifi.m_Mac);
-    
-    wifi.m_WIFIMode = ap_fixed;
-    wifi_best_ssid  = NULL;
-    WIFI_state      = wifi_connect;
-    WIFI_Mesh_state = mesh_disabled;
-
-    if(p1 != NULL) {
-        os_strcpy((char*)(wifi.m_StationConfig.ssid), p1);
-
-        if(p2 != NULL) {
-            os_strcpy((char*)(wifi.m_StationConfig.password), p2);
-        }
-        else {
-            wifi.m_StationConfig.password[0] = '\0';
-        }
-    }
-    else {
-        wifi.m_StationConfig.ssid[0]     = '\0';
-        wifi.m_StationConfig.password[0] = '\0';
-
-        rc = -1;
-    }
-    
-    DTXT("WIFI_Initialize(): end; rc = %d\n", rc);
-    
-    return rc;
-}
+static bool config_opmode(uint8_t mode, uint8_t persist);
 /**
  * 
- * @param list
+ * @param config
+ * @param persist
  * @return 
  */
-int ICACHE_FLASH_ATTR WIFI_InitializeEx(WIFI_AP list[])
-{
-    wifi_list = list;
-    
-    DTXT("WIFI_InitializeEx(): begin\n");
-    
-    int rc = 0;
-    
-    wifi.m_OnConnectCallback    = 0;
-    wifi.m_OnDisconnectCallback = 0;
-    wifi.m_CallbackPtr          = 0;
-
-    wifi.m_StationConfig.ssid[0]     = '\0';
-    wifi.m_StationConfig.password[0] = '\0';
-    
-    wifi_set_opmode(NULL_MODE);
-    wifi_station_set_config(&wifi.m_StationConfig);
-    wifi_station_set_auto_connect(0);
-    
-    uint8_t hwaddr[6];
-    
-    // get our MAC address and convert it to text for future use
-    wifi_get_macaddr(STATION_IF, hwaddr);
-    os_sprintf(wifi.m_Mac, MACSTR, MAC2STR(hwaddr));
-    
-    DTXT("WIFI_InitializeEx(): MAC = %s\n", wifi.m_Mac);
-    
-    wifi.m_WIFIMode = ap_fixed_auto;
-    wifi_best_ssid  = NULL;
-    WIFI_state      = wifi_scan;
-    WIFI_Mesh_state = mesh_disabled;
-
-    DTXT("WIFI_InitializeEx(): end; rc = %d\n", rc);
-    
-    return rc;
-}
+static bool config_station(struct station_config* config, uint8_t persist);
 /**
  * 
- * @param mode
- * @param ssid
- * @param pass
- * @param prefix
- * @param group
+ * @param config
+ * @param persist
  * @return 
  */
-int ICACHE_FLASH_ATTR WIFI_MeshInitialize(WIFI_Mode mode, const void* ssid, const void* pass, const char* prefix, const char* group)
-{
-    DTXT("WIFI_MeshInitialize(): begin\n");
-    
-    int rc = 0;
-
-    WIFI_state                  = none;
-    WIFI_Mesh_state             = none;
-    wifi.m_OnConnectCallback    = 0;
-    wifi.m_OnDisconnectCallback = 0;
-    wifi.m_CallbackPtr          = 0;
-
-    wifi.m_StationConfig.ssid[0]     = '\0';
-    wifi.m_StationConfig.password[0] = '\0';
-    
-    wifi_set_opmode(NULL_MODE);
-    wifi_station_set_config(&wifi.m_StationConfig);
-    wifi_station_set_auto_connect(0);
-    
-    os_strcpy(mesh_prefix, prefix);    
-    os_strcpy((char*)(wifi_mesh.m_ApConfig.password), "AbCdE");
-    
-    uint8_t hwaddr[6];
-    
-    // get our MAC address and convert it to text for future use
-    wifi_get_macaddr(STATION_IF, hwaddr);
-    os_sprintf(wifi.m_Mac, MACSTR, MAC2STR(hwaddr));
-    
-    os_sprintf(mesh_postfix, "%02X%02X%02X%02X%02X%02X", MAC2STR(hwaddr));
-    
-    DTXT("WIFI_MeshInitialize(): MAC = %s\n", wifi.m_Mac);
-    
-    mesh_status = MESH_STATUS_NONE;
+static bool config_softap(struct softap_config* config, uint8_t persist);
+/**
+ * 
+ * @param set
+ * @return 
+ */
+static bool config_auto_connect(uint8_t set);
+#if defined(WITH_LOG_RING)
+/**
+ * 
+ * @param fmt
+ * @param a
+ * @param b
+ * @param c
+ * @param d
+ */
+static void wifi_log_put(const char* fmt, uintptr_t a, uintptr_t b, uintptr_t c, uintptr_t d);
+#endif
+/**
+ * 
+ * @return 
+ */
+static int fast_connect_load(void);
+/**
+ * 
+ * @return 
+ */
+static int fast_connect_save(void);
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t fast_connect_fallback(void);
+/**
+ * 
+ * @param rtc
+ * @return 
+ */
+static uint32_t wifi_rtc_checksum(const WIFIRtc* rtc);
+/**
+ * 
+ * @return 
+ */
+static int resume_save(void);
+/**
+ * 
+ * @param resume
+ * @return 
+ */
+static uint32_t resume_checksum(const WIFIResume* resume);
+#if defined(WITH_IP_CACHE)
+/**
+ * 
+ */
+static void ip_cache_apply(void);
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ip_cache_verify(void);
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ip_cache_fallback(void);
+#endif
+/**
+ * 
+ * @param ssid
+ * @param length
+ * @return 
+ */
+static uint32_t wifi_ssid_hash(const void* ssid, size_t length);
+/**
+ * 
+ * @return 
+ */
+static int connect_check_interval(void);
+/**
+ * 
+ * @return 
+ */
+static int power_check_interval(void);
+/**
+ * 
+ * @param connected     0 = radio on for scanning/connecting
+ */
+static void power_apply(uint8_t connected);
+/**
+ * 
+ * @return 
+ */
+static WIFI_RetryCause retry_cause(void);
+/**
+ * 
+ * @param retry
+ * @param cause
+ * @param d         DEADLINE_* to set to the delay
+ * @return 
+ */
+static int retry_backoff(WIFIRetry* retry, WIFI_RetryCause cause, uint8_t d);
+/**
+ * 
+ * @param cause
+ * @return 
+ */
+static WIFI_state_t do_wifi_retry(WIFI_RetryCause cause);
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t do_wifi_roam(void);
+/**
+ * 
+ */
+static void roam_scan(void);
+/**
+ * 
+ * @param arg
+ * @param status
+ */
+static void roam_scan_callback(void* arg, STATUS status);
+/**
+ * 
+ */
+static void roam_reset(void);
+/**
+ * 
+ * @param ap
+ * @param bss
+ */
+static void candidate_add(WIFI_AP* ap, const struct bss_info* bss);
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t candidate_connect(void);
+#if defined(WITH_AP_STATS)
+/**
+ * 
+ */
+static void stats_load(void);
+/**
+ * 
+ */
+static void stats_save(void);
+/**
+ * 
+ * @param bssid
+ * @param hash
+ * @param create
+ * @return 
+ */
+static WIFIStat* stats_find(const uint8_t* bssid, uint32_t hash, uint8_t create);
+/**
+ * 
+ */
+static void stats_attempt(void);
+/**
+ * 
+ */
+static void stats_success(void);
+/**
+ * 
+ */
+static void stats_disconnect(void);
+/**
+ * 
+ * @param bss
+ * @return 
+ */
+static sint16 stats_score(const struct bss_info* bss);
+#endif
+/**
+ * WIFI_Run() may have work before the time it returned; called by the SDK callbacks and the calls that move a deadline
+ */
+static void run_wake(void);
+/**
+ * set DEADLINE_RUN for the states that have no deadline of their own to wait for
+ * 
+ * @param start         the states this WIFI_Run() call started with
+ * @param start_mesh
+ */
+static void run_poll(WIFI_state_t start, WIFI_Mesh_state_t start_mesh);
+/**
+ * start or move a deadline
+ * 
+ * @param d         DEADLINE_*
+ * @param ms
+ */
+static void deadline_set(uint8_t d, uint32_t ms);
+/**
+ * deadline_set() for periodic checks: up to ms / DEADLINE_LAZY late, if that lets it share a WIFI_Run() call with
+ * another deadline
+ * 
+ * @param d
+ * @param ms
+ */
+static void deadline_lazy(uint8_t d, uint32_t ms);
+/**
+ * 
+ * @param d
+ */
+static void deadline_clear(uint8_t d);
+/**
+ * 
+ * @param d
+ * @return 1 if it has passed or is not running, as expired() on a Timer
+ */
+static uint8_t deadline_passed(uint8_t d);
+/**
+ * 
+ * @return 1 if a DEADLINE_WAKE deadline has passed
+ */
+static uint8_t deadline_due(void);
+/**
+ * 
+ * @return ms to the soonest DEADLINE_WAKE deadline, or WIFI_RUN_IDLE
+ */
+static int deadline_next(void);
+/**
+ * stop the DEADLINE_WAKE deadlines that have passed; the states that wait for one see it through deadline_passed(),
+ * the others would keep WIFI_Run() busy
+ */
+static void deadline_drop(void);
+/**
+ * update m_DeadlineNext
+ */
+static void deadline_find(void);
+/**
+ * 
+ * @param event
+ * @param type      WIFI_EventType
+ */
+static void event_init(WIFI_Event* event, uint8_t type);
+/**
+ * call the subscribers of event->type
+ * 
+ * @param event
+ */
+static void event_publish(const WIFI_Event* event);
+/**
+ * event_got_ip, event_lost_ip and event_roamed, from the states WIFI_Run() leaves
+ */
+static void event_link(void);
+/**
+ * event_connected and event_mesh_child
+ * 
+ * @param evt
+ */
+static void event_sdk(System_Event_t* evt);
+/**
+ * event_scan_done, from any of the scan callbacks
+ * 
+ * @param bss
+ * @param status
+ */
+static void event_scan(struct bss_info* bss, STATUS status);
+#if defined(WITH_STATE_STATS)
+/**
+ * add the time since the last call to the states WIFI_Run() saw last, and count the changes since
+ */
+static void timing_run(void);
+/**
+ * 
+ * @param kind      TIMING_*
+ */
+static void timing_start(uint8_t kind);
+/**
+ * put the time since timing_start() into the histogram of 'kind', if it was started
+ * 
+ * @param kind
+ */
+static void timing_stop(uint8_t kind);
+/**
+ * 
+ * @param wifi_status   anything but STATION_GOT_IP
+ */
+static void timing_check(uint8_t wifi_status);
+#endif
+#if defined(WITH_TRACE)
+/**
+ * ms since the node was first used; system_get_time() wraps after 71 minutes, this after 49 days
+ * 
+ * @return 
+ */
+static uint32_t trace_now(void);
+/**
+ * 
+ * @param event     WIFI_TraceEvent
+ * @param a
+ * @param b
+ */
+static void trace_put(uint8_t event, uint8_t a, uint16_t b);
+/**
+ * record the state changes since the last call
+ */
+static void trace_run(void);
+/**
+ * 
+ * @param p
+ * @param value
+ * @param bytes
+ * @return the byte after the last one written
+ */
+static uint8_t* trace_write(uint8_t* p, uint32_t value, int bytes);
+#endif
+#if defined(WITH_MESH_UDP)
+/**
+ * 
+ * @return -1 when the heap is short; nothing is kept then
+ */
+static int mesh_udp_start(void);
+/**
+ * unbind the mesh port; the frames are kept
+ */
+static void mesh_udp_stop(void);
+/**
+ * 
+ */
+static void mesh_udp_flush(void);
+/**
+ * 
+ * @param direction
+ * @return 
+ */
+static WIFIMeshFrame* mesh_udp_frame(uint8_t direction);
+/**
+ * 
+ * @param f
+ * @param data
+ * @param length
+ */
+static void mesh_udp_append(WIFIMeshFrame* f, const void* data, uint16_t length);
+/**
+ * 
+ * @param f
+ * @return 
+ */
+static err_t mesh_udp_send(WIFIMeshFrame* f);
+/**
+ * 
+ * @param p
+ * @param direction
+ * @return 
+ */
+static err_t mesh_udp_output(struct pbuf* p, uint8_t direction);
+/**
+ * 
+ * @param arg
+ * @param pcb
+ * @param p
+ * @param addr
+ * @param port
+ */
+static void mesh_udp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, ip_addr_t* addr, u16_t port);
+/**
+ * 
+ * @param frame
+ * @param length
+ */
+static void mesh_udp_deliver(const uint8_t* frame, uint16_t length);
+/**
+ * 
+ * @param frame
+ * @param length
+ * @param addr
+ */
+static void mesh_udp_learn(const uint8_t* frame, uint16_t length, const ip_addr_t* addr);
+/**
+ * 
+ * @return 
+ */
+static int mesh_udp_is_root(void);
+#endif
+
+/******************************************************************************************************************
+ * public functions
+ *
+ */
+
+/**
+ * 
+ * @return NULL when out of memory
+ */
+WIFI_Ctx* ICACHE_FLASH_ATTR WIFI_CtxNew(void)
+{
+    return (WIFI_Ctx*)os_zalloc(sizeof(WIFI_Ctx));
+}
+/**
+ * the SDK (and lwIP) it was run with must be the current one
+ * 
+ * @param c
+ */
+void ICACHE_FLASH_ATTR WIFI_CtxFree(WIFI_Ctx* c)
+{
+    if(c == NULL || c == &wifi_default) {
+        return;
+    }
+    
+#if defined(WITH_MESH_UDP)
+    int i;
+    
+    for(i = 0; i < WIFI_MESH_FRAMES; i++) {
+        if(c->m_MeshUdp.m_Frame[i].m_Pbuf != NULL) {
+            pbuf_free(c->m_MeshUdp.m_Frame[i].m_Pbuf);
+        }
+    }
+    
+    if(c->m_MeshUdp.m_Pcb != NULL) {
+        udp_remove(c->m_MeshUdp.m_Pcb);
+    }
+    
+#endif
+    if(ctx == c) {
+        ctx = &wifi_default;
+    }
+    
+    os_free(c);
+}
+/**
+ * the one WIFI_Initialize() and the other functions without a WIFI_Ctx* work on
+ * 
+ * @return 
+ */
+WIFI_Ctx* ICACHE_FLASH_ATTR WIFI_CtxDefault(void)
+{
+    return &wifi_default;
+}
+/**
+ * 
+ * @param c
+ * @param p1
+ * @param p2
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxInitialize(WIFI_Ctx* c, const void* p1, const void* p2)
+{
+    ctx_select(c);
+    
+    DTXT("WIFI_Initialize(): begin\n");
+    
+    int rc = 0;
+    
+    ctx_reset(1);
+    
+    uint8_t hwaddr[6];
+    
+    // get our MAC address and convert it to text for future use
+    wifi_get_macaddr(STATION_IF, hwaddr);
+    os_sprintf(ctx->m_Wifi.m_Mac, MACSTR, MAC2STR(hwaddr));
+    
+    DTXT("WIFI_Initialize(): MAC = %s\n", ctx->m_Wifi.m_Mac);
+    
+    ctx->m_Wifi.m_WIFIMode = ap_fixed;
+    ctx->m_State           = wifi_connect;
+    ctx->m_MeshState       = mesh_disabled;
+
+    if(p1 != NULL) {
+        os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.ssid), p1);
+
+        if(p2 != NULL) {
+            os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.password), p2);
+        }
+        else {
+            ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+        }
+    }
+    else {
+        ctx->m_Wifi.m_StationConfig.ssid[0]     = '\0';
+        ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+
+        rc = -1;
+    }
+    
+    if(rc == 0) {
+        fast_connect_load();
+        resume_save();
+    }
+    
+    DTXT("WIFI_Initialize(): end; rc = %d\n", rc);
+    
+    return rc;
+}
+/**
+ * 
+ * @param c
+ * @param list
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxInitializeEx(WIFI_Ctx* c, WIFI_AP list[])
+{
+    ctx_select(c);
+    
+    ctx->m_List = list;
+    
+    wifi_build_index();
+#if defined(WITH_AP_STATS)
+    stats_load();
+#endif
+    
+    DTXT("WIFI_InitializeEx(): begin\n");
+    
+    int rc = 0;
+    
+    ctx_reset(1);
+    
+    uint8_t hwaddr[6];
+    
+    // get our MAC address and convert it to text for future use
+    wifi_get_macaddr(STATION_IF, hwaddr);
+    os_sprintf(ctx->m_Wifi.m_Mac, MACSTR, MAC2STR(hwaddr));
+    
+    DTXT("WIFI_InitializeEx(): MAC = %s\n", ctx->m_Wifi.m_Mac);
+    
+    ctx->m_Wifi.m_WIFIMode = ap_fixed_auto;
+    ctx->m_State           = wifi_scan;
+    ctx->m_MeshState       = mesh_disabled;
+    
+    if(fast_connect_load() == 0) {
+        ctx->m_State = wifi_connect;                                            // skip the scan
+    }
+    
+    resume_save();
+
+    DTXT("WIFI_InitializeEx(): end; rc = %d\n", rc);
+    
+    return rc;
+}
+/**
+ * 
+ * @param c
+ * @param mode
+ * @param ssid
+ * @param pass
+ * @param prefix
+ * @param group
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxMeshInitialize(WIFI_Ctx* c, WIFI_Mode mode, const void* ssid, const void* pass, const char* prefix, const char* group)
+{
+    ctx_select(c);
+    
+    DTXT("WIFI_MeshInitialize(): begin\n");
+    
+    int rc = 0;
+    
+    ctx_reset(1);
+    
+    os_strcpy(ctx->m_MeshPrefix, prefix);    
+    os_strcpy((char*)(ctx->m_Mesh.m_ApConfig.password), "AbCdE");
+    
+    uint8_t hwaddr[6];
+    
+    // get our MAC address and convert it to text for future use
+    wifi_get_macaddr(STATION_IF, hwaddr);
+    os_sprintf(ctx->m_Wifi.m_Mac, MACSTR, MAC2STR(hwaddr));
+    
+    os_sprintf(ctx->m_MeshPostfix, "%02X%02X%02X%02X%02X%02X", MAC2STR(hwaddr));
+    
+    DTXT("WIFI_MeshInitialize(): MAC = %s\n", ctx->m_Wifi.m_Mac);
+    
+    ctx->m_Mesh.m_ApConfig.ssid_len       = 0;
+    ctx->m_Mesh.m_ApConfig.authmode       = AUTH_OPEN;
+    ctx->m_Mesh.m_ApConfig.ssid_hidden    = 0;
+    ctx->m_Mesh.m_ApConfig.max_connection = 4;
+
+    switch(mode) {
+        case ap_fixed:
+            DTXT("WIFI_MeshInitialize(): ap_fixed\n");
+            
+            ctx->m_Wifi.m_WIFIMode = ap_fixed;
+            ctx->m_State           = wifi_connect;
+            ctx->m_MeshState       = mesh_disabled;
+            
+            if(ssid != NULL) {
+                os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.ssid), ssid);
+
+                if(pass != NULL) {
+                    os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.password), pass);
+                }
+                else {
+                    ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+                }
+            }
+            else {
+                ctx->m_Wifi.m_StationConfig.ssid[0]     = '\0';
+                ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+
+                rc = -1;
+            }
+            break;
+            
+        case mesh_root:
+            DTXT("WIFI_MeshInitialize(): mesh_root\n");
+            
+            ctx->m_Wifi.m_WIFIMode = mesh_root;
+            ctx->m_State           = wifi_connect;
+            ctx->m_MeshState       = none; //mesh_connect;
+            
+            //wifi_station_set_config(&wifi.m_StationConfig);
+
+            if(ssid != NULL) {
+                os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.ssid), ssid);
+
+                if(pass != NULL) {
+                    os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.password), pass);
+                }
+                else {
+                    ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+                }
+            }
+            else {
+                ctx->m_Wifi.m_StationConfig.ssid[0]     = '\0';
+                ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+
+                rc = -1;
+            }
+            
+            config_station(&ctx->m_Wifi.m_StationConfig, 0);                    // do_wifi_connect() applies it; no need to persist
+
+            build_mesh_ap_ssid(ctx->m_MeshStatus);
+            break;
+            
+        case mesh_non_leaf:
+            DTXT("WIFI_MeshInitialize(): mesh_non_leaf\n");
+
+            ctx->m_Wifi.m_WIFIMode = mesh_non_leaf;
+            ctx->m_State           = wifi_disabled;
+            ctx->m_MeshState       = mesh_connect;
+            
+            ctx->m_Wifi.m_StationConfig.ssid[0]     = '\0';
+            ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+
+            //wifi_station_disconnect();
+
+            config_station(&ctx->m_Wifi.m_StationConfig, 1);
+            break;
+            
+        case mesh_leaf:
+            DTXT("WIFI_MeshInitialize(): mesh_leaf\n");
+            
+            ctx->m_Wifi.m_WIFIMode = mesh_leaf;
+            ctx->m_State           = wifi_disabled;
+            ctx->m_MeshState       = mesh_connect;
+            
+            ctx->m_Wifi.m_StationConfig.ssid[0]     = '\0';
+            ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+            
+            //wifi_station_disconnect();
+            
+            config_station(&ctx->m_Wifi.m_StationConfig, 1);
+            break;
+            
+        default:
+            break;
+    }
+    
+    if(rc == 0) {
+        resume_save();
+    }
+
+    DTXT("WIFI_MeshInitialize(): end; rc = %d\n", rc);
+    
+    return rc;
+}
+/**
+ * 
+ * @param c
+ * @param list
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxResume(WIFI_Ctx* c, WIFI_AP list[])
+{
+    ctx_select(c);
+    
+    DTXT("WIFI_Resume(): begin\n");
+    
+    if(!system_rtc_mem_read(WIFI_RESUME_RTC_ADDR, &ctx->m_Resume, sizeof(ctx->m_Resume)) ||
+       ctx->m_Resume.m_Magic != WIFI_RESUME_MAGIC ||
+       ctx->m_Resume.m_Checksum != resume_checksum(&ctx->m_Resume) ||
+       (ctx->m_Resume.m_WIFIMode == ap_fixed_auto) != (list != NULL)) {
+        DTXT("WIFI_Resume(): no valid record\n");
+        
+        ctx->m_Resume.m_Magic = 0;
+        return -1;
+    }
+    
+    ctx->m_List = list;
+    
+    if(list != NULL) {
+        wifi_build_index();
+#if defined(WITH_AP_STATS)
+        stats_load();
+        
+        ctx->m_StatsSaved = 1;                                                  // not a boot; a node that wakes every minute would wear out the sector
+        deadline_set(DEADLINE_STATS_SAVE, STATS_SAVE_SECONDS * 1000u);
+#endif
+    }
+    
+    ctx_reset(0);                                                               // the SDK booted with what WIFI_*Initialize() left in flash
+    
+    ctx->m_Wifi.m_WIFIMode      = (WIFI_Mode)ctx->m_Resume.m_WIFIMode;
+    ctx->m_Wifi.m_StationConfig = ctx->m_Resume.m_StationConfig;
+    ctx->m_Wifi.m_EventDriven   = ctx->m_Resume.m_EventDriven;
+    
+    ctx->m_Retry.m_Attempts = ctx->m_Resume.m_RetryAttempts;
+    ctx->m_Retry.m_Cause    = ctx->m_Resume.m_RetryCause;
+    
+    os_memcpy(ctx->m_Wifi.m_Mac, ctx->m_Resume.m_Mac, sizeof(ctx->m_Wifi.m_Mac));
+    os_memcpy(ctx->m_MeshPrefix, ctx->m_Resume.m_MeshPrefix, sizeof(ctx->m_MeshPrefix));
+    os_memcpy(ctx->m_MeshPostfix, ctx->m_Resume.m_MeshPostfix, sizeof(ctx->m_MeshPostfix));
+    ctx->m_Mesh.m_ApConfig = ctx->m_Resume.m_ApConfig;
+    
+    switch(ctx->m_Wifi.m_WIFIMode) {
+        case ap_fixed:
+            ctx->m_State     = wifi_connect;
+            ctx->m_MeshState = mesh_disabled;
+            
+            fast_connect_load();
+            break;
+            
+        case ap_fixed_auto:
+            ctx->m_State     = (fast_connect_load() == 0) ? wifi_connect : wifi_scan;
+            ctx->m_MeshState = mesh_disabled;
+            break;
+            
+        case mesh_root:
+            ctx->m_State     = wifi_connect;
+            ctx->m_MeshState = none;
+            
+            config_station(&ctx->m_Wifi.m_StationConfig, 0);
+            
+            build_mesh_ap_ssid(ctx->m_MeshStatus);
+            break;
+            
+        case mesh_non_leaf:
+        case mesh_leaf:
+            ctx->m_State     = wifi_disabled;
+            ctx->m_MeshState = mesh_connect;
+            break;
+    }
+    
+    DTXT("WIFI_Resume(): end; mode = %d, fast connect = %d\n", ctx->m_Wifi.m_WIFIMode, ctx->m_Wifi.m_FastConnect);
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param on_connect
+ * @param on_disconnect
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxSetCallback(WIFI_Ctx* c, WIFI_Callback on_connect, WIFI_Callback on_disconnect, void* ptr)
+{
+    ctx_select(c);
+    
+    ctx->m_Wifi.m_OnConnectCallback    = on_connect;
+    ctx->m_Wifi.m_OnDisconnectCallback = on_disconnect;
+    ctx->m_Wifi.m_CallbackPtr          = ptr;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param wakeup
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxSetWakeup(WIFI_Ctx* c, WIFI_Wakeup wakeup, void* ptr)
+{
+    ctx_select(c);
+    
+    ctx->m_RunWakeup    = wakeup;
+    ctx->m_RunWakeupPtr = ptr;
+    ctx->m_RunWake      = 1;                                                    // what WIFI_Run() last returned assumed the other one
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param mask
+ * @param handler
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxSubscribe(WIFI_Ctx* c, uint16_t mask, WIFI_EventHandler handler, void* ptr)
+{
+    ctx_select(c);
+    
+    uint16_t free = (uint16_t)(~ctx->m_SubscriberSet & ((1u << WIFI_EVENT_SUBSCRIBERS) - 1));
+    int      slot;
+    uint8_t  type;
+    
+    if(handler == NULL || free == 0) {
+        return -1;
+    }
+    
+    slot = __builtin_ctz(free);
+    
+    ctx->m_Subscriber[slot].m_Handler = handler;
+    ctx->m_Subscriber[slot].m_Ptr     = ptr;
+    ctx->m_SubscriberSet             |= (uint16_t)(1 << slot);
+    
+    for(type = 0; type < event_types; type++) {
+        if((mask & (1 << type)) != 0) {
+            ctx->m_EventMask[type] |= (uint16_t)(1 << slot);
+        }
+    }
+    
+    return slot;
+}
+/**
+ * 
+ * @param c
+ * @param slot
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxUnsubscribe(WIFI_Ctx* c, int slot)
+{
+    ctx_select(c);
+    
+    uint8_t type;
+    
+    if(slot < 0 || slot >= WIFI_EVENT_SUBSCRIBERS || (ctx->m_SubscriberSet & (1 << slot)) == 0) {
+        return -1;
+    }
+    
+    ctx->m_SubscriberSet &= (uint16_t)~(1 << slot);
+    
+    for(type = 0; type < event_types; type++) {
+        ctx->m_EventMask[type] &= (uint16_t)~(1 << slot);
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param enable
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxSetEventDriven(WIFI_Ctx* c, int enable)
+{
+    ctx_select(c);
+    
+    ctx->m_Wifi.m_EventDriven = (enable != 0) ? 1 : 0;
+    
+    resume_save();
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxSetRetryPolicy(WIFI_Ctx* c, const WIFI_RetryPolicy* policy)
+{
+    ctx_select(c);
+    
+    if(policy == NULL) {
+        ctx->m_RetryPolicy = &retry_defaults;
+        return 0;
+    }
+    
+    int i;
+    
+    if(policy->jitter > 100) {
+        return -1;
+    }
+    
+    for(i = 0; i < retry_causes; i++) {
+        const WIFI_Backoff* b = &policy->cause[i];
+        
+        if(b->first_ms == 0 || b->first_ms > b->max_ms || b->max_ms > WIFI_BACKOFF_MAX_MS) {
+            return -1;
+        }
+    }
+    
+    ctx->m_RetryUser   = *policy;
+    ctx->m_RetryPolicy = &ctx->m_RetryUser;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxSetRoamPolicy(WIFI_Ctx* c, const WIFI_RoamPolicy* policy)
+{
+    ctx_select(c);
+    
+    if(policy == NULL) {
+        ctx->m_RoamPolicy = &roam_defaults;
+        return 0;
+    }
+    
+    if(policy->threshold > 0 || policy->sample_s == 0) {
+        return -1;
+    }
+    
+    ctx->m_RoamUser   = *policy;
+    ctx->m_RoamPolicy = &ctx->m_RoamUser;
+    
+    run_wake();                                                                 // the sample timer may be due already
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxSetPowerPolicy(WIFI_Ctx* c, WIFI_PowerPolicy policy)
+{
+    ctx_select(c);
+    
+    if(policy >= power_policies) {
+        return -1;
+    }
+    
+    ctx->m_PowerPolicy = policy;
+    
+    run_wake();                                                                 // for power_apply()
+    
+    if(ctx->m_State == wifi_ready) {
+        deadline_lazy(DEADLINE_CONNECT_CHECK, power_check_interval() * 1000u);
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxGetRetryPolicy(WIFI_Ctx* c, WIFI_RetryPolicy* policy)
+{
+    ctx_select(c);
+    
+    *policy = *ctx->m_RetryPolicy;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxIsConnected(WIFI_Ctx* c)
+{
+    ctx_select(c);
+    
+    switch(ctx->m_Wifi.m_WIFIMode) {
+        case ap_fixed:
+        case ap_fixed_auto:
+            //DTXT("WIFI_IsConnected(): ap_fixed\n");
+            return (ctx->m_State == wifi_ready) ? 1 : 0;
+            break;
+            
+        case mesh_root:
+            //DTXT("WIFI_IsConnected(): mesh_root\n");
+            //return (espconn_mesh_get_status() == MESH_ONLINE_AVAIL) ? 1 : 0;
+            return (ctx->m_State == wifi_ready || ctx->m_MeshState == mesh_connect_done) ? 1 : 0;
+            break;
+            
+        case mesh_non_leaf:
+        case mesh_leaf:
+            return (ctx->m_MeshState == mesh_connect_done) ? 1 : 0;
+            break;
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxConnect(WIFI_Ctx* c)
+{
+    ctx_select(c);
+    
+    ctx->m_State = wifi_connect;
+    
+    run_wake();                                                                 // may be called while the main loop sleeps
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxDisconnect(WIFI_Ctx* c)
+{
+    ctx_select(c);
+    
+    ctx->m_State = wifi_disconnect;
+    
+    run_wake();                                                                 // may be called while the main loop sleeps
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxRun(WIFI_Ctx* c)
+{
+    ctx_select(c);
+    
+    //DTXT("WIFI_Run(): begin\n");
+    
+    if(ctx->m_RunWake == 0 && ctx->m_RunState == ctx->m_State && ctx->m_RunMeshState == ctx->m_MeshState && !deadline_due()) {
+        return deadline_next();                                                 // nothing changed, nothing due
+    }
+    
+    WIFI_state_t      start      = ctx->m_State;
+    WIFI_Mesh_state_t start_mesh = ctx->m_MeshState;
+    
+    deadline_drop();
+    
+#if defined(WITH_LOG_RING)
+    WIFI_LogFlush(WIFI_LOG_DRAIN_MAX);
+#endif
+    
+#if defined(WITH_STATE_STATS)
+    timing_run();                                                               // what the callbacks changed since the last call
+#endif
+#if defined(WITH_TRACE)
+    trace_run();
+#endif
+    
+    power_apply(ctx->m_State == wifi_ready || ctx->m_MeshState == mesh_connect_done);
+    
+#if defined(WITH_MESH_UDP)
+    if(ctx->m_MeshUdp.m_Batch != NULL && deadline_passed(DEADLINE_MESH_BATCH)) {
+        mesh_udp_flush();
+    }
+#endif
+    
+    switch(ctx->m_State) {
+        case wifi_disabled:                                                     // if we're mesh non-leaf or mesh leaf
+            break;
+            
+        case none:
+            //WIFI_state = do_wifi_connect();
+            //countdown(&timer1, CHECK_INTERVAL_SECONDS);
+            break;
+
+        case wifi_connect:
+            ctx->m_State = do_wifi_connect();
+            deadline_set(DEADLINE_CONNECT_CHECK,   connect_check_interval() * 1000u);
+            deadline_set(DEADLINE_CONNECT_TIMEOUT, ((ctx->m_Wifi.m_FastConnect != 0) ? FAST_CONNECT_TIMEOUT_SECONDS : CONNECT_TIMEOUT_SECONDS) * 1000u);
+            break;
+
+        case wifi_connect_in_progress:
+            if(ctx->m_Wifi.m_FastConnect != 0 && deadline_passed(DEADLINE_CONNECT_TIMEOUT)) {
+                DTXT("WIFI_Run(): fast connect timeout\n");
+                
+                ctx->m_State = fast_connect_fallback();
+            }
+            else if(deadline_passed(DEADLINE_CONNECT_TIMEOUT)) {
+                DTXT("WIFI_Run(): connect timeout\n");
+                
+                ctx->m_State = wifi_connect_fail;
+            }
+            else if(deadline_passed(DEADLINE_CONNECT_CHECK)) {
+                ctx->m_State = do_wifi_check();
+                
+                deadline_set(DEADLINE_CONNECT_CHECK, connect_check_interval() * 1000u);
+            }
+            break;
+
+        case wifi_connect_fail:
+            if(ctx->m_Wifi.m_FastConnect != 0) {
+                ctx->m_State = fast_connect_fallback();                         // cached AP is gone; scan/connect normally
+            }
+            else if(ctx->m_Wifi.m_WIFIMode == ap_fixed_auto && ctx->m_CandidateNext < ctx->m_CandidateCount && !deadline_passed(DEADLINE_CANDIDATES)) {
+                wifi_station_disconnect();
+                
+                ctx->m_State = candidate_connect();                             // next one from the last scan
+            }
+            else {
+                ctx->m_State = do_wifi_retry(retry_cause());
+            }
+            break;
+
+        case wifi_connect_wait:
+            if(deadline_passed(DEADLINE_CONNECT_TIMEOUT)) {
+                ctx->m_State = (ctx->m_Wifi.m_WIFIMode == ap_fixed_auto) ? wifi_scan : wifi_connect;
+            }
+            break;
+
+        case wifi_connect_done:
+#if defined(WITH_IP_CACHE)
+            if(ctx->m_Wifi.m_StaticIp == IP_CACHE_APPLIED) {
+                ctx->m_State = ip_cache_verify();                               // don't report a lease the network may not accept
+                break;
+            }
+#endif
+            ctx->m_State = do_wifi_connect_done();
+            
+            if(ctx->m_Wifi.m_OnConnectCallback != 0) {
+                ctx->m_Wifi.m_OnConnectCallback(1, ctx->m_Wifi.m_CallbackPtr);  // notify user
+            }
+            
+            deadline_clear(DEADLINE_CONNECT_TIMEOUT);
+            deadline_lazy(DEADLINE_CONNECT_CHECK, power_check_interval() * 1000u);
+            break;
+            
+#if defined(WITH_IP_CACHE)
+        case wifi_connect_verify:
+            ctx->m_State = ip_cache_verify();
+            break;
+            
+#endif
+        case wifi_disconnect:
+            ctx->m_State = do_wifi_disconnect();
+            break;
+            
+        case wifi_disconnect_in_progress:
+            break;
+            
+        case wifi_disconnect_done:
+            ctx->m_State = do_wifi_disconnect_done();
+            
+            if(ctx->m_Wifi.m_OnDisconnectCallback != 0) {
+                ctx->m_Wifi.m_OnDisconnectCallback(1, ctx->m_Wifi.m_CallbackPtr); // notify user
+            }
+            break;
+            
+        case wifi_scan:
+            ctx->m_State = do_wifi_scan();
+            break;
+
+        case wifi_scan_in_progress:
+            break;
+
+        case wifi_scan_done:
+            ctx->m_State = do_wifi_scan_done();
+            break;
+
+        case wifi_scan_fail:
+            if(deadline_passed(DEADLINE_SCAN_RETRY)) {
+                ctx->m_State = do_wifi_scan();
+            }
+            break;
+            
+        case wifi_ready:
+            if(ctx->m_Wifi.m_WIFIMode == ap_fixed_auto) {
+                ctx->m_State = do_wifi_roam();
+                
+                if(ctx->m_State != wifi_ready) {
+                    break;                                                      // switching to a better AP
+                }
+            }
+            
+            if(deadline_passed(DEADLINE_CONNECT_CHECK)) {
+                WIFI_state_t state = do_wifi_check();
+                
+                if(state != wifi_connect_done) {
+#if defined(WITH_AP_STATS)
+                    stats_disconnect();
+#endif
+                    ctx->m_State = state;                                       // something happened
+                    //if(wifi.m_Callback != 0) {
+                    //    wifi.m_Callback(0, wifi.m_CallbackPtr);                 // notify user
+                    //}
+                }
+                
+#if defined(WITH_MESH_UDP)
+                if(ctx->m_State == wifi_ready && ctx->m_Wifi.m_WIFIMode == mesh_root && ctx->m_MeshUdp.m_Pcb == NULL) {
+                    mesh_udp_start();                                           // do_wifi_connect_done() found the heap short
+                }
+#endif
+                
+                deadline_lazy(DEADLINE_CONNECT_CHECK, power_check_interval() * 1000u);
+            }
+            break;
+            
+        default:
+            DTXT("WIFI_Run(): WIFI_state default\n");
+            break;
+    }
+    
+    switch(ctx->m_MeshState) {
+        case mesh_disabled:
+            break;
+            
+        case none:
+            if(ctx->m_State == wifi_disabled) {
+                DTXT("WIFI_Run(): mesh - wifi disabled, start mesh connect\n");
+                ctx->m_MeshState = mesh_connect;
+            }
+            break;
+            
+        case mesh_connect:
+            ctx->m_MeshState = do_wifi_mesh_connect();
+            deadline_set(DEADLINE_MESH_CHECK, MESH_CHECK_INTERVAL_SECONDS * 1000u);
+            break;
+            
+        case mesh_scan_in_progress:
+            break;
+            
+        case mesh_scan_done:
+            if(ctx->m_ParentNext < ctx->m_ParentCount) {
+                ctx->m_MeshState = parent_connect();
+            }
+            else if(retry_backoff(&ctx->m_MeshRetry, (ctx->m_ParentCount == 0) ? retry_no_ap_found : retry_connect_fail, DEADLINE_MESH_CHECK) == 0) {
+                wifi_station_disconnect();
+                
+                ctx->m_MeshState = mesh_connect_fail;                           // scan again later
+            }
+            else {
+                ctx->m_MeshState = mesh_disabled;
+            }
+            break;
+            
+        case mesh_connect_in_progress:
+            ctx->m_MeshState = do_wifi_mesh_check();
+            
+            if(ctx->m_MeshState == mesh_connect_done) {
+                ctx->m_MeshState = do_wifi_mesh_connect_done();
+                
+                deadline_lazy(DEADLINE_MESH_CHECK, MESH_CHECK_INTERVAL_SECONDS * 1000u);
+            }
+            else if(ctx->m_MeshState == mesh_connect_fail) {
+                ctx->m_MeshState = mesh_scan_done;                              // next parent, or back off
+            }
+            break;
+            
+        case mesh_connect_done:
+            if(deadline_passed(DEADLINE_MESH_CHECK)) {
+                ctx->m_MeshState = do_wifi_mesh_check();
+                
+                if(ctx->m_MeshState != mesh_connect_done) {
+                    if(ctx->m_Wifi.m_OnDisconnectCallback != 0) {
+                        ctx->m_Wifi.m_OnDisconnectCallback(1, ctx->m_Wifi.m_CallbackPtr); // notify user
+                    }
+                    
+                    ctx->m_MeshStatus = MESH_STATUS_NONE;
+                    ctx->m_MeshState  = mesh_connect;                           // find another parent
+                }
+#if defined(WITH_MESH_UDP)
+                else if(ctx->m_MeshUdp.m_Pcb == NULL) {
+                    mesh_udp_start();                                           // do_wifi_mesh_connect_done() found the heap short
+                }
+#endif
+                
+                deadline_lazy(DEADLINE_MESH_CHECK, MESH_CHECK_INTERVAL_SECONDS * 1000u);
+            }
+            break;
+            
+        case mesh_connect_fail:
+            if(deadline_passed(DEADLINE_MESH_CHECK)) {
+                ctx->m_MeshState = mesh_connect;
+            }
+            break;
+            
+        default:
+            DTXT("WIFI_Run(): WIFI_Mesh_state default\n");
+            break;
+    }
+    
+    /*switch(wifi.m_WIFIMode) {
+        case ap_fixed:
+            break;
+            
+        case mesh_root:
+            break;
+            
+        case mesh_non_leaf:
+            break;
+            
+        case mesh_leaf:
+            break;
+    }*/
+    
+#if defined(WITH_STATE_STATS)
+    timing_run();
+#endif
+#if defined(WITH_TRACE)
+    trace_run();
+#endif
+    
+    event_link();
+    run_poll(start, start_mesh);
+    
+    ctx->m_RunWake      = 0;
+    ctx->m_RunState     = (uint8_t)ctx->m_State;
+    ctx->m_RunMeshState = (uint8_t)ctx->m_MeshState;
+    
+    //DTXT("WIFI_Run(): end\n");
+    
+    return deadline_next();
+}
+/**
+ * 
+ * @param c
+ * @param writes
+ * @param avoided
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxGetFlashWrites(WIFI_Ctx* c, uint32_t* writes, uint32_t* avoided)
+{
+    ctx_select(c);
+    
+    *writes  = ctx->m_Flash.m_Writes;
+    *avoided = ctx->m_Flash.m_Avoided;
+    
+    return 0;
+}
+#if defined(WITH_AP_STATS)
+/**
+ * 
+ * @param c
+ * @param ssid
+ * @param stats
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxGetAPStats(WIFI_Ctx* c, const char* ssid, WIFI_APStats* stats)
+{
+    ctx_select(c);
+    
+    uint32_t hash = wifi_ssid_hash(ssid, os_strlen(ssid));
+    uint32_t ms   = 0;
+    int      rc   = -1;
+    int      i;
+    
+    os_memset(stats, 0, sizeof(*stats));
+    
+    for(i = 0; i < WIFI_MAX_STATS; i++) {
+        const WIFIStat* e = &ctx->m_Stats.m_Stat[i];
+        
+        if(e->m_Attempts == 0 || e->m_SsidHash != hash) {
+            continue;
+        }
+        
+        stats->attempts    += e->m_Attempts;
+        stats->successes   += e->m_Successes;
+        stats->disconnects += e->m_Disconnects;
+        ms                 += (uint32_t)e->m_TimeToIp * e->m_Successes;
+        rc                  = 0;
+    }
+    
+    if(stats->successes != 0) {
+        stats->time_to_ip_ms = (uint16_t)(ms / stats->successes);
+    }
+    
+    return rc;
+}
+#endif
+#if defined(WITH_STATE_STATS)
+/**
+ * 
+ * @param c
+ * @param stats
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxGetStats(WIFI_Ctx* c, WIFI_Stats* stats)
+{
+    ctx_select(c);
+    
+    timing_run();                                                               // count up to now, not to the last WIFI_Run()
+    
+    os_memcpy(stats, &ctx->m_Timing, sizeof(*stats));
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxResetStats(WIFI_Ctx* c)
+{
+    ctx_select(c);
+    
+    os_memset(&ctx->m_Timing, 0, sizeof(ctx->m_Timing));
+    
+    ctx->m_Timing.state      = (uint8_t)ctx->m_State;
+    ctx->m_Timing.mesh_state = (uint8_t)ctx->m_MeshState;
+    ctx->m_TimingSince       = system_get_time();
+    
+    return 0;
+}
+#endif
+#if defined(WITH_TRACE)
+/**
+ * 
+ * @param c
+ * @param buffer
+ * @param size
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxTraceDump(WIFI_Ctx* c, uint8_t* buffer, uint16_t size)
+{
+    ctx_select(c);
+    
+    if(size < WIFI_TRACE_HEADER) {
+        return -1;
+    }
+    
+    uint16_t count = ctx->m_TraceCount;
+    uint8_t  set   = 0;
+    uint8_t* p     = buffer;
+    uint16_t i;
+    
+    if(count > (size - WIFI_TRACE_HEADER) / WIFI_TRACE_RECORD) {
+        count = (size - WIFI_TRACE_HEADER) / WIFI_TRACE_RECORD;                 // the newest ones
+    }
+    
+#if defined(WITH_IP_CACHE)
+    set |= WIFI_TRACE_IP_CACHE;
+#endif
+#if defined(WITH_SMARTLINK)
+    set |= WIFI_TRACE_SMARTLINK;
+#endif
+#if defined(WITH_SMARTWEB)
+    set |= WIFI_TRACE_SMARTWEB;
+#endif
+    
+    p = trace_write(p, 'W', 1);
+    p = trace_write(p, 'T', 1);
+    p = trace_write(p, WIFI_TRACE_VERSION, 1);
+    p = trace_write(p, set, 1);
+    p = trace_write(p, count, 2);
+    p = trace_write(p, WIFI_TRACE_RECORD, 2);
+    p = trace_write(p, ctx->m_TraceLost + (ctx->m_TraceCount - count), 4);
+    p = trace_write(p, trace_now(), 4);
+    
+    for(i = 0; i < count; i++) {
+        const WIFITrace* r = &ctx->m_Trace[(ctx->m_TraceNext + WIFI_TRACE_SIZE - count + i) % WIFI_TRACE_SIZE];
+        
+        p = trace_write(p, r->m_Time, 4);
+        p = trace_write(p, r->m_Event, 1);
+        p = trace_write(p, r->m_A, 1);
+        p = trace_write(p, r->m_B, 2);
+    }
+    
+    return (int)(p - buffer);
+}
+#endif
+/**
+ * 
+ * @param c
+ * @param mac
+ * @param ip
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxMeshRoute(WIFI_Ctx* c, const uint8_t* mac, uint32_t* ip)
+{
+    ctx_select(c);
+    
+    WIFIRoute* r = route_find(mac);
+    
+    if(r == NULL || ctx->m_Children[r->m_Child].m_Ip.addr == 0) {
+        return -1;
+    }
+    
+    *ip = ctx->m_Children[r->m_Child].m_Ip.addr;
+    
+    return 0;
+}
+#if defined(WITH_MESH_UDP)
+/**
+ * 
+ * @param c
+ * @param receive
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxMeshSetReceive(WIFI_Ctx* c, WIFI_MeshReceive receive, void* ptr)
+{
+    ctx_select(c);
+    
+    ctx->m_MeshUdp.m_Receive    = receive;
+    ctx->m_MeshUdp.m_ReceivePtr = ptr;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param delay_ms
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxMeshSetBatching(WIFI_Ctx* c, uint16_t delay_ms)
+{
+    ctx_select(c);
+    
+    ctx->m_MeshBatchMs = delay_ms;
+    
+    if(delay_ms == 0) {
+        mesh_udp_flush();
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param data
+ * @param length
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxMeshSend(WIFI_Ctx* c, const void* data, uint16_t length)
+{
+    ctx_select(c);
+    
+    WIFIMeshFrame* f = ctx->m_MeshUdp.m_Batch;
+    
+    if(ctx->m_MeshUdp.m_Pcb == NULL || WIFI_CtxIsConnected(ctx) == 0 || length > WIFI_MESH_SEND_MAX) {
+        return -1;
+    }
+    
+    if(f != NULL && f->m_Used + MESH_RECORD_HEADER + length > WIFI_MESH_FRAME_SIZE) {
+        mesh_udp_flush();
+        
+        f = NULL;
+    }
+    
+    if(f == NULL) {
+        if((f = mesh_udp_frame(mesh_udp_is_root() ? MESH_FRAME_DOWN : MESH_FRAME_UP)) == NULL) {
+            return -1;
+        }
+        
+        ctx->m_MeshUdp.m_Batch = f;
+        
+        deadline_set(DEADLINE_MESH_BATCH, ctx->m_MeshBatchMs);
+        run_wake();
+    }
+    
+    mesh_udp_append(f, data, length);
+    
+    if(ctx->m_MeshBatchMs == 0 || f->m_Data[3] == 0xFF) {
+        mesh_udp_flush();
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param mac
+ * @param data
+ * @param length
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_CtxMeshSendTo(WIFI_Ctx* c, const uint8_t* mac, const void* data, uint16_t length)
+{
+    ctx_select(c);
+    
+    WIFIMeshFrame* f;
+    
+    if(ctx->m_MeshUdp.m_Pcb == NULL || route_find(mac) == NULL || length > WIFI_MESH_SEND_TO_MAX) {
+        return -1;
+    }
+    
+    if((f = mesh_udp_frame(MESH_FRAME_TO)) == NULL) {
+        return -1;
+    }
+    
+    os_memcpy(f->m_Data + MESH_FRAME_HEADER, mac, 6);
+    f->m_Used = MESH_FRAME_TO_HEADER;
+    
+    mesh_udp_append(f, data, length);
+    
+    return (mesh_udp_send(f) == ERR_OK) ? 0 : -1;
+}
+#endif
+/**
+ * 
+ * @param max
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_LogFlush(int max)
+{
+    int count = 0;
+    
+#if defined(WITH_LOG_RING)
+    if(log_dropped != 0) {
+        os_printf("WIFI_LogFlush(): %d records dropped\n", log_dropped);
+        log_dropped = 0;
+    }
+    
+    while(log_tail != log_head && (max <= 0 || count < max)) {
+        WIFILog* r = &log_ring[log_tail];
+        
+        os_printf(r->m_Format, r->m_Arg[0], r->m_Arg[1], r->m_Arg[2], r->m_Arg[3]);
+        
+        log_tail = (log_tail + 1) % WIFI_LOG_RING_SIZE;
+        count++;
+    }
+#endif
+    
+    return count;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+const char* WIFI_CtxGetMAC(WIFI_Ctx* c)
+{
+    ctx_select(c);
+    
+    return ctx->m_Wifi.m_Mac;
+}
+
+/******************************************************************************************************************
+ * the default instance
+ *
+ */
+
+/**
+ * 
+ * @param p1
+ * @param p2
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_Initialize(const void* p1, const void* p2)
+{
+    return WIFI_CtxInitialize(&wifi_default, p1, p2);
+}
+/**
+ * 
+ * @param list
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_InitializeEx(WIFI_AP list[])
+{
+    return WIFI_CtxInitializeEx(&wifi_default, list);
+}
+/**
+ * 
+ * @param mode
+ * @param ssid
+ * @param pass
+ * @param prefix
+ * @param group
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_MeshInitialize(WIFI_Mode mode, const void* ssid, const void* pass, const char* prefix, const char* group)
+{
+    return WIFI_CtxMeshInitialize(&wifi_default, mode, ssid, pass, prefix, group);
+}
+/**
+ * 
+ * @param list
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_Resume(WIFI_AP list[])
+{
+    return WIFI_CtxResume(&wifi_default, list);
+}
+/**
+ * 
+ * @param on_connect
+ * @param on_disconnect
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_SetCallback(WIFI_Callback on_connect, WIFI_Callback on_disconnect, void* ptr)
+{
+    return WIFI_CtxSetCallback(&wifi_default, on_connect, on_disconnect, ptr);
+}
+/**
+ * 
+ * @param wakeup
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_SetWakeup(WIFI_Wakeup wakeup, void* ptr)
+{
+    return WIFI_CtxSetWakeup(&wifi_default, wakeup, ptr);
+}
+/**
+ * 
+ * @param mask
+ * @param handler
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_Subscribe(uint16_t mask, WIFI_EventHandler handler, void* ptr)
+{
+    return WIFI_CtxSubscribe(&wifi_default, mask, handler, ptr);
+}
+/**
+ * 
+ * @param slot
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_Unsubscribe(int slot)
+{
+    return WIFI_CtxUnsubscribe(&wifi_default, slot);
+}
+/**
+ * 
+ * @param enable
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_SetEventDriven(int enable)
+{
+    return WIFI_CtxSetEventDriven(&wifi_default, enable);
+}
+/**
+ * 
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_SetRetryPolicy(const WIFI_RetryPolicy* policy)
+{
+    return WIFI_CtxSetRetryPolicy(&wifi_default, policy);
+}
+/**
+ * 
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_SetRoamPolicy(const WIFI_RoamPolicy* policy)
+{
+    return WIFI_CtxSetRoamPolicy(&wifi_default, policy);
+}
+/**
+ * 
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_SetPowerPolicy(WIFI_PowerPolicy policy)
+{
+    return WIFI_CtxSetPowerPolicy(&wifi_default, policy);
+}
+/**
+ * 
+ * @param policy
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_GetRetryPolicy(WIFI_RetryPolicy* policy)
+{
+    return WIFI_CtxGetRetryPolicy(&wifi_default, policy);
+}
+/**
+ * 
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_IsConnected(void)
+{
+    return WIFI_CtxIsConnected(&wifi_default);
+}
+/**
+ * 
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_connect(void)
+{
+    return WIFI_CtxConnect(&wifi_default);
+}
+/**
+ * 
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_disconnect(void)
+{
+    return WIFI_CtxDisconnect(&wifi_default);
+}
+/**
+ * 
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_Run(void)
+{
+    return WIFI_CtxRun(&wifi_default);
+}
+/**
+ * 
+ * @param writes
+ * @param avoided
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_GetFlashWrites(uint32_t* writes, uint32_t* avoided)
+{
+    return WIFI_CtxGetFlashWrites(&wifi_default, writes, avoided);
+}
+#if defined(WITH_AP_STATS)
+/**
+ * 
+ * @param ssid
+ * @param stats
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_GetAPStats(const char* ssid, WIFI_APStats* stats)
+{
+    return WIFI_CtxGetAPStats(&wifi_default, ssid, stats);
+}
+#endif
+#if defined(WITH_STATE_STATS)
+/**
+ * 
+ * @param stats
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_GetStats(WIFI_Stats* stats)
+{
+    return WIFI_CtxGetStats(&wifi_default, stats);
+}
+/**
+ * 
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_ResetStats(void)
+{
+    return WIFI_CtxResetStats(&wifi_default);
+}
+#endif
+#if defined(WITH_TRACE)
+/**
+ * 
+ * @param buffer
+ * @param size
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_TraceDump(uint8_t* buffer, uint16_t size)
+{
+    return WIFI_CtxTraceDump(&wifi_default, buffer, size);
+}
+#endif
+/**
+ * 
+ * @param mac
+ * @param ip
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_MeshRoute(const uint8_t* mac, uint32_t* ip)
+{
+    return WIFI_CtxMeshRoute(&wifi_default, mac, ip);
+}
+#if defined(WITH_MESH_UDP)
+/**
+ * 
+ * @param receive
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_MeshSetReceive(WIFI_MeshReceive receive, void* ptr)
+{
+    return WIFI_CtxMeshSetReceive(&wifi_default, receive, ptr);
+}
+/**
+ * 
+ * @param delay_ms
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_MeshSetBatching(uint16_t delay_ms)
+{
+    return WIFI_CtxMeshSetBatching(&wifi_default, delay_ms);
+}
+/**
+ * 
+ * @param data
+ * @param length
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_MeshSend(const void* data, uint16_t length)
+{
+    return WIFI_CtxMeshSend(&wifi_default, data, length);
+}
+/**
+ * 
+ * @param mac
+ * @param data
+ * @param length
+ * @return 
+ */
+int ICACHE_FLASH_ATTR WIFI_MeshSendTo(const uint8_t* mac, const void* data, uint16_t length)
+{
+    return WIFI_CtxMeshSendTo(&wifi_default, mac, data, length);
+}
+#endif
+/**
+ * 
+ * @return 
+ */
+const char* WIFI_GetMAC(void)
+{
+    return WIFI_CtxGetMAC(&wifi_default);
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * the private functions and the SDK callbacks work on 'c' from now on; a new one gets its defaults first
+ * 
+ * @param c
+ */
+static void ICACHE_FLASH_ATTR ctx_select(WIFI_Ctx* c)
+{
+    ctx = c;
+    
+    if(c->m_Ready != 0) {
+        return;
+    }
+    
+    c->m_Ready       = 1;
+    c->m_RetryPolicy = &retry_defaults;
+    c->m_RoamPolicy  = &roam_defaults;
+    c->m_PowerPolicy = power_balanced;
+    c->m_PowerSleep  = 0xFF;
+    c->m_PowerListen = 0xFF;
+    c->m_RunWake     = 1;
+    
+    c->m_Wifi.m_EventDriven = 1;                                                // WIFI_SetEventDriven() may come before or after WIFI_*Initialize()
+#if defined(WITH_MESH_UDP)
+    c->m_MeshBatchMs = MESH_BATCH_MS;
+#endif
+#if defined(WITH_STATE_STATS)
+    c->m_TimingSince = system_get_time();
+#endif
+#if defined(WITH_TRACE)
+    c->m_TraceAt     = system_get_time();
+#endif
+}
+/**
+ * 
+ * @param flash
+ */
+static void ICACHE_FLASH_ATTR ctx_reset(uint8_t flash)
+{
+    ctx->m_State                       = none;
+    ctx->m_MeshState                   = none;
+    ctx->m_Wifi.m_OnConnectCallback    = 0;
+    ctx->m_Wifi.m_OnDisconnectCallback = 0;
+    ctx->m_Wifi.m_CallbackPtr          = 0;
+    
+    if(flash != 0) {
+        ctx->m_Wifi.m_StationConfig.ssid[0]     = '\0';
+        ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+        ctx->m_Wifi.m_StationConfig.bssid_set   = 0;
+        
+        ctx->m_Flash.m_Loaded = 0;                                              // read what is in flash now
+        
+        config_opmode(NULL_MODE, 1);
+        config_station(&ctx->m_Wifi.m_StationConfig, 1);
+        config_auto_connect(0);
+    }
+    
+    ctx->m_Wifi.m_LastReason = 0;                                               // m_EventDriven is left as the application set it
+    wifi_set_event_handler_cb(wifi_event_callback);
+    
+    ctx->m_Wifi.m_FastConnect = 0;
+    ctx->m_Wifi.m_Channel     = 0;
+    os_memset(ctx->m_Wifi.m_Bssid, 0, sizeof(ctx->m_Wifi.m_Bssid));
+    os_memset(&ctx->m_ScanPlan, 0, sizeof(ctx->m_ScanPlan));
+    os_memset(&ctx->m_Retry, 0, sizeof(ctx->m_Retry));
+    os_memset(&ctx->m_MeshRetry, 0, sizeof(ctx->m_MeshRetry));
+    os_memset(&ctx->m_Roam, 0, sizeof(ctx->m_Roam));
+    ctx->m_PowerSleep  = 0xFF;                                                  // set again by the next WIFI_Run()
+    ctx->m_PowerListen = 0xFF;
+    ctx->m_BestSsid    = NULL;
+    
+    ctx->m_MeshStatus  = MESH_STATUS_NONE;
+    ctx->m_MeshHops    = 0;
+    ctx->m_ParentCount = 0;
+    ctx->m_ParentNext  = 0;
+    route_reset();
+#if defined(WITH_MESH_UDP)
+    mesh_udp_stop();                                                            // an earlier call in this boot may have bound the port
+#endif
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR run_wake(void)
+{
+    ctx->m_RunWake = 1;
+    
+    if(ctx->m_RunWakeup != NULL) {
+        ctx->m_RunWakeup(ctx->m_RunWakeupPtr);
+    }
+}
+/**
+ * 
+ * @param start
+ * @param start_mesh
+ */
+static void ICACHE_FLASH_ATTR run_poll(WIFI_state_t start, WIFI_Mesh_state_t start_mesh)
+{
+    int poll = WIFI_RUN_IDLE;
+    
+    switch(ctx->m_State) {
+        case wifi_connect:
+        case wifi_connect_fail:
+        case wifi_connect_done:
+        case wifi_disconnect:
+        case wifi_disconnect_done:
+        case wifi_scan_done:
+            poll = 0;                                                           // the next step is due now
+            break;
+            
+        case wifi_scan:
+            if(ctx->m_Roam.m_Scan != ROAM_SCANNING) {
+                poll = 0;
+            }
+            break;                                                              // else roam_scan_callback() wakes us
+            
+#if defined(WITH_IP_CACHE)
+        case wifi_connect_verify:
+            poll = RUN_POLL_MS;                                                 // no callback for the ARP answer
+            break;
+            
+#endif
+        case wifi_ready:
+            if(ctx->m_Wifi.m_WIFIMode == ap_fixed_auto && ctx->m_RoamPolicy->threshold != 0 && ctx->m_Roam.m_Scan == ROAM_SCAN_DONE) {
+                poll = 0;
+            }
+            break;
+            
+        default:                                                                // waiting for a deadline or a callback
+            break;
+    }
+    
+    switch(ctx->m_MeshState) {
+        case none:
+            if(ctx->m_State == wifi_disabled) {
+                poll = 0;
+            }
+            break;
+            
+        case mesh_connect:
+        case mesh_scan_done:
+            poll = 0;
+            break;
+            
+        default:
+            break;
+    }
+    
+    if(ctx->m_State != start || ctx->m_MeshState != start_mesh) {
+        poll = 0;                                                               // power_apply() above saw the old state
+    }
+    
+#if defined(WITH_LOG_RING)
+    if(log_tail != log_head) {
+        poll = 0;                                                               // more than WIFI_LOG_DRAIN_MAX were waiting
+    }
+#endif
+#if defined(WITH_STATE_STATS) || defined(WITH_TRACE)
+    if(poll == WIFI_RUN_IDLE) {
+        poll = RUN_MAX_MS;
+    }
+#endif
+    
+    if(ctx->m_RunWakeup == NULL && (poll == WIFI_RUN_IDLE || poll > RUN_POLL_MS)) {
+        poll = RUN_POLL_MS;                                                     // nothing would tell the application about a callback
+    }
+    
+    if(poll == WIFI_RUN_IDLE) {
+        deadline_clear(DEADLINE_RUN);
+    }
+    else {
+        deadline_set(DEADLINE_RUN, (uint32_t)poll);
+    }
+}
+/**
+ * 
+ * @param d
+ * @param ms
+ */
+static void ICACHE_FLASH_ATTR deadline_set(uint8_t d, uint32_t ms)
+{
+    countdown_ms(&ctx->m_Deadline[d], ms);
+    
+    ctx->m_DeadlineSet |= (uint16_t)(1 << d);
+    
+    if((DEADLINE_WAKE & (1 << d)) != 0) {
+        deadline_find();
+    }
+}
+/**
+ * 
+ * @param d
+ * @param ms
+ */
+static void ICACHE_FLASH_ATTR deadline_lazy(uint8_t d, uint32_t ms)
+{
+    uint16_t set  = (uint16_t)(ctx->m_DeadlineSet & DEADLINE_WAKE & ~(1 << d));
+    int      best = -1;
+    int      left = 0;
+    uint8_t  i;
+    
+    for(i = 0; i < DEADLINES; i++) {
+        if((set & (1 << i)) != 0) {
+            int l = left_ms(&ctx->m_Deadline[i]);
+            
+            if(l >= (int)ms && l <= (int)(ms + ms / DEADLINE_LAZY) && (best < 0 || l < left)) {
+                best = i;
+                left = l;
+            }
+        }
+    }
+    
+    if(best < 0) {
+        deadline_set(d, ms);
+        return;
+    }
+    
+    ctx->m_Deadline[d]  = ctx->m_Deadline[best];                                // one WIFI_Run() call for both
+    ctx->m_DeadlineSet |= (uint16_t)(1 << d);
+    
+    deadline_find();
+}
+/**
+ * 
+ * @param d
+ */
+static void ICACHE_FLASH_ATTR deadline_clear(uint8_t d)
+{
+    ctx->m_DeadlineSet &= (uint16_t)~(1 << d);
+    
+    if((DEADLINE_WAKE & (1 << d)) != 0) {
+        deadline_find();
+    }
+}
+/**
+ * 
+ * @param d
+ * @return 
+ */
+static uint8_t ICACHE_FLASH_ATTR deadline_passed(uint8_t d)
+{
+    return ((ctx->m_DeadlineSet & (1 << d)) == 0 || expired(&ctx->m_Deadline[d])) ? 1 : 0;
+}
+/**
+ * 
+ * @return 
+ */
+static uint8_t ICACHE_FLASH_ATTR deadline_due(void)
+{
+    return ((ctx->m_DeadlineSet & DEADLINE_WAKE) != 0 && expired(&ctx->m_Deadline[ctx->m_DeadlineNext])) ? 1 : 0;
+}
+/**
+ * 
+ * @return 
+ */
+static int ICACHE_FLASH_ATTR deadline_next(void)
+{
+    if((ctx->m_DeadlineSet & DEADLINE_WAKE) == 0) {
+        return WIFI_RUN_IDLE;
+    }
+    
+    int left = left_ms(&ctx->m_Deadline[ctx->m_DeadlineNext]);
+    
+    return (left < 0) ? 0 : left;
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR deadline_drop(void)
+{
+    uint8_t i;
+    
+    for(i = 0; i < DEADLINES; i++) {
+        if((ctx->m_DeadlineSet & DEADLINE_WAKE & (1 << i)) != 0 && expired(&ctx->m_Deadline[i])) {
+            ctx->m_DeadlineSet &= (uint16_t)~(1 << i);
+        }
+    }
+    
+    deadline_find();
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR deadline_find(void)
+{
+    uint16_t set  = (uint16_t)(ctx->m_DeadlineSet & DEADLINE_WAKE);
+    int      left = -1;
+    uint8_t  i;
+    
+    for(i = 0; set != 0; i++, set >>= 1) {
+        if((set & 1) != 0) {
+            int l = left_ms(&ctx->m_Deadline[i]);
+            
+            if(left < 0 || l < left) {
+                ctx->m_DeadlineNext = i;
+                left                = (l < 0) ? 0 : l;
+            }
+        }
+    }
+}
+/**
+ * 
+ * @param event
+ * @param type
+ */
+static void ICACHE_FLASH_ATTR event_init(WIFI_Event* event, uint8_t type)
+{
+    os_memset(event, 0, sizeof(*event));
+    
+    event->type = type;
+}
+/**
+ * 
+ * @param event
+ */
+static void ICACHE_FLASH_ATTR event_publish(const WIFI_Event* event)
+{
+    WIFI_Ctx* c    = ctx;
+    uint16_t  bits = ctx->m_EventMask[event->type];
+    
+    while(bits != 0) {
+        int slot = __builtin_ctz(bits);
+        
+        bits &= (uint16_t)(bits - 1);
+        
+        if((c->m_EventMask[event->type] & (1 << slot)) != 0) {                  // an earlier handler may have unsubscribed it
+            c->m_Subscriber[slot].m_Handler(event, c->m_Subscriber[slot].m_Ptr);
+            
+            ctx = c;                                                            // the handler may have used another WIFI_Ctx
+        }
+    }
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR event_link(void)
+{
+    uint8_t    up = (ctx->m_State == wifi_ready || ctx->m_MeshState == mesh_connect_done) ? 1 : 0;
+    WIFI_Event event;
+    
+    if(up == ctx->m_EventLink) {
+        return;
+    }
+    
+    ctx->m_EventLink = up;
+    
+    if(up == 0) {
+        event_init(&event, event_lost_ip);
+        event.reason = ctx->m_Wifi.m_LastReason;
+        event_publish(&event);
+        return;
+    }
+    
+    event_init(&event, event_got_ip);
+    event.channel = wifi_get_channel();
+    event.ip      = ctx->m_Wifi.m_Info.ip.addr;
+    event_publish(&event);
+    
+    if(ctx->m_Roam.m_Switched != 0) {
+        ctx->m_Roam.m_Switched = 0;
+        
+        event_init(&event, event_roamed);
+        event.channel = wifi_get_channel();
+        event.rssi    = wifi_station_get_rssi();
+        os_memcpy(event.mac, ctx->m_Wifi.m_StationConfig.bssid, sizeof(event.mac));
+        event_publish(&event);
+    }
+}
+/**
+ * 
+ * @param evt
+ */
+static void ICACHE_FLASH_ATTR event_sdk(System_Event_t* evt)
+{
+    WIFI_Event event;
+    
+    switch(evt->event) {
+        case EVENT_STAMODE_CONNECTED:
+            event_init(&event, event_connected);
+            event.channel = evt->event_info.connected.channel;
+            os_memcpy(event.mac, evt->event_info.connected.bssid, sizeof(event.mac));
+            break;
+            
+        case EVENT_SOFTAPMODE_STACONNECTED:
+            event_init(&event, event_mesh_child);
+            event.count = wifi_softap_get_station_num();
+            os_memcpy(event.mac, evt->event_info.sta_connected.mac, sizeof(event.mac));
+            break;
+            
+        default:
+            return;
+    }
+    
+    event_publish(&event);
+}
+/**
+ * 
+ * @param bss
+ * @param status
+ */
+static void ICACHE_FLASH_ATTR event_scan(struct bss_info* bss, STATUS status)
+{
+    WIFI_Event event;
+    
+    if(ctx->m_EventMask[event_scan_done] == 0) {
+        return;                                                                 // don't walk the list for nobody
+    }
+    
+    event_init(&event, event_scan_done);
+    event.reason = (uint16_t)status;
+    
+    for(; status == OK && bss != NULL; bss = bss->next.stqe_next) {
+        event.count++;
+    }
+    
+    event_publish(&event);
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_connect(void)
+{
+    DTXT("do_wifi_connect(): begin\n");
+    
+    ctx->m_Wifi.m_LastReason = 0;
+    
+    switch(ctx->m_Wifi.m_WIFIMode) {
+        case ap_fixed:
+        case ap_fixed_auto:
+            // required to call wifi_set_opmode before station_set_config
+            config_opmode(STATION_MODE, 0);
+
+            config_station(&ctx->m_Wifi.m_StationConfig, 0);
+            
+            if(ctx->m_Wifi.m_FastConnect != 0) {
+                wifi_set_channel(ctx->m_Wifi.m_Channel);                        // no need for the SDK to sweep for the AP
+            }
+            
+#if defined(WITH_AP_STATS)
+            if(ctx->m_Wifi.m_WIFIMode == ap_fixed_auto) {
+                stats_attempt();
+            }
+#endif
+            
+#if defined(WITH_IP_CACHE)
+            ip_cache_apply();
+#endif
+#if defined(WITH_STATE_STATS)
+            timing_start(TIMING_IP);
+#endif
+#if defined(WITH_TRACE)
+            trace_put(trace_connect, (ctx->m_Wifi.m_FastConnect != 0) ? ctx->m_Wifi.m_Channel : 0, ctx->m_Retry.m_Attempts);
+#endif
+            wifi_station_connect();
+
+            wifi_station_set_reconnect_policy(true);                            // not persisted, unlike auto connect
+            break;
+            
+        case mesh_root:
+            // required to call wifi_set_opmode before station_set_config
+            config_opmode(STATION_MODE, 0);
+
+            config_station(&ctx->m_Wifi.m_StationConfig, 0);
+#if defined(WITH_STATE_STATS)
+            timing_start(TIMING_IP);
+#endif
+#if defined(WITH_TRACE)
+            trace_put(trace_connect, 0, ctx->m_Retry.m_Attempts);
+#endif
+            wifi_station_connect();
+
+            wifi_station_set_reconnect_policy(true);
+            break;
+            
+        case mesh_non_leaf:
+            break;
+            
+        case mesh_leaf:
+            break;
+    }
+    
+    DTXT("do_wifi_connect(): end\n");
+    
+    return wifi_connect_in_progress;
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_connect_done(void)
+{
+    DTXT("do_wifi_connect_done(): begin\n");
+    
+    WIFI_state_t state = wifi_ready;
+    
+#if defined(WITH_STATE_STATS)
+    timing_stop(TIMING_IP);
+    timing_stop(TIMING_RECONNECT);
+#endif
+#if defined(WITH_TRACE)
+    trace_put(trace_got_ip, wifi_get_channel(), (uint16_t)wifi_station_get_rssi());
+#endif
+    
+    ctx->m_Retry.m_Attempts   = 0;
+    ctx->m_Wifi.m_FastConnect = 0;                                              // later reconnects go through the normal path
+    
+    resume_save();
+    
+    wifi_get_ip_info(STATION_IF, &(ctx->m_Wifi.m_Info));
+    
+    DTXT("do_wifi_connect_done(): ip = %d.%d.%d.%d\n", ip4_addr1(&ctx->m_Wifi.m_Info.ip), ip4_addr2(&ctx->m_Wifi.m_Info.ip), ip4_addr3(&ctx->m_Wifi.m_Info.ip), ip4_addr4(&ctx->m_Wifi.m_Info.ip));
+    
+    switch(ctx->m_Wifi.m_WIFIMode) {
+        case ap_fixed:
+            DTXT("do_wifi_connect_done(): ap_fixed\n");
+            fast_connect_save();
+            ctx->m_Wifi.m_StationConfig.bssid_set = 0;                          // any AP with the SSID will do next time
+            break;
+            
+        case ap_fixed_auto:
+            DTXT("do_wifi_connect_done(): ap_fixed_auto\n");
+            fast_connect_save();
+            roam_reset();
+#if defined(WITH_AP_STATS)
+            stats_success();
+#endif
+            break;
+            
+        case mesh_root:
+            DTXT("do_wifi_connect_done(): mesh_root\n");
+            config_opmode(STATIONAP_MODE, 0);
+            
+            ctx->m_MeshStatus = MESH_STATUS_CONNECTED;
+            ctx->m_MeshHops   = 0;
+
+            build_mesh_ap_ssid(ctx->m_MeshStatus);
+        
+            config_softap(&ctx->m_Mesh.m_ApConfig, 0);
+            
+#if defined(WITH_MESH_UDP)
+            mesh_udp_start();
+#endif
+            break;
+            
+        case mesh_non_leaf:
+            DTXT("do_wifi_connect_done(): mesh_non_leaf\n");
+            break;
+            
+        case mesh_leaf:
+            DTXT("do_wifi_connect_done(): mesh_leaf\n");
+            break;
+    }
+                
+    DTXT("do_wifi_connect_done(): end\n");
+    
+    return state;
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_disconnect(void)
+{
+    DTXT("do_wifi_disconnect(): begin\n");
+    
+    switch(ctx->m_Wifi.m_WIFIMode) {
+        case ap_fixed:
+            config_auto_connect(0);
+            wifi_station_disconnect();
+            break;
+            
+        case ap_fixed_auto:
+            config_auto_connect(0);
+            wifi_station_disconnect();
+            break;
+            
+        case mesh_root:
+            config_auto_connect(0);
+            wifi_station_disconnect();
+
+            ctx->m_MeshStatus = MESH_STATUS_NONE;
+
+            build_mesh_ap_ssid(ctx->m_MeshStatus);
+            
+            config_softap(&ctx->m_Mesh.m_ApConfig, 0);
+            break;
+            
+        case mesh_non_leaf:
+            break;
+            
+        case mesh_leaf:
+            break;
+    }
+    
+    DTXT("do_wifi_disconnect(): end\n");
+    
+    return wifi_disconnect_in_progress;
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_disconnect_done(void)
+{
+    DTXT("do_wifi_disconnect_done(): begin\n");
+    
+    WIFI_state_t state = wifi_disabled;
+    
+    DTXT("do_wifi_disconnect_done(): end\n");
+    
+    return state;
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_check(void)
+{
+    WIFI_state_t state;
+    
+    uint8_t wifi_status = wifi_station_get_connect_status();
+    
+#if defined(WITH_STATE_STATS)
+    if(wifi_status != STATION_GOT_IP) {
+        timing_check(wifi_status);
+    }
+#endif
+#if defined(WITH_TRACE)
+    if(wifi_status != STATION_GOT_IP) {
+        trace_put(trace_check, wifi_status, ctx->m_Wifi.m_LastReason);
+    }
+#endif
+    
+    switch(wifi_status) {
+        case STATION_IDLE:
+            DTXT("do_wifi_check(): STATION_IDLE\n");
+            state = wifi_connect_fail;
+            break;
+            
+        case STATION_GOT_IP:
+            //DTXT("do_wifi_check(): STATION_GOT_IP\n");
+            state = wifi_connect_done;
+            break;
+            
+        case STATION_WRONG_PASSWORD:
+            DTXT("do_wifi_check(): STATION_WRONG_PASSWORD\n");
+            state = wifi_connect_fail;
+            break;
+
+        case STATION_NO_AP_FOUND:
+            DTXT("do_wifi_check(): STATION_NO_AP_FOUND\n");
+            state = wifi_connect_fail;
+            break;
+
+        case STATION_CONNECT_FAIL:
+            DTXT("do_wifi_check(): STATION_CONNECT_FAIL\n");
+            state = wifi_connect_fail;
+            break;
+        
+        default:
+            DTXT("do_wifi_check(): wifi not connected; wifi_status = %d\n", wifi_status);
+            state = wifi_connect_fail;
+            break;
+    }
+                
+    return state;
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_Mesh_state_t ICACHE_FLASH_ATTR do_wifi_mesh_connect(void)
+{
+    DTXT("do_wifi_mesh_connect(): begin\n");
+
+    config_auto_connect(0);
+    wifi_station_disconnect();
+    
+    // the SDK only scans with the station interface up
+    config_opmode(STATION_MODE, 0);
+    
+    struct scan_config config;
+    
+    os_memset(&config, 0, sizeof(config));
+    
+    ctx->m_ParentCount = 0;
+    ctx->m_ParentNext  = 0;
+    
+    // all mesh nodes share the root's channel, so look there first
+    ctx->m_ScanPlan.m_MeshFull = (ctx->m_ScanPlan.m_MeshChannel == 0) ? 1 : 0;
+    config.channel             = ctx->m_ScanPlan.m_MeshChannel;
+    
+    // start scan
+#if defined(WITH_STATE_STATS)
+    timing_start(TIMING_SCAN);
+#endif
+    if(!wifi_station_scan(&config, &mesh_scan_callback)) {
+        DTXT("do_wifi_mesh_connect(): scan not started\n");
+        
+        return mesh_scan_done;                                                  // no parents; back off
+    }
+    
+    DTXT("do_wifi_mesh_connect(): end\n");
+    
+    return mesh_scan_in_progress;
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_scan(void)
+{
+    DTXT("do_wifi_scan(): begin\n");
+    
+    if(ctx->m_Roam.m_Scan == ROAM_SCANNING) {
+        return wifi_scan;                                                       // the SDK runs one scan at a time; wait for the background one
+    }
+    
+    // ensure we are in station mode
+    config_opmode(STATION_MODE, 0);
+    
+    struct scan_config config;
+    
+    os_memset(&config, 0, sizeof(config));
+    
+    if(ctx->m_ScanPlan.m_Active == 0) {                                         // new round
+        ctx->m_ScanPlan.m_Active  = 1;
+        ctx->m_ScanPlan.m_Pending = ctx->m_ScanPlan.m_Known & SCAN_CHANNELS;
+        ctx->m_ScanPlan.m_Found   = 0;
+        
+        ctx->m_CandidateCount = 0;
+        ctx->m_CandidateNext  = 0;
+    }
+    
+    config.channel = scan_next_channel(&ctx->m_ScanPlan.m_Pending);
+    
+    if(config.channel != 0) {
+        ctx->m_ScanPlan.m_Full = 0;
+        
+        if(ctx->m_List != NULL && ctx->m_List[0].ssid != NULL && ctx->m_List[1].ssid == NULL) {
+            config.ssid = (uint8*)ctx->m_List[0].ssid;                          // only one to look for; let the SDK filter
+        }
+    }
+    else {
+        ctx->m_ScanPlan.m_Full = 1;
+    }
+   
+#if defined(WITH_STATE_STATS)
+    timing_start(TIMING_SCAN);
+#endif
+    bool rc = wifi_station_scan(&config, scan_done_callback);
+    
+    DTXT("do_wifi_scan(): end; rc = %s, channel = %d\n", rc ? "True" : "False", config.channel);
+    
+    if(!rc) {
+#if defined(WITH_STATE_STATS)
+        ctx->m_TimingPending &= (uint8_t)~(1 << TIMING_SCAN);                   // no scan to time
+#endif
+        if(config.channel != 0) {
+            ctx->m_ScanPlan.m_Pending |= (uint16_t)(1 << config.channel);       // this channel again with the retry
+        }
+        
+        deadline_set(DEADLINE_SCAN_RETRY, SCAN_RETRY_SECONDS * 1000u);
+        
+        return wifi_scan_fail;
+    }
+    
+    return wifi_scan_in_progress;
+}
+/**
+ * 
+ * @param pending
+ * @return 
+ */
+static uint8_t ICACHE_FLASH_ATTR scan_next_channel(uint16_t* pending)
+{
+    uint8_t channel;
+    
+    for(channel = 1; channel <= 14; channel++) {
+        if((*pending & (1 << channel)) != 0) {
+            *pending &= (uint16_t)~(1 << channel);
+            return channel;
+        }
+    }
+    
+    *pending = 0;                                                               // nothing scannable left
+    
+    return 0;
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_scan_done(void)
+{
+    DTXT("do_wifi_scan_done(): begin\n");
+
+    WIFI_state_t state;
+    
+    if(ctx->m_CandidateCount > 0) {
+        deadline_set(DEADLINE_CANDIDATES, CANDIDATES_STALE_SECONDS * 1000u);
+        
+        state = candidate_connect();
+    }
+    else {
+        state = do_wifi_retry(retry_no_ap_found);                               // scan again later
+    }
+    
+    DTXT("do_wifi_scan_done(): end\n");
+    
+    return state;
+}
+/**
+ * 
+ * @param arg
+ * @param status
+ */
+static void ICACHE_FLASH_ATTR scan_done_callback(void* arg, STATUS status)
+{
+    DTXT("scan_done_callback(): begin\n");
+
+    struct bss_info *bss = arg;
+    
+    run_wake();
+    event_scan(bss, status);
+    
+#if defined(WITH_STATE_STATS)
+    timing_stop(TIMING_SCAN);
+#endif
+    
+    WIFI_AP* s;
+#if defined(WITH_TRACE)
+    uint8_t  seen = 0;
+    uint8_t  ours = 0;
+    sint8    best = -128;
+#endif
+    
+    switch(status) {
+        case OK:
+            DTXT("scan_done_callback(): status == OK\n");
+            
+            while(bss) {
+                DDBG("scan_done_callback(): " BSSIDSTR " %d %d\n", BSSID2STR(bss->bssid), bss->channel, bss->rssi);
+                
+                s = wifi_find_ssid(bss->ssid, bss->ssid_len);
+                
+                if(s != NULL) {
+                    ctx->m_ScanPlan.m_Found |= (1 << bss->channel);
+                    
+                    candidate_add(s, bss);
+#if defined(WITH_TRACE)
+                    ours += (ours < 0xFF) ? 1 : 0;
+                    best  = (bss->rssi > best) ? bss->rssi : best;
+#endif
+                }
+#if defined(WITH_TRACE)
+                seen += (seen < 0xFF) ? 1 : 0;
+#endif
+                
+                //DTXT("bssid: %02x:%02x:%02x:%02x:%02x:%02x\n", MAC2STR(inf->bssid));
+                //DTXT("ssid:  %s\n", (char*)inf->ssid);
+                //DTXT("rssi:  %d\n", inf->rssi);
+                
+                    //os()->jsonRpc()->getJEncoder()->setName("bssid");   os()->jsonRpc()->getJEncoder()->setString(b);
+                    //os()->jsonRpc()->getJEncoder()->setName("ssid");    os()->jsonRpc()->getJEncoder()->setString((char*)inf->ssid);
+                    //os()->jsonRpc()->getJEncoder()->setName("channel"); os()->jsonRpc()->getJEncoder()->setInt(inf->channel);
+                    //os()->jsonRpc()->getJEncoder()->setName("rssi");    os()->jsonRpc()->getJEncoder()->setInt(inf->rssi);
+                    //os()->jsonRpc()->getJEncoder()->setName("auth");    os()->jsonRpc()->getJEncoder()->setString(auth_to_string(b, inf->authmode));                            
+
+                bss = bss->next.stqe_next;
+            }
+            
+#if defined(WITH_TRACE)
+            trace_put(trace_scan, seen, (uint16_t)((ours << 8) | (uint8_t)best));
+#endif
+            
+            if(ctx->m_ScanPlan.m_Full != 0) {
+                ctx->m_ScanPlan.m_Known = ctx->m_ScanPlan.m_Found;              // forget channels our SSIDs left
+            }
+            else {
+                ctx->m_ScanPlan.m_Known |= ctx->m_ScanPlan.m_Found;
+            }
+            
+            if(ctx->m_ScanPlan.m_Pending != 0 || (ctx->m_CandidateCount == 0 && ctx->m_ScanPlan.m_Full == 0)) {
+                ctx->m_State = wifi_scan;                                       // next channel, or the full sweep
+            }
+            else {
+                ctx->m_ScanPlan.m_Active = 0;
+                ctx->m_State             = wifi_scan_done;
+            }
+            break;
+            
+        case FAIL:
+        case PENDING:
+        case BUSY:
+        case CANCEL:
+            DTXT("scan_done_callback(): status = %d\n", status);
+            ctx->m_State = wifi_scan_fail;
+            
+            deadline_set(DEADLINE_SCAN_RETRY, SCAN_RETRY_SECONDS * 1000u);
+            break;
+    }
+    
+    DTXT("scan_done_callback(): end\n");    
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_Mesh_state_t ICACHE_FLASH_ATTR do_wifi_mesh_check(void)
+{
+    uint8_t wifi_status = wifi_station_get_connect_status();
+    
+    if(ctx->m_MeshState == mesh_connect_in_progress) {
+        if(wifi_status == STATION_GOT_IP) {
+            return mesh_connect_done;
+        }
+        
+        if(wifi_status == STATION_CONNECTING && !deadline_passed(DEADLINE_MESH_CHECK)) {
+            return mesh_connect_in_progress;
+        }
+        
+        DTXT("do_wifi_mesh_check(): parent failed; wifi_status = %d, reason = %d\n", wifi_status, ctx->m_Wifi.m_LastReason);
+#if defined(WITH_STATE_STATS)
+        timing_check(wifi_status);
+#endif
+#if defined(WITH_TRACE)
+        trace_put(trace_check, wifi_status, ctx->m_Wifi.m_LastReason);
+#endif
+        
+        return mesh_connect_fail;
+    }
+    
+    if(deadline_passed(DEADLINE_ROUTE_RECONCILE)) {                             // the events keep the table current
+        route_reconcile();
+        
+        deadline_set(DEADLINE_ROUTE_RECONCILE, MESH_ROUTE_RECONCILE_SECONDS * 1000u);
+    }
+    
+    if(wifi_status != STATION_GOT_IP) {
+        DTXT("do_wifi_mesh_check(): lost parent; wifi_status = %d\n", wifi_status);
+#if defined(WITH_STATE_STATS)
+        timing_check(wifi_status);
+#endif
+#if defined(WITH_TRACE)
+        trace_put(trace_check, wifi_status, ctx->m_Wifi.m_LastReason);
+#endif
+        
+        return mesh_connect_fail;
+    }
+    
+    return mesh_connect_done;
+}
+/**
+ * joined the mesh; open our own softAP one hop further from the root
+ * 
+ * @return 
+ */
+static WIFI_Mesh_state_t ICACHE_FLASH_ATTR do_wifi_mesh_connect_done(void)
+{
+    DTXT("do_wifi_mesh_connect_done(): begin\n");
+    
+    WIFI_Event event;
+    
+#if defined(WITH_STATE_STATS)
+    timing_stop(TIMING_IP);
+    timing_stop(TIMING_RECONNECT);
+#endif
+#if defined(WITH_TRACE)
+    trace_put(trace_got_ip, wifi_get_channel(), (uint16_t)wifi_station_get_rssi());
+#endif
+    
+    ctx->m_MeshRetry.m_Attempts = 0;
+    
+    wifi_get_ip_info(STATION_IF, &(ctx->m_Wifi.m_Info));
+    
+    DTXT("do_wifi_mesh_connect_done(): ip = %d.%d.%d.%d, hops = %d\n", ip4_addr1(&ctx->m_Wifi.m_Info.ip), ip4_addr2(&ctx->m_Wifi.m_Info.ip), ip4_addr3(&ctx->m_Wifi.m_Info.ip), ip4_addr4(&ctx->m_Wifi.m_Info.ip), ctx->m_MeshHops);
+    
+    if(ctx->m_Wifi.m_WIFIMode != mesh_leaf) {                                   // leaves take no children
+        config_opmode(STATIONAP_MODE, 0);
+        
+        ctx->m_MeshStatus = MESH_STATUS_CONNECTED;
+        
+        build_mesh_ap_ssid(ctx->m_MeshStatus);
+        
+        config_softap(&ctx->m_Mesh.m_ApConfig, 0);
+    }
+    
+#if defined(WITH_MESH_UDP)
+    mesh_udp_start();
+#endif
+    
+    if(ctx->m_Wifi.m_OnConnectCallback != 0) {
+        ctx->m_Wifi.m_OnConnectCallback(1, ctx->m_Wifi.m_CallbackPtr);          // notify user
+    }
+    
+    event_init(&event, event_mesh_parent);
+    event.channel = wifi_get_channel();
+    event.hops    = ctx->m_MeshHops;
+    os_memcpy(event.mac, ctx->m_Wifi.m_StationConfig.bssid, sizeof(event.mac));
+    event_publish(&event);
+    
+    DTXT("do_wifi_mesh_connect_done(): end\n");
+    
+    return mesh_connect_done;
+}
+/**
+ * 
+ * @param arg
+ * @param status
+ */
+static void ICACHE_FLASH_ATTR mesh_scan_callback(void* arg, STATUS status)
+{
+    DTXT("mesh_scan_callback(): begin\n");
+    
+    struct bss_info *bss = arg;
+    
+    uint8_t mesh_seen = 0;
+    uint8_t hops;
+    uint8_t load;
+    int     parent;
+#if defined(WITH_TRACE)
+    uint8_t seen      = 0;
+#endif
+    
+    run_wake();
+    event_scan(bss, status);
+    
+#if defined(WITH_STATE_STATS)
+    timing_stop(TIMING_SCAN);
+#endif
+    
+    switch(status) {
+        case OK:
+            while(bss) {
+                parent = mesh_parse_ssid(bss, &hops, &load);
+                
+                if(parent >= 0) {
+                    ctx->m_ScanPlan.m_MeshChannel = bss->channel;
+                    mesh_seen                     = 1;
+                }
+                
+                if(parent > 0 && (ctx->m_Wifi.m_WIFIMode == mesh_leaf || hops < MESH_MAX_HOPS)) {
+                    parent_add(bss, hops, load);
+                }
+#if defined(WITH_TRACE)
+                seen += (seen < 0xFF) ? 1 : 0;
+#endif
+                
+                bss = bss->next.stqe_next;
+            }
+            
+#if defined(WITH_TRACE)
+            trace_put(trace_mesh_scan, seen, (uint16_t)((ctx->m_ParentCount << 8) | (uint8_t)((ctx->m_ParentCount != 0) ? ctx->m_Parents[0].m_Rssi : 0)));
+#endif
+            
+            if(mesh_seen == 0 && ctx->m_ScanPlan.m_MeshFull == 0) {
+                DTXT("mesh_scan_callback(): mesh not on channel %d; sweeping\n", ctx->m_ScanPlan.m_MeshChannel);
+                
+                ctx->m_ScanPlan.m_MeshChannel = 0;                              // not where we left it
+                ctx->m_MeshState              = mesh_connect;
+                return;
+            }
+            break;
+            
+        case FAIL:
+        case PENDING:
+        case BUSY:
+        case CANCEL:
+            DTXT("mesh_scan_callback(): status = %d\n", status);
+            break;
+    }
+    
+    ctx->m_MeshState = mesh_scan_done;
+    
+    DTXT("mesh_scan_callback(): end; parents = %d\n", ctx->m_ParentCount);
+}
+/**
+ * mesh softAP SSIDs are prefix_<status><hops><load>_<MAC>; the older prefix_<status>_<MAC> is read as hops 0, load 0
+ * 
+ * @param bss
+ * @param hops
+ * @param load
+ * @return -1 = not a mesh SSID, 0 = mesh node without a route to the root, 1 = usable parent
+ */
+static int ICACHE_FLASH_ATTR mesh_parse_ssid(const struct bss_info* bss, uint8_t* hops, uint8_t* load)
+{
+    size_t         length = os_strlen(ctx->m_MeshPrefix);
+    const uint8_t* p      = bss->ssid + length + 1;
+    size_t         digits;
+    
+    if(length == 0 || bss->ssid_len < length + 3 || os_memcmp(bss->ssid, ctx->m_MeshPrefix, length) != 0 || bss->ssid[length] != '_') {
+        return -1;
+    }
+    
+    for(digits = 0; length + 1 + digits < bss->ssid_len && p[digits] != '_'; digits++) {
+        if(p[digits] < '0' || p[digits] > '9') {
+            return -1;
+        }
+    }
+    
+    if((digits != 1 && digits != 3) || length + 1 + digits == bss->ssid_len) {
+        return -1;
+    }
+    
+    if(bss->ssid_len - (length + 2 + digits) == os_strlen(ctx->m_MeshPostfix) &&
+       os_memcmp(p + digits + 1, ctx->m_MeshPostfix, os_strlen(ctx->m_MeshPostfix)) == 0) {
+        return -1;                                                              // our own softAP from before a restart
+    }
+    
+    *hops = (digits == 3) ? (uint8_t)(p[1] - '0') : 0;
+    *load = (digits == 3) ? (uint8_t)(p[2] - '0') : 0;
+    
+    return (p[0] == MESH_STATUS_CONNECTED) ? 1 : 0;
+}
+/**
+ * keep the WIFI_MAX_PARENTS best, best first; a hop closer to the root or a less loaded parent is worth a few dB
+ * 
+ * @param bss
+ * @param hops
+ * @param load
+ */
+static void ICACHE_FLASH_ATTR parent_add(const struct bss_info* bss, uint8_t hops, uint8_t load)
+{
+    int    i     = ctx->m_ParentCount;
+    sint16 score = bss->rssi - hops * MESH_HOP_PENALTY - load * MESH_LOAD_PENALTY;
+    
+    if(bss->rssi < MESH_MIN_RSSI) {
+        score -= 100;                                                           // a link this weak won't hold; last resort
+    }
+    
+    DDBG("parent_add(): %.*s %d dBm, hops = %d, load = %d, score = %d\n", bss->ssid_len, bss->ssid, bss->rssi, hops, load, score);
+    
+    if(i == WIFI_MAX_PARENTS) {
+        if(score <= ctx->m_Parents[i - 1].m_Score) {
+            return;
+        }
+        
+        i--;                                                                    // the worst makes room
+    }
+    else {
+        ctx->m_ParentCount++;
+    }
+    
+    while(i > 0 && ctx->m_Parents[i - 1].m_Score < score) {
+        ctx->m_Parents[i] = ctx->m_Parents[i - 1];
+        i--;
+    }
+    
+    os_memcpy(ctx->m_Parents[i].m_Ssid, bss->ssid, sizeof(ctx->m_Parents[i].m_Ssid));
+    os_memcpy(ctx->m_Parents[i].m_Bssid, bss->bssid, sizeof(ctx->m_Parents[i].m_Bssid));
+    ctx->m_Parents[i].m_SsidLen = bss->ssid_len;
+    ctx->m_Parents[i].m_Channel = bss->channel;
+    ctx->m_Parents[i].m_Hops    = hops;
+    ctx->m_Parents[i].m_Load    = load;
+    ctx->m_Parents[i].m_Rssi    = bss->rssi;
+    ctx->m_Parents[i].m_Score   = score;
+}
+/**
+ * join the next parent; the BSSID is pinned since every node's softAP has a different SSID anyway
+ * 
+ * @return 
+ */
+static WIFI_Mesh_state_t ICACHE_FLASH_ATTR parent_connect(void)
+{
+    WIFIParent* p = &ctx->m_Parents[ctx->m_ParentNext++];
+    
+    DTXT("parent_connect(): %d of %d, %.*s at %d dBm\n", ctx->m_ParentNext, ctx->m_ParentCount, p->m_SsidLen, p->m_Ssid, p->m_Rssi);
+    
+    ctx->m_Wifi.m_LastReason = 0;
+    
+    wifi_station_disconnect();
+    
+    os_memset(ctx->m_Wifi.m_StationConfig.ssid, 0, sizeof(ctx->m_Wifi.m_StationConfig.ssid));
+    os_memcpy(ctx->m_Wifi.m_StationConfig.ssid, p->m_Ssid, p->m_SsidLen);
+    os_memcpy(ctx->m_Wifi.m_StationConfig.bssid, p->m_Bssid, sizeof(ctx->m_Wifi.m_StationConfig.bssid));
+    
+    ctx->m_Wifi.m_StationConfig.password[0] = '\0';                             // mesh softAPs are open
+    ctx->m_Wifi.m_StationConfig.bssid_set   = 1;
+    
+    config_station(&ctx->m_Wifi.m_StationConfig, 0);
+    
+    wifi_set_channel(p->m_Channel);
+#if defined(WITH_STATE_STATS)
+    timing_start(TIMING_IP);
+#endif
+#if defined(WITH_TRACE)
+    trace_put(trace_connect, p->m_Channel, ctx->m_MeshRetry.m_Attempts);
+#endif
+    wifi_station_connect();
+    
+    ctx->m_MeshHops = p->m_Hops + 1;
+    
+    deadline_set(DEADLINE_MESH_CHECK, MESH_CONNECT_TIMEOUT_SECONDS * 1000u);
+    
+    return mesh_connect_in_progress;
+}
+/**
+ * 
+ * @param mac
+ * @return 
+ */
+static uint8_t ICACHE_FLASH_ATTR route_slot(const uint8_t* mac)
+{
+    return (uint8_t)(((mac[3] * 31u + mac[4]) * 31u + mac[5]) & (WIFI_MAX_ROUTES - 1));  // the NIC specific half
+}
+/**
+ * 
+ * @param mac
+ * @return the entry, or NULL when the node is not below us
+ */
+static WIFIRoute* ICACHE_FLASH_ATTR route_find(const uint8_t* mac)
+{
+    uint8_t i = route_slot(mac);
+    
+    while(ctx->m_Routes[i].m_Used != 0) {                                       // never full, so this ends
+        if(os_memcmp(ctx->m_Routes[i].m_Mac, mac, 6) == 0) {
+            return &ctx->m_Routes[i];
+        }
+        
+        i = (i + 1) & (WIFI_MAX_ROUTES - 1);
+    }
+    
+    return NULL;
+}
+/**
+ * 'mac' is reached through 'child'; a node that moved to another child moves with it. Room for all children is kept,
+ * nodes further down are turned away before that.
+ * 
+ * @param mac
+ * @param child
+ * @return NULL when the table is full
+ */
+static WIFIRoute* ICACHE_FLASH_ATTR route_learn(const uint8_t* mac, uint8_t child)
+{
+    WIFIRoute* r = route_find(mac);
+    
+    if(r == NULL) {
+        uint8_t i = route_slot(mac);
+        
+        if(ctx->m_RouteCount + WIFI_MAX_CHILDREN >= WIFI_MAX_ROUTES * 3 / 4 && os_memcmp(mac, ctx->m_Children[child].m_Mac, 6) != 0) {
+            DDBG("route_learn(): table full\n");
+            return NULL;
+        }
+        
+        while(ctx->m_Routes[i].m_Used != 0) {
+            i = (i + 1) & (WIFI_MAX_ROUTES - 1);
+        }
+        
+        r = &ctx->m_Routes[i];
+        
+        os_memcpy(r->m_Mac, mac, sizeof(r->m_Mac));
+        r->m_Used  = 1;
+        r->m_Child = child;
+        
+        ctx->m_Children[child].m_Routes++;
+        ctx->m_RouteCount++;
+    }
+    else if(r->m_Child != child) {
+        ctx->m_Children[r->m_Child].m_Routes--;
+        ctx->m_Children[child].m_Routes++;
+        
+        r->m_Child = child;
+    }
+    
+    r->m_LastSeen = system_get_time();
+    
+    return r;
+}
+/**
+ * backward shift, so that lookups never have to step over deleted entries
+ * 
+ * @param r
+ */
+static void ICACHE_FLASH_ATTR route_remove(WIFIRoute* r)
+{
+    uint8_t hole = (uint8_t)(r - ctx->m_Routes);
+    uint8_t i    = hole;
+    
+    ctx->m_Children[r->m_Child].m_Routes--;
+    ctx->m_RouteCount--;
+    
+    for(;;) {
+        i = (i + 1) & (WIFI_MAX_ROUTES - 1);
+        
+        if(ctx->m_Routes[i].m_Used == 0) {
+            break;
+        }
+        
+        uint8_t home = route_slot(ctx->m_Routes[i].m_Mac);
+        
+        if(((i - home) & (WIFI_MAX_ROUTES - 1)) >= ((i - hole) & (WIFI_MAX_ROUTES - 1))) {
+            ctx->m_Routes[hole] = ctx->m_Routes[i];                             // its probe sequence passes the hole
+            hole                = i;
+        }
+    }
+    
+    ctx->m_Routes[hole].m_Used = 0;
+}
+/**
+ * 
+ * @param mac
+ * @return index into m_Children, or -1
+ */
+static int ICACHE_FLASH_ATTR route_child_find(const uint8_t* mac)
+{
+    int i;
+    
+    for(i = 0; i < WIFI_MAX_CHILDREN; i++) {
+        if(ctx->m_Children[i].m_Used != 0 && os_memcmp(ctx->m_Children[i].m_Mac, mac, 6) == 0) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+/**
+ * a station joined our softAP, or got its lease (ip != 0)
+ * 
+ * @param mac
+ * @param ip
+ */
+static void ICACHE_FLASH_ATTR route_child_add(const uint8_t* mac, uint32_t ip)
+{
+    int i = route_child_find(mac);
+    
+    if(i < 0) {
+        for(i = 0; i < WIFI_MAX_CHILDREN && ctx->m_Children[i].m_Used != 0; i++) {
+        }
+        
+        if(i == WIFI_MAX_CHILDREN) {
+            DTXT("route_child_add(): no room for " MACSTR "\n", MAC2STR(mac));
+            return;
+        }
+        
+        os_memcpy(ctx->m_Children[i].m_Mac, mac, sizeof(ctx->m_Children[i].m_Mac));
+        ctx->m_Children[i].m_Used    = 1;
+        ctx->m_Children[i].m_Routes  = 0;
+        ctx->m_Children[i].m_Ip.addr = 0;
+        
+        ctx->m_ChildCount++;
+    }
+    
+    if(ip != 0) {
+        ctx->m_Children[i].m_Ip.addr = ip;
+    }
+    
+    route_learn(mac, (uint8_t)i);
+    
+    DDBG("route_child_add(): " MACSTR ", ip = %d.%d.%d.%d\n", MAC2STR(mac), IP2STR(&(ctx->m_Children[i].m_Ip)));
+}
+/**
+ * a station left our softAP; everything we reached through it goes too
+ * 
+ * @param child
+ */
+static void ICACHE_FLASH_ATTR route_child_remove(int child)
+{
+    uint8_t i = 0;
+    
+    while(ctx->m_Children[child].m_Routes > 0) {
+        if(ctx->m_Routes[i].m_Used != 0 && ctx->m_Routes[i].m_Child == child) {
+            route_remove(&ctx->m_Routes[i]);                                    // may shift another one into i, or wrap one past 0
+        }
+        else {
+            i = (i + 1) & (WIFI_MAX_ROUTES - 1);
+        }
+    }
+    
+    ctx->m_Children[child].m_Used = 0;
+    ctx->m_ChildCount--;
+}
+/**
+ * fallback for events we did not get: compare the table with the SDK's station list, and drop nodes further down
+ * that have not been heard from
+ */
+static void ICACHE_FLASH_ATTR route_reconcile(void)
+{
+    struct station_info* sta  = wifi_softap_get_station_info();
+    uint32_t             seen = 0;
+    uint32_t             now  = system_get_time();
+    int                  i;
+    
+    for(; sta != NULL; sta = STAILQ_NEXT(sta, next)) {
+        i = route_child_find(sta->bssid);
+        
+        if(i < 0 || ctx->m_Children[i].m_Ip.addr != sta->ip.addr) {
+            DTXT("route_reconcile(): " MACSTR " at %d.%d.%d.%d was missed\n", MAC2STR(sta->bssid), IP2STR(&(sta->ip)));
+            
+            route_child_add(sta->bssid, sta->ip.addr);
+            
+            i = route_child_find(sta->bssid);
+        }
+        
+        if(i >= 0) {
+            seen |= 1u << i;
+        }
+    }
+    
+    wifi_softap_free_station_info();
+    
+    for(i = 0; i < WIFI_MAX_CHILDREN; i++) {
+        if(ctx->m_Children[i].m_Used != 0 && (seen & (1u << i)) == 0) {
+            DTXT("route_reconcile(): " MACSTR " is gone\n", MAC2STR(ctx->m_Children[i].m_Mac));
+            
+            route_child_remove(i);
+        }
+    }
+    
+    i = 0;
+    
+    while(i < WIFI_MAX_ROUTES) {                                                // one that wraps past 0 waits for the next round
+        WIFIRoute* r = &ctx->m_Routes[i];
+        
+        if(r->m_Used != 0 && os_memcmp(r->m_Mac, ctx->m_Children[r->m_Child].m_Mac, 6) != 0 &&
+           now - r->m_LastSeen > MESH_ROUTE_EXPIRE_SECONDS * 1000000u) {
+            route_remove(r);
+        }
+        else {
+            i++;
+        }
+    }
+    
+    DDBG("route_reconcile(): children = %d, routes = %d\n", ctx->m_ChildCount, ctx->m_RouteCount);
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR route_reset(void)
+{
+    os_memset(ctx->m_Routes, 0, sizeof(ctx->m_Routes));
+    os_memset(ctx->m_Children, 0, sizeof(ctx->m_Children));
+    
+    ctx->m_RouteCount = 0;
+    ctx->m_ChildCount = 0;
+    
+    deadline_set(DEADLINE_ROUTE_RECONCILE, MESH_ROUTE_RECONCILE_SECONDS * 1000u);
+}
+/**
+ * the routing table follows the softAP events, whether or not they drive the state machine
+ * 
+ * @param evt
+ */
+static void ICACHE_FLASH_ATTR route_event(System_Event_t* evt)
+{
+    int i;
+    
+    switch(evt->event) {
+        case EVENT_SOFTAPMODE_STACONNECTED:
+            route_child_add(evt->event_info.sta_connected.mac, 0);
+            break;
+            
+        case EVENT_SOFTAPMODE_DISTRIBUTE_STA_IP:
+            route_child_add(evt->event_info.distribute_sta_ip.mac, evt->event_info.distribute_sta_ip.ip.addr);
+            break;
+            
+        case EVENT_SOFTAPMODE_STADISCONNECTED:
+            if((i = route_child_find(evt->event_info.sta_disconnected.mac)) >= 0) {
+                route_child_remove(i);
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+/**
+ * 
+ * @param status
+ * @return 
+ */
+int ICACHE_FLASH_ATTR build_mesh_ap_ssid(char status)
+{
+    uint8 load = wifi_softap_get_station_num();
+    char  buf[4];
+    
+    buf[0] = status;
+    buf[1] = '0' + ((ctx->m_MeshHops < MESH_MAX_HOPS) ? ctx->m_MeshHops : MESH_MAX_HOPS);
+    buf[2] = '0' + ((load < 9) ? load : 9);                                     // as of now; refreshed when the softAP is set up again
+    buf[3] = '\0';
+
+    os_strcpy((char*)(ctx->m_Mesh.m_ApConfig.ssid), ctx->m_MeshPrefix);
+    os_strcat((char*)(ctx->m_Mesh.m_ApConfig.ssid), "_");
+    os_strcat((char*)(ctx->m_Mesh.m_ApConfig.ssid), buf);
+    os_strcat((char*)(ctx->m_Mesh.m_ApConfig.ssid), "_");
+    os_strcat((char*)(ctx->m_Mesh.m_ApConfig.ssid), ctx->m_MeshPostfix);
+    
+    DTXT("build_mesh_ap_ssid(): %s\n", ctx->m_Mesh.m_ApConfig.ssid);
+    
+    return 0;
+}
+/**
+ * one hash and a binary search per BSS instead of a strcmp against every WIFI_AP
+ * 
+ * @param ssid
+ * @param length
+ * @return 
+ */
+static WIFI_AP* ICACHE_FLASH_ATTR wifi_find_ssid(const uint8_t* ssid, uint8_t length)
+{
+    if(ctx->m_List == NULL) {                                                   // mesh modes scan without a list
+        return NULL;
+    }
+    
+    if(ctx->m_SsidIndexOverflow != 0) {
+        WIFI_AP* p = ctx->m_List;
+        
+        while(p->ssid != NULL) {
+            if(os_strlen(p->ssid) == length && os_memcmp(p->ssid, ssid, length) == 0) {
+                return p;
+            }
+            
+            p++;
+        }
+        
+        return NULL;
+    }
+    
+    uint32_t hash = wifi_ssid_hash(ssid, length);
+    int      lo   = 0;
+    int      hi   = ctx->m_SsidIndexCount;
+    
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        
+        if(ctx->m_SsidIndex[mid].m_Hash < hash) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    
+    for(; lo < ctx->m_SsidIndexCount && ctx->m_SsidIndex[lo].m_Hash == hash; lo++) {
+        WIFI_AP* p = &ctx->m_List[ctx->m_SsidIndex[lo].m_Index];
+        
+        if(ctx->m_SsidIndex[lo].m_Length == length && os_memcmp(p->ssid, ssid, length) == 0) {
+            return p;
+        }
+    }
+    
+    return NULL;
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR wifi_build_index(void)
+{
+    int i;
+    
+    ctx->m_SsidIndexCount    = 0;
+    ctx->m_SsidIndexOverflow = 0;
+    
+    for(i = 0; ctx->m_List[i].ssid != NULL; i++) {
+        if(i >= WIFI_MAX_AP) {
+            DTXT("wifi_build_index(): more than %d APs; not indexed\n", WIFI_MAX_AP);
+            
+            ctx->m_SsidIndexOverflow = 1;
+            return;
+        }
+        
+        WIFISsid entry;
+        int      j = ctx->m_SsidIndexCount;
+        
+        entry.m_Length = (uint8_t)os_strlen(ctx->m_List[i].ssid);
+        entry.m_Hash   = wifi_ssid_hash(ctx->m_List[i].ssid, entry.m_Length);
+        entry.m_Index  = (uint8_t)i;
+        
+        // insertion sort; equal hashes keep list order so the first duplicate still wins
+        while(j > 0 && ctx->m_SsidIndex[j - 1].m_Hash > entry.m_Hash) {
+            ctx->m_SsidIndex[j] = ctx->m_SsidIndex[j - 1];
+            j--;
+        }
+        
+        ctx->m_SsidIndex[j] = entry;
+        ctx->m_SsidIndexCount++;
+    }
+}
+/**
+ * called by the SDK; moves the state machine as soon as the station gets an IP or loses the link
+ * 
+ * @param evt
+ */
+static void ICACHE_FLASH_ATTR wifi_event_callback(System_Event_t* evt)
+{
+    run_wake();
+    
+    route_event(evt);
+    event_sdk(evt);
+    
+    if(ctx->m_Wifi.m_EventDriven == 0) {
+        return;
+    }
+    
+    switch(evt->event) {
+        case EVENT_STAMODE_CONNECTED:
+            DDBG("wifi_event_callback(): connected; channel = %d\n", evt->event_info.connected.channel);
+            
+            ctx->m_Wifi.m_Channel = evt->event_info.connected.channel;
+            os_memcpy(ctx->m_Wifi.m_Bssid, evt->event_info.connected.bssid, sizeof(ctx->m_Wifi.m_Bssid));
+            break;
+            
+        case EVENT_STAMODE_GOT_IP:
+            DTXT("wifi_event_callback(): got ip; ip = %d.%d.%d.%d\n", IP2STR(&(evt->event_info.got_ip.ip)));
+            
+            if(ctx->m_State == wifi_connect_in_progress) {
+                ctx->m_State = wifi_connect_done;
+            }
+            break;
+            
+        case EVENT_STAMODE_DHCP_TIMEOUT:
+            DTXT("wifi_event_callback(): dhcp timeout\n");
+            
+            if(ctx->m_State == wifi_connect_in_progress) {
+                ctx->m_State = wifi_connect_fail;
+            }
+            break;
+            
+        case EVENT_STAMODE_DISCONNECTED:
+            ctx->m_Wifi.m_LastReason = evt->event_info.disconnected.reason;
+            
+            DTXT("wifi_event_callback(): disconnected; reason = %d\n", ctx->m_Wifi.m_LastReason);
+            
+#if defined(WITH_TRACE)
+            trace_put(trace_disconnect, ctx->m_Wifi.m_LastReason, (uint16_t)ctx->m_State);
+#endif
+            
+            if(ctx->m_MeshState == mesh_connect_done ||
+               (ctx->m_MeshState == mesh_connect_in_progress && ctx->m_Wifi.m_LastReason == REASON_ASSOC_TOOMANY)) {
+                deadline_set(DEADLINE_MESH_CHECK, 0);                           // lost our parent, or it is full; don't wait for the poll
+            }
+            
+            switch(ctx->m_State) {
+                case wifi_ready:
+#if defined(WITH_AP_STATS)
+                    stats_disconnect();
+#endif
+#if defined(WITH_STATE_STATS)
+                    timing_check(wifi_station_get_connect_status());            // what do_wifi_check() would have seen
+#endif
+                    ctx->m_State = wifi_connect_fail;
+                    break;
+                    
+                case wifi_connect_in_progress:
+                    switch(ctx->m_Wifi.m_LastReason) {
+                        case REASON_AUTH_FAIL:
+                        case REASON_4WAY_HANDSHAKE_TIMEOUT:
+                        case REASON_HANDSHAKE_TIMEOUT:
+                        case REASON_NO_AP_FOUND:
+#if defined(WITH_STATE_STATS)
+                            timing_check(wifi_station_get_connect_status());
+#endif
+                            ctx->m_State = wifi_connect_fail;
+                            break;
+                            
+                        default:                                                // the SDK keeps retrying by itself
+                            break;
+                    }
+                    break;
+                    
+                case wifi_disconnect_in_progress:
+                    ctx->m_State = wifi_disconnect_done;
+                    break;
+                    
+#if defined(WITH_IP_CACHE)
+                case wifi_connect_verify:
+                    ctx->m_Wifi.m_StaticIp = IP_CACHE_APPLIED;                  // verify again once the SDK is back on
+                    ctx->m_State           = wifi_connect_in_progress;
+                    break;
+                    
+#endif
+                default:
+                    break;
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+/**
+ * 
+ * @return 
+ */
+static int ICACHE_FLASH_ATTR connect_check_interval(void)
+{
+    return (ctx->m_Wifi.m_EventDriven != 0) ? CONNECT_CHECK_FALLBACK_SECONDS : CONNECT_CHECK_INTERVAL_SECONDS;
+}
+/**
+ * 
+ * @return 
+ */
+static int ICACHE_FLASH_ATTR power_check_interval(void)
+{
+    int seconds = power_profiles[ctx->m_PowerPolicy].m_CheckSeconds;
+    
+    if(seconds == 0 || (ctx->m_Wifi.m_EventDriven != 0 && seconds < CONNECT_CHECK_FALLBACK_SECONDS)) {
+        seconds = connect_check_interval();                                     // events report a lost link anyway
+    }
+    
+    return seconds;
+}
+/**
+ * the listen interval goes into the association request, so it is set before connecting; the radio only sleeps
+ * once connected
+ * 
+ * @param connected
+ */
+static void ICACHE_FLASH_ATTR power_apply(uint8_t connected)
+{
+    const WIFIPower* p     = &power_profiles[ctx->m_PowerPolicy];
+    uint8_t          sleep = (connected != 0) ? p->m_SleepType : NONE_SLEEP_T;
+    
+    if(p->m_ListenInterval != ctx->m_PowerListen) {
+        if(p->m_ListenInterval != 0) {
+            wifi_set_sleep_level(MAX_SLEEP_T);
+            wifi_set_listen_interval(p->m_ListenInterval);
+        }
+        else {
+            wifi_set_sleep_level(MIN_SLEEP_T);
+        }
+        
+        ctx->m_PowerListen = p->m_ListenInterval;
+    }
+    
+    if(sleep != ctx->m_PowerSleep) {
+        DDBG("power_apply(): sleep type = %d\n", sleep);
+        
+        wifi_set_sleep_type((enum sleep_type)sleep);
+        
+        ctx->m_PowerSleep = sleep;
+    }
+}
+/**
+ * 
+ * @return 
+ */
+static WIFI_RetryCause ICACHE_FLASH_ATTR retry_cause(void)
+{
+    switch(wifi_station_get_connect_status()) {
+        case STATION_WRONG_PASSWORD:
+            return retry_wrong_password;
+            
+        case STATION_NO_AP_FOUND:
+            return retry_no_ap_found;
+            
+        default:
+            break;
+    }
+    
+    switch(ctx->m_Wifi.m_LastReason) {                                          // the SDK may already be retrying
+        case REASON_AUTH_FAIL:
+        case REASON_4WAY_HANDSHAKE_TIMEOUT:
+        case REASON_HANDSHAKE_TIMEOUT:
+            return retry_wrong_password;
+            
+        case REASON_NO_AP_FOUND:
+            return retry_no_ap_found;
+            
+        default:
+            return retry_connect_fail;
+    }
+}
+/**
+ * exponential backoff with jitter so that nodes that lost the same AP don't all come back at the same time
+ * 
+ * @param retry
+ * @param cause
+ * @param timer     started with the delay
+ * @return 0 = wait for timer, -1 = limit reached
+ */
+static int ICACHE_FLASH_ATTR retry_backoff(WIFIRetry* retry, WIFI_RetryCause cause, uint8_t d)
+{
+    const WIFI_Backoff* b = &ctx->m_RetryPolicy->cause[cause];
+    uint32_t            delay;
+    uint16_t            i;
+    
+    if(b->limit != 0 && retry->m_Attempts >= b->limit) {
+        DTXT("retry_backoff(): cause = %d, giving up after %d attempts\n", cause, retry->m_Attempts);
+        return -1;
+    }
+    
+    delay = b->first_ms;
+    
+    for(i = 0; i < retry->m_Attempts && delay < b->max_ms; i++) {
+        delay = (delay <= b->max_ms / 2) ? (delay << 1) : b->max_ms;            // can't wrap
+    }
+    
+    delay -= (uint32_t)(os_random() % (delay / 100 * ctx->m_RetryPolicy->jitter + 1));
+    
+    retry->m_Attempts++;
+    retry->m_Cause = (uint8_t)cause;
+    
+    DTXT("retry_backoff(): cause = %d, attempt = %d, delay = %d ms\n", cause, retry->m_Attempts, delay);
+    
+    deadline_set(d, delay);
+    
+    return 0;
+}
+/**
+ * stop the SDK's own reconnects and wait for our turn
+ * 
+ * @param cause
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_retry(WIFI_RetryCause cause)
+{
+    wifi_station_disconnect();
+    
+    if(retry_backoff(&ctx->m_Retry, cause, DEADLINE_CONNECT_TIMEOUT) != 0) {
+        return wifi_disabled;
+    }
+    
+    resume_save();
+    
+    return wifi_connect_wait;
+}
+/**
+ * sample the RSSI, scan in the background when it is weak and move to a clearly stronger AP from wifi_list
+ * 
+ * @return wifi_ready, or wifi_connect to switch
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_roam(void)
+{
+    if(ctx->m_RoamPolicy->threshold == 0) {
+        return wifi_ready;
+    }
+    
+    if(ctx->m_Roam.m_Scan == ROAM_SCAN_DONE) {
+        ctx->m_Roam.m_Scan = ROAM_IDLE;
+        
+        deadline_set(DEADLINE_ROAM_DWELL, ctx->m_RoamPolicy->dwell_s * 1000u);
+        
+        if(ctx->m_Roam.m_Best == NULL || ctx->m_Roam.m_BestRssi < ctx->m_Roam.m_Rssi + ctx->m_RoamPolicy->hysteresis) {
+            DDBG("do_wifi_roam(): staying; rssi = %d, best = %d\n", ctx->m_Roam.m_Rssi, (ctx->m_Roam.m_Best != NULL) ? ctx->m_Roam.m_BestRssi : 0);
+            return wifi_ready;
+        }
+        
+        DTXT("do_wifi_roam(): %s at %d dBm, leaving %d dBm\n", ctx->m_Roam.m_Best->ssid, ctx->m_Roam.m_BestRssi, ctx->m_Roam.m_Rssi);
+        
+        // everything for the new AP is known, so the switch is a direct reassociation (see fast connect)
+        ctx->m_BestSsid    = ctx->m_Roam.m_Best;
+        ctx->m_BestRssi    = ctx->m_Roam.m_BestRssi;
+        ctx->m_BestChannel = ctx->m_Roam.m_BestChannel;
+        os_memcpy(ctx->m_BestBssid, ctx->m_Roam.m_BestBssid, sizeof(ctx->m_BestBssid));
+        
+        os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.ssid), ctx->m_BestSsid->ssid);
+        
+        if(ctx->m_BestSsid->psw != NULL) {
+            os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.password), ctx->m_BestSsid->psw);
+        }
+        else {
+            ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+        }
+        
+        os_memcpy(ctx->m_Wifi.m_StationConfig.bssid, ctx->m_Roam.m_BestBssid, sizeof(ctx->m_Wifi.m_StationConfig.bssid));
+        
+        ctx->m_Wifi.m_StationConfig.bssid_set = 1;
+        ctx->m_Wifi.m_Channel                 = ctx->m_Roam.m_BestChannel;
+        ctx->m_Wifi.m_FastConnect             = 1;                              // falls back to a normal scan if it does not answer
+        ctx->m_Roam.m_Switched                = 1;
+        
+        wifi_station_disconnect();
+        
+        return wifi_connect;
+    }
+    
+    if(ctx->m_Roam.m_Scan != ROAM_IDLE || !deadline_passed(DEADLINE_ROAM_SAMPLE)) {
+        return wifi_ready;
+    }
+    
+    deadline_lazy(DEADLINE_ROAM_SAMPLE, ctx->m_RoamPolicy->sample_s * 1000u);
+    
+    sint8 rssi = wifi_station_get_rssi();
+    
+    if(rssi > 0) {
+        return wifi_ready;                                                      // 31 = no link
+    }
+    
+    ctx->m_Roam.m_Rssi = (ctx->m_Roam.m_Rssi == 0) ? rssi : (sint16)((ctx->m_Roam.m_Rssi * 3 + rssi) / 4);
+    
+    if(ctx->m_Roam.m_Rssi < ctx->m_RoamPolicy->threshold && deadline_passed(DEADLINE_ROAM_DWELL)) {
+        DTXT("do_wifi_roam(): rssi = %d, looking for a better AP\n", ctx->m_Roam.m_Rssi);
+        
+        ctx->m_Roam.m_Scan     = ROAM_SCANNING;
+        ctx->m_Roam.m_Pending  = ctx->m_ScanPlan.m_Known & SCAN_CHANNELS;
+        ctx->m_Roam.m_Best     = NULL;
+        ctx->m_Roam.m_BestRssi = -127;
+        
+        roam_scan();
+    }
+    
+    return wifi_ready;
+}
+/**
+ * one channel at a time (all of them if we know none), so the link is only away from its channel briefly
+ */
+static void ICACHE_FLASH_ATTR roam_scan(void)
+{
+    struct scan_config config;
+    
+    os_memset(&config, 0, sizeof(config));
+    
+    config.channel = scan_next_channel(&ctx->m_Roam.m_Pending);
+    
+#if defined(WITH_STATE_STATS)
+    timing_start(TIMING_SCAN);
+#endif
+    if(!wifi_station_scan(&config, roam_scan_callback)) {
+        ctx->m_Roam.m_Scan = ROAM_SCAN_DONE;
+    }
+}
+/**
+ * 
+ * @param arg
+ * @param status
+ */
+static void ICACHE_FLASH_ATTR roam_scan_callback(void* arg, STATUS status)
+{
+    struct bss_info* bss = arg;
+    WIFI_AP*         s;
+    
+    run_wake();
+    event_scan(bss, status);
+    
+#if defined(WITH_STATE_STATS)
+    timing_stop(TIMING_SCAN);
+#endif
+    
+    if(status == OK) {
+        while(bss) {
+            s = wifi_find_ssid(bss->ssid, bss->ssid_len);
+            
+            if(s != NULL && os_memcmp(bss->bssid, ctx->m_Wifi.m_Bssid, sizeof(ctx->m_Wifi.m_Bssid)) != 0 && bss->rssi > ctx->m_Roam.m_BestRssi) {
+                ctx->m_Roam.m_Best        = s;
+                ctx->m_Roam.m_BestRssi    = bss->rssi;
+                ctx->m_Roam.m_BestChannel = bss->channel;
+                os_memcpy(ctx->m_Roam.m_BestBssid, bss->bssid, sizeof(ctx->m_Roam.m_BestBssid));
+            }
+            
+            bss = bss->next.stqe_next;
+        }
+    }
+    
+    if(status == OK && ctx->m_Roam.m_Pending != 0 && ctx->m_State == wifi_ready) {
+        roam_scan();
+    }
+    else {
+        ctx->m_Roam.m_Scan = (ctx->m_State == wifi_ready) ? ROAM_SCAN_DONE : ROAM_IDLE; // the link went away meanwhile
+    }
+}
+/**
+ * new AP: no RSSI history, and stay a while
+ */
+static void ICACHE_FLASH_ATTR roam_reset(void)
+{
+    if(ctx->m_Roam.m_Scan == ROAM_SCAN_DONE) {
+        ctx->m_Roam.m_Scan = ROAM_IDLE;
+    }
+    
+    ctx->m_Roam.m_Rssi = 0;
+    
+    deadline_lazy(DEADLINE_ROAM_SAMPLE, ctx->m_RoamPolicy->sample_s * 1000u);
+    deadline_set(DEADLINE_ROAM_DWELL, ctx->m_RoamPolicy->dwell_s * 1000u);
+}
+/**
+ * keep the WIFI_MAX_CANDIDATES best, best first
+ * 
+ * @param ap
+ * @param bss
+ */
+static void ICACHE_FLASH_ATTR candidate_add(WIFI_AP* ap, const struct bss_info* bss)
+{
+    int    i     = ctx->m_CandidateCount;
+#if defined(WITH_AP_STATS)
+    sint16 score = stats_score(bss);
+#else
+    sint16 score = bss->rssi;
+#endif
+    
+    if(i == WIFI_MAX_CANDIDATES) {
+        if(score <= ctx->m_Candidates[i - 1].m_Score) {
+            return;
+        }
+        
+        i--;                                                                    // the worst makes room
+    }
+    else {
+        ctx->m_CandidateCount++;
+    }
+    
+    while(i > 0 && ctx->m_Candidates[i - 1].m_Score < score) {
+        ctx->m_Candidates[i] = ctx->m_Candidates[i - 1];
+        i--;
+    }
+    
+    ctx->m_Candidates[i].m_Ap      = ap;
+    ctx->m_Candidates[i].m_Channel = bss->channel;
+    ctx->m_Candidates[i].m_Rssi    = bss->rssi;
+    ctx->m_Candidates[i].m_Score   = score;
+    os_memcpy(ctx->m_Candidates[i].m_Bssid, bss->bssid, sizeof(ctx->m_Candidates[i].m_Bssid));
+}
+/**
+ * set up the station for the next candidate; the BSSID is pinned so that a failing AP is not picked again by the SDK
+ * 
+ * @return 
+ */
+static WIFI_state_t ICACHE_FLASH_ATTR candidate_connect(void)
+{
+    WIFICandidate* c = &ctx->m_Candidates[ctx->m_CandidateNext++];
+    
+    DTXT("candidate_connect(): %d of %d, %s at %d dBm\n", ctx->m_CandidateNext, ctx->m_CandidateCount, c->m_Ap->ssid, c->m_Rssi);
+    
+    ctx->m_BestSsid    = c->m_Ap;
+    ctx->m_BestRssi    = c->m_Rssi;
+    ctx->m_BestChannel = c->m_Channel;
+    os_memcpy(ctx->m_BestBssid, c->m_Bssid, sizeof(ctx->m_BestBssid));
+    
+    os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.ssid), c->m_Ap->ssid);
+    
+    if(c->m_Ap->psw != NULL) {
+        os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.password), c->m_Ap->psw);
+    }
+    else {
+        ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+    }
+    
+    os_memcpy(ctx->m_Wifi.m_StationConfig.bssid, c->m_Bssid, sizeof(ctx->m_Wifi.m_StationConfig.bssid));
+    
+    ctx->m_Wifi.m_StationConfig.bssid_set = 1;
+    
+    return wifi_connect;
+}
+#if defined(WITH_AP_STATS)
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR stats_load(void)
+{
+    ctx->m_StatsCurrent = NULL;
+    ctx->m_StatsDirty   = 0;
+    ctx->m_StatsSaved   = 0;
+    
+    if(system_param_load(WIFI_STATS_SECTOR, 0, &ctx->m_Stats, sizeof(ctx->m_Stats)) &&
+       ctx->m_Stats.m_Magic == WIFI_STATS_MAGIC &&
+       ctx->m_Stats.m_Checksum == wifi_ssid_hash(ctx->m_Stats.m_Stat, sizeof(ctx->m_Stats.m_Stat))) {
+        return;
+    }
+    
+    DTXT("stats_load(): no valid record\n");
+    
+    os_memset(&ctx->m_Stats, 0, sizeof(ctx->m_Stats));
+    ctx->m_Stats.m_Magic = WIFI_STATS_MAGIC;
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR stats_save(void)
+{
+    if(ctx->m_StatsDirty == 0 || (ctx->m_StatsSaved != 0 && !deadline_passed(DEADLINE_STATS_SAVE))) {
+        return;
+    }
+    
+    ctx->m_Stats.m_Checksum = wifi_ssid_hash(ctx->m_Stats.m_Stat, sizeof(ctx->m_Stats.m_Stat));
+    
+    if(system_param_save_with_protect(WIFI_STATS_SECTOR, &ctx->m_Stats, sizeof(ctx->m_Stats))) {
+        ctx->m_StatsDirty = 0;
+        ctx->m_StatsSaved = 1;
+        
+        deadline_set(DEADLINE_STATS_SAVE, STATS_SAVE_SECONDS * 1000u);
+    }
+}
+/**
+ * 
+ * @param bssid
+ * @param hash
+ * @param create    replace the oldest entry if 'bssid' is not there
+ * @return 
+ */
+static WIFIStat* ICACHE_FLASH_ATTR stats_find(const uint8_t* bssid, uint32_t hash, uint8_t create)
+{
+    WIFIStat* oldest = &ctx->m_Stats.m_Stat[0];
+    int       i;
+    
+    for(i = 0; i < WIFI_MAX_STATS; i++) {
+        WIFIStat* e = &ctx->m_Stats.m_Stat[i];
+        
+        if(e->m_SsidHash == hash && os_memcmp(e->m_Bssid, bssid, sizeof(e->m_Bssid)) == 0) {
+            return e;
+        }
+        
+        if(e->m_Attempts == 0 || (oldest->m_Attempts != 0 && e->m_Age > oldest->m_Age)) {
+            oldest = e;                                                         // free ones first
+        }
+    }
+    
+    if(create == 0) {
+        return NULL;
+    }
+    
+    os_memset(oldest, 0, sizeof(*oldest));
+    os_memcpy(oldest->m_Bssid, bssid, sizeof(oldest->m_Bssid));
+    oldest->m_SsidHash = hash;
+    
+    return oldest;
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR stats_attempt(void)
+{
+    WIFIStat* e;
+    int       i;
+    
+    ctx->m_StatsCurrent = NULL;
+    
+    if(ctx->m_Wifi.m_StationConfig.bssid_set == 0) {
+        return;
+    }
+    
+    e = stats_find(ctx->m_Wifi.m_StationConfig.bssid, wifi_ssid_hash(ctx->m_Wifi.m_StationConfig.ssid, os_strlen((const char*)ctx->m_Wifi.m_StationConfig.ssid)), 1);
+    
+    for(i = 0; i < WIFI_MAX_STATS; i++) {
+        if(ctx->m_Stats.m_Stat[i].m_Age < 0xFF) {
+            ctx->m_Stats.m_Stat[i].m_Age++;
+        }
+    }
+    
+    if(e->m_Attempts == 0xFF) {
+        e->m_Attempts    /= 2;
+        e->m_Successes   /= 2;
+        e->m_Disconnects /= 2;
+    }
+    
+    e->m_Attempts++;
+    e->m_Age = 0;
+    
+    ctx->m_StatsCurrent = e;
+    ctx->m_StatsStarted = system_get_time();
+    ctx->m_StatsDirty   = 1;
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR stats_success(void)
+{
+    uint32_t ms;
     
-    wifi_mesh.m_ApConfig.ssid_len       = 0;
-    wifi_mesh.m_ApConfig.authmode       = AUTH_OPEN;
-    wifi_mesh.m_ApConfig.ssid_hidden    = 0;
-    wifi_mesh.m_ApConfig.max_connection = 4;
-
-    switch(mode) {
-        case ap_fixed:
-            DTXT("WIFI_MeshInitialize(): ap_fixed\n");
-            
-            wifi.m_WIFIMode = ap_fixed;
-            WIFI_state      = wifi_connect;
-            WIFI_Mesh_state = mesh_disabled;
-            
-            if(ssid != NULL) {
-                os_strcpy((char*)(wifi.m_StationConfig.ssid), ssid);
-
-                if(pass != NULL) {
-                    os_strcpy((char*)(wifi.m_StationConfig.password), pass);
-                }
-                else {
-                    wifi.m_StationConfig.password[0] = '\0';
-                }
-            }
-            else {
-                wifi.m_StationConfig.ssid[0]     = '\0';
-                wifi.m_StationConfig.password[0] = '\0';
-
-                rc = -1;
-            }
+    if(ctx->m_StatsCurrent == NULL) {
+        return;
+    }
+    
+    ms = (system_get_time() - ctx->m_StatsStarted) / 1000;
+    
+    if(ms > 0xFFFF) {
+        ms = 0xFFFF;
+    }
+    
+    ctx->m_StatsCurrent->m_Successes++;
+    ctx->m_StatsCurrent->m_TimeToIp = (ctx->m_StatsCurrent->m_TimeToIp == 0) ? (uint16_t)ms : (uint16_t)((ctx->m_StatsCurrent->m_TimeToIp * 3 + ms) / 4);
+    
+    ctx->m_StatsDirty = 1;
+    
+    stats_save();
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR stats_disconnect(void)
+{
+    if(ctx->m_StatsCurrent == NULL || ctx->m_StatsCurrent->m_Disconnects == 0xFF) {
+        return;
+    }
+    
+    ctx->m_StatsCurrent->m_Disconnects++;
+    
+    ctx->m_StatsDirty = 1;
+}
+/**
+ * RSSI in dBm, moved by up to +-20 for the success rate, and down by up to 10 each for slow DHCP and dropped links
+ * 
+ * @param bss
+ * @return 
+ */
+static sint16 ICACHE_FLASH_ATTR stats_score(const struct bss_info* bss)
+{
+    WIFIStat* e     = stats_find(bss->bssid, wifi_ssid_hash(bss->ssid, bss->ssid_len), 0);
+    sint16    score = bss->rssi;
+    
+    if(e == NULL || e->m_Attempts == 0) {
+        return score;
+    }
+    
+    score += (sint16)(((e->m_Successes + 1) * 40) / (e->m_Attempts + 2)) - 20;
+    score -= (e->m_TimeToIp / 500 < 10) ? e->m_TimeToIp / 500 : 10;
+    score -= (e->m_Disconnects * 10 / (e->m_Successes + 1) < 10) ? e->m_Disconnects * 10 / (e->m_Successes + 1) : 10;
+    
+    return score;
+}
+#endif
+#if defined(WITH_STATE_STATS)
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR timing_run(void)
+{
+    WIFI_Stats* s   = &ctx->m_Timing;
+    uint32_t    now = system_get_time();
+    uint32_t    ms  = (now - ctx->m_TimingSince) / 1000;
+    
+    ctx->m_TimingSince += ms * 1000;                                            // the remainder counts next time
+    
+    s->state_ms[s->state]     += ms;
+    s->mesh_ms[s->mesh_state] += ms;
+    
+    if(s->state != ctx->m_State) {
+        if(s->state == wifi_ready && ctx->m_State != wifi_disconnect) {
+            timing_start(TIMING_RECONNECT);
+        }
+        
+        s->state = (uint8_t)ctx->m_State;
+        
+        if(s->state_entries[s->state] < 0xFFFF) {
+            s->state_entries[s->state]++;
+        }
+    }
+    
+    if(s->mesh_state != ctx->m_MeshState) {
+        if(s->mesh_state == mesh_connect_done) {
+            timing_start(TIMING_RECONNECT);
+        }
+        
+        s->mesh_state = (uint8_t)ctx->m_MeshState;
+        
+        if(s->mesh_entries[s->mesh_state] < 0xFFFF) {
+            s->mesh_entries[s->mesh_state]++;
+        }
+    }
+}
+/**
+ * 
+ * @param kind
+ */
+static void ICACHE_FLASH_ATTR timing_start(uint8_t kind)
+{
+    ctx->m_TimingAt[kind]  = system_get_time();
+    ctx->m_TimingPending  |= (uint8_t)(1 << kind);
+}
+/**
+ * 
+ * @param kind
+ */
+static void ICACHE_FLASH_ATTR timing_stop(uint8_t kind)
+{
+    uint16_t* histogram;
+    uint32_t  ms;
+    int       n = 0;
+    
+    if((ctx->m_TimingPending & (1 << kind)) == 0) {
+        return;
+    }
+    
+    ctx->m_TimingPending &= (uint8_t)~(1 << kind);
+    
+    switch(kind) {
+        case TIMING_SCAN:
+            histogram = ctx->m_Timing.scan_ms;
             break;
             
-        case mesh_root:
-            DTXT("WIFI_MeshInitialize(): mesh_root\n");
-            
-            wifi.m_WIFIMode = mesh_root;
-            WIFI_state      = wifi_connect;
-            WIFI_Mesh_state = none; //mesh_connect;
-            
-            //wifi_station_set_config(&wifi.m_StationConfig);
-
-            if(ssid != NULL) {
-                os_strcpy((char*)(wifi.m_StationConfig.ssid), ssid);
-
-                if(pass != NULL) {
-                    os_strcpy((char*)(wifi.m_StationConfig.password), pass);
-                }
-                else {
-                    wifi.m_StationConfig.password[0] = '\0';
-                }
-            }
-            else {
-                wifi.m_StationConfig.ssid[0]     = '\0';
-                wifi.m_StationConfig.password[0] = '\0';
-
-                rc = -1;
-            }
-            
-            wifi_station_set_config(&wifi.m_StationConfig);
-
-            build_mesh_ap_ssid(mesh_status);
+        case TIMING_IP:
+            histogram = ctx->m_Timing.ip_ms;
             break;
             
-        case mesh_non_leaf:
-            DTXT("WIFI_MeshInitialize(): mesh_non_leaf\n");
-
-            wifi.m_WIFIMode = mesh_non_leaf;
-            WIFI_state      = wifi_disabled;
-            WIFI_Mesh_state = mesh_connect;
-            
-            wifi.m_StationConfig.ssid[0]     = '\0';
-            wifi.m_StationConfig.password[0] = '\0';
-
-            //wifi_station_disconnect();
-
-            wifi_station_set_config(&wifi.m_StationConfig);
+        default:
+            histogram = ctx->m_Timing.reconnect_ms;
+            break;
+    }
+    
+    for(ms = (system_get_time() - ctx->m_TimingAt[kind]) / 1000; ms > 1 && n < WIFI_STATS_BUCKETS - 1; ms >>= 1) {
+        n++;
+    }
+    
+    if(histogram[n] < 0xFFFF) {
+        histogram[n]++;
+    }
+}
+/**
+ * 
+ * @param wifi_status
+ */
+static void ICACHE_FLASH_ATTR timing_check(uint8_t wifi_status)
+{
+    WIFI_CheckCause cause;
+    
+    switch(wifi_status) {
+        case STATION_IDLE:
+            cause = check_idle;
             break;
             
-        case mesh_leaf:
-            DTXT("WIFI_MeshInitialize(): mesh_leaf\n");
-            
-            wifi.m_WIFIMode = mesh_leaf;
-            WIFI_state      = wifi_disabled;
-            WIFI_Mesh_state = mesh_connect;
-            
-            wifi.m_StationConfig.ssid[0]     = '\0';
-            wifi.m_StationConfig.password[0] = '\0';
+        case STATION_WRONG_PASSWORD:
+            cause = check_wrong_password;
+            break;
             
-            //wifi_station_disconnect();
+        case STATION_NO_AP_FOUND:
+            cause = check_no_ap_found;
+            break;
             
-            wifi_station_set_config(&wifi.m_StationConfig);
+        case STATION_CONNECT_FAIL:
+            cause = check_connect_fail;
             break;
             
         default:
+            cause = check_connecting;
             break;
     }
-
-    DTXT("WIFI_MeshInitialize(): end; rc = %d\n", rc);
+    
+    if(ctx->m_Timing.check_fail[cause] < 0xFFFF) {
+        ctx->m_Timing.check_fail[cause]++;
+    }
+}
+#endif
+#if defined(WITH_TRACE)
+/**
+ * 
+ * @return 
+ */
+static uint32_t ICACHE_FLASH_ATTR trace_now(void)
+{
+    uint32_t ms = (system_get_time() - ctx->m_TraceAt) / 1000;
+    
+    ctx->m_TraceAt += ms * 1000;                                                // the remainder counts next time
+    ctx->m_TraceMs += ms;
+    
+    return ctx->m_TraceMs;
+}
+/**
+ * 
+ * @param event
+ * @param a
+ * @param b
+ */
+static void ICACHE_FLASH_ATTR trace_put(uint8_t event, uint8_t a, uint16_t b)
+{
+    WIFITrace* r = &ctx->m_Trace[ctx->m_TraceNext];
+    
+    r->m_Time  = trace_now();
+    r->m_Event = event;
+    r->m_A     = a;
+    r->m_B     = b;
+    
+    ctx->m_TraceNext = (ctx->m_TraceNext + 1) % WIFI_TRACE_SIZE;
+    
+    if(ctx->m_TraceCount < WIFI_TRACE_SIZE) {
+        ctx->m_TraceCount++;
+    }
+    else {
+        ctx->m_TraceLost++;
+    }
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR trace_run(void)
+{
+    trace_now();                                                                // keeps the clock going while nothing happens
+    
+    if(ctx->m_TraceState != ctx->m_State) {
+        trace_put(trace_state, ctx->m_TraceState, (uint16_t)ctx->m_State);
+        
+        ctx->m_TraceState = (uint8_t)ctx->m_State;
+    }
+    
+    if(ctx->m_TraceMeshState != ctx->m_MeshState) {
+        trace_put(trace_mesh_state, ctx->m_TraceMeshState, (uint16_t)ctx->m_MeshState);
+        
+        ctx->m_TraceMeshState = (uint8_t)ctx->m_MeshState;
+    }
+}
+/**
+ * 
+ * @param p
+ * @param value
+ * @param bytes
+ * @return 
+ */
+static uint8_t* ICACHE_FLASH_ATTR trace_write(uint8_t* p, uint32_t value, int bytes)
+{
+    while(bytes-- > 0) {
+        *p++    = (uint8_t)value;                                               // little endian
+        value >>= 8;
+    }
+    
+    return p;
+}
+#endif
+#if defined(WITH_MESH_UDP)
+/**
+ * bind the mesh port and allocate the batch buffers; once that worked, the pbufs are kept for good
+ */
+static int ICACHE_FLASH_ATTR mesh_udp_start(void)
+{
+    struct udp_pcb* pcb = NULL;
+    int             i;
+    
+    wifi_get_macaddr(STATION_IF, ctx->m_MeshUdp.m_Mac);
+    
+    if(ctx->m_MeshUdp.m_Pcb != NULL) {
+        return 0;
+    }
+    
+    for(i = 0; i < WIFI_MESH_FRAMES; i++) {
+        WIFIMeshFrame* f = &ctx->m_MeshUdp.m_Frame[i];
+        
+        if(f->m_Pbuf == NULL) {
+            f->m_Pbuf = pbuf_alloc(PBUF_TRANSPORT, WIFI_MESH_FRAME_SIZE, PBUF_RAM);
+            
+            if(f->m_Pbuf == NULL) {
+                break;
+            }
+            
+            f->m_Data = f->m_Pbuf->payload;
+        }
+    }
+    
+    if(i == WIFI_MESH_FRAMES) {
+        pcb = udp_new();
+    }
+    
+    if(pcb != NULL && udp_bind(pcb, IP_ADDR_ANY, WIFI_MESH_PORT) != ERR_OK) {
+        udp_remove(pcb);
+        pcb = NULL;
+    }
+    
+    if(pcb == NULL) {
+        for(i = 0; i < WIFI_MESH_FRAMES; i++) {
+            if(ctx->m_MeshUdp.m_Frame[i].m_Pbuf != NULL) {
+                pbuf_free(ctx->m_MeshUdp.m_Frame[i].m_Pbuf);                    // give the heap back; a frame still in the driver keeps its own reference
+                ctx->m_MeshUdp.m_Frame[i].m_Pbuf = NULL;
+            }
+        }
+        
+        DDBG("mesh_udp_start(): no frames or no port, retry with the next link check\n");
+        return -1;
+    }
+    
+    ctx->m_MeshUdp.m_Pcb = pcb;
+    
+    udp_recv(pcb, mesh_udp_recv, ctx);
+    
+    DTXT("mesh_udp_start(): port %d\n", WIFI_MESH_PORT);
+    
+    return 0;
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR mesh_udp_stop(void)
+{
+    if(ctx->m_MeshUdp.m_Pcb != NULL) {
+        udp_remove(ctx->m_MeshUdp.m_Pcb);
+        ctx->m_MeshUdp.m_Pcb = NULL;
+    }
+    
+    ctx->m_MeshUdp.m_Batch = NULL;
+    deadline_clear(DEADLINE_MESH_BATCH);
+}
+/**
+ * 
+ */
+static void ICACHE_FLASH_ATTR mesh_udp_flush(void)
+{
+    WIFIMeshFrame* f = ctx->m_MeshUdp.m_Batch;
+    
+    if(f == NULL) {
+        return;
+    }
+    
+    ctx->m_MeshUdp.m_Batch = NULL;
+    
+    deadline_clear(DEADLINE_MESH_BATCH);
+    
+    if(mesh_udp_is_root() && f->m_Data[1] == MESH_FRAME_UP) {
+        mesh_udp_deliver(f->m_Data, f->m_Used);                                 // became the root while batching
+        return;
+    }
+    
+    mesh_udp_send(f);
+}
+/**
+ * a free batch buffer with the header written
+ * 
+ * @param direction
+ * @return NULL when all of them are still being sent
+ */
+static WIFIMeshFrame* ICACHE_FLASH_ATTR mesh_udp_frame(uint8_t direction)
+{
+    WIFIMeshFrame* f;
+    int            i;
+    
+    for(i = 0; i < WIFI_MESH_FRAMES && ctx->m_MeshUdp.m_Frame[i].m_Pbuf->ref != 1; i++) {
+    }
+    
+    if(i == WIFI_MESH_FRAMES) {
+        DDBG("mesh_udp_frame(): all frames in flight\n");
+        return NULL;
+    }
+    
+    f = &ctx->m_MeshUdp.m_Frame[i];
+    
+    f->m_Data[0] = MESH_FRAME_MAGIC;
+    f->m_Data[1] = direction;
+    f->m_Data[2] = 0;
+    f->m_Data[3] = 0;
+    f->m_Used    = MESH_FRAME_HEADER;
+    
+    return f;
+}
+/**
+ * add one of our messages; the caller checked that it fits
+ * 
+ * @param f
+ * @param data
+ * @param length
+ */
+static void ICACHE_FLASH_ATTR mesh_udp_append(WIFIMeshFrame* f, const void* data, uint16_t length)
+{
+    os_memcpy(f->m_Data + f->m_Used, ctx->m_MeshUdp.m_Mac, sizeof(ctx->m_MeshUdp.m_Mac));
+    f->m_Data[f->m_Used + 6] = (uint8_t)(length >> 8);
+    f->m_Data[f->m_Used + 7] = (uint8_t)length;
+    os_memcpy(f->m_Data + f->m_Used + MESH_RECORD_HEADER, data, length);
+    
+    f->m_Used += MESH_RECORD_HEADER + length;
+    f->m_Data[3]++;
+}
+/**
+ * 
+ * @param f
+ * @return 
+ */
+static err_t ICACHE_FLASH_ATTR mesh_udp_send(WIFIMeshFrame* f)
+{
+    // lwIP left the payload pointer at the link header of the last send
+    f->m_Pbuf->payload = f->m_Data;
+    f->m_Pbuf->len     = f->m_Used;
+    f->m_Pbuf->tot_len = f->m_Used;
+    
+    return mesh_udp_output(f->m_Pbuf, f->m_Data[1]);
+}
+/**
+ * up goes to the parent, i.e. our gateway; down is broadcast on the softAP, or sent to the child the destination is
+ * reached through. Every softAP has the same subnet, so the interface is given rather than looked up from the address.
+ * 
+ * @param p
+ * @param direction
+ * @return 
+ */
+static err_t ICACHE_FLASH_ATTR mesh_udp_output(struct pbuf* p, uint8_t direction)
+{
+    err_t rc;
+    
+    if(direction == MESH_FRAME_UP) {
+        rc = udp_sendto_if(ctx->m_MeshUdp.m_Pcb, p, &ctx->m_Wifi.m_Info.gw, WIFI_MESH_PORT, eagle_lwip_getif(STATION_IF));
+    }
+    else if(direction == MESH_FRAME_TO) {
+        WIFIRoute* r = route_find((uint8_t*)p->payload + MESH_FRAME_HEADER);
+        
+        if(r != NULL && ctx->m_Children[r->m_Child].m_Ip.addr != 0) {
+            rc = udp_sendto_if(ctx->m_MeshUdp.m_Pcb, p, &ctx->m_Children[r->m_Child].m_Ip, WIFI_MESH_PORT, eagle_lwip_getif(SOFTAP_IF));
+        }
+        else {
+            rc = ERR_RTE;                                                       // left the mesh below us since
+        }
+    }
+    else if(ctx->m_ChildCount > 0) {
+        rc = udp_sendto_if(ctx->m_MeshUdp.m_Pcb, p, IP_ADDR_BROADCAST, WIFI_MESH_PORT, eagle_lwip_getif(SOFTAP_IF));
+    }
+    else {
+        rc = ERR_OK;                                                            // nobody below us
+    }
+    
+    if(rc != ERR_OK) {
+        DDBG("mesh_udp_output(): direction = %d, rc = %d\n", direction, rc);
+    }
     
     return rc;
 }
 /**
+ * a frame from a child (up) or from the parent (down, or to one node); it is passed on in the pbuf it came in, only
+ * the hop count is changed in place
  * 
- * @param on_connect
- * @param on_disconnect
- * @param ptr
- * @return 
+ * @param arg
+ * @param pcb
+ * @param p
+ * @param addr
+ * @param port
  */
-int ICACHE_FLASH_ATTR WIFI_SetCallback(WIFI_Callback on_connect, WIFI_Callback on_disconnect, void* ptr)
+static void ICACHE_FLASH_ATTR mesh_udp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, ip_addr_t* addr, u16_t port)
 {
-    wifi.m_OnConnectCallback    = on_connect;
-    wifi.m_OnDisconnectCallback = on_disconnect;
-    wifi.m_CallbackPtr          = ptr;
+    WIFI_Ctx* caller = ctx;                                                     // a node sending on the host may be delivering to us
     
-    return 0;
+    ctx = (WIFI_Ctx*)arg;                                                       // the node that bound the port
+    
+    uint8_t* h      = p->payload;
+    uint8_t  parent = (addr->addr == ctx->m_Wifi.m_Info.gw.addr) ? 1 : 0;
+    
+    if(p->len != p->tot_len || p->len < MESH_FRAME_HEADER || h[0] != MESH_FRAME_MAGIC || h[2] >= MESH_MAX_HOPS ||
+       (parent != 0 && h[1] != MESH_FRAME_DOWN && (h[1] != MESH_FRAME_TO || p->len < MESH_FRAME_TO_HEADER)) ||
+       (parent == 0 && h[1] != MESH_FRAME_UP)) {
+        DDBG("mesh_udp_recv(): dropped %d bytes\n", p->tot_len);
+        
+        pbuf_free(p);
+        ctx = caller;
+        return;
+    }
+    
+    h[2]++;
+    
+    if(h[1] == MESH_FRAME_DOWN) {
+        mesh_udp_deliver(h, p->len);
+        
+        if(ctx->m_Wifi.m_WIFIMode != mesh_leaf) {
+            mesh_udp_output(p, MESH_FRAME_DOWN);
+        }
+    }
+    else if(h[1] == MESH_FRAME_TO) {
+        if(os_memcmp(h + MESH_FRAME_HEADER, ctx->m_MeshUdp.m_Mac, 6) == 0) {
+            mesh_udp_deliver(h, p->len);
+        }
+        else {
+            mesh_udp_output(p, MESH_FRAME_TO);
+        }
+    }
+    else {
+        mesh_udp_learn(h, p->len, addr);
+        
+        if(mesh_udp_is_root()) {
+            mesh_udp_deliver(h, p->len);
+        }
+        else {
+            mesh_udp_output(p, MESH_FRAME_UP);
+        }
+    }
+    
+    pbuf_free(p);                                                               // the driver holds its own reference while sending
+    
+    ctx = caller;
 }
 /**
  * 
- * @return 
+ * @param frame
+ * @param length
  */
-int ICACHE_FLASH_ATTR WIFI_IsConnected(void)
+static void ICACHE_FLASH_ATTR mesh_udp_deliver(const uint8_t* frame, uint16_t length)
 {
-    switch(wifi.m_WIFIMode) {
-        case ap_fixed:
-        case ap_fixed_auto:
-            //DTXT("WIFI_IsConnected(): ap_fixed\n");
-            return (WIFI_state == wifi_ready) ? 1 : 0;
-            break;
-            
-        case mesh_root:
-            //DTXT("WIFI_IsConnected(): mesh_root\n");
-            //return (espconn_mesh_get_status() == MESH_ONLINE_AVAIL) ? 1 : 0;
-            return (WIFI_state == wifi_ready) ? 1 : 0;
-            break;
-            
-        case mesh_non_leaf:
-            //DTXT("WIFI_IsConnected(): mesh_non_leaf\n");
-            //return (espconn_mesh_get_status() == MESH_ONLINE_AVAIL) ? 1 : 0;
-            //break;
-            
-        case mesh_leaf:
-            //DTXT("WIFI_IsConnected(): mesh_leaf\n");
-            //return  () && ((espconn_mesh_get_status() == MESH_ONLINE_AVAIL) ? 1 : 0;
+    uint16_t offset = (frame[1] == MESH_FRAME_TO) ? MESH_FRAME_TO_HEADER : MESH_FRAME_HEADER;
+    uint8_t  count  = frame[3];
+    
+    while(count-- > 0 && offset + MESH_RECORD_HEADER <= length) {
+        uint16_t size = (uint16_t)((frame[offset + 6] << 8) | frame[offset + 7]);
+        
+        if(offset + MESH_RECORD_HEADER + size > length) {
             break;
+        }
+        
+        if(ctx->m_MeshUdp.m_Receive != NULL) {
+            ctx->m_MeshUdp.m_Receive(frame + offset, frame + offset + MESH_RECORD_HEADER, size, ctx->m_MeshUdp.m_ReceivePtr);
+        }
+        
+        offset += MESH_RECORD_HEADER + size;
     }
-    
-    return 0;
 }
 /**
+ * the nodes that sent the messages in a frame from a child are reached through that child
  * 
- * @return 
+ * @param frame
+ * @param length
+ * @param addr
  */
-int ICACHE_FLASH_ATTR WIFI_connect(void)
+static void ICACHE_FLASH_ATTR mesh_udp_learn(const uint8_t* frame, uint16_t length, const ip_addr_t* addr)
 {
-    WIFI_state = wifi_connect;
+    uint16_t offset = MESH_FRAME_HEADER;
+    uint8_t  count  = frame[3];
+    int      child;
     
-    return 0;
+    for(child = 0; child < WIFI_MAX_CHILDREN; child++) {
+        if(ctx->m_Children[child].m_Used != 0 && ctx->m_Children[child].m_Ip.addr == addr->addr) {
+            break;
+        }
+    }
+    
+    if(child == WIFI_MAX_CHILDREN) {
+        return;                                                                 // no lease seen yet; route_reconcile() catches up
+    }
+    
+    while(count-- > 0 && offset + MESH_RECORD_HEADER <= length) {
+        route_learn(frame + offset, (uint8_t)child);
+        
+        offset += MESH_RECORD_HEADER + ((frame[offset + 6] << 8) | frame[offset + 7]);
+    }
 }
 /**
+ * the root is the one on the router; a mesh_root that fell back into the mesh forwards like any other node
  * 
  * @return 
  */
-int ICACHE_FLASH_ATTR WIFI_disconnect(void)
+static int ICACHE_FLASH_ATTR mesh_udp_is_root(void)
 {
-    WIFI_state = wifi_disconnect;
-    
-    return 0;
+    return (ctx->m_Wifi.m_WIFIMode == mesh_root && ctx->m_State == wifi_ready) ? 1 : 0;
 }
+#endif
 /**
+ * use the BSSID/channel cached in RTC memory if it belongs to the AP we are about to connect to
  * 
- * @return 
+ * @return 0 when a fast connect has been set up
  */
-int ICACHE_FLASH_ATTR WIFI_Run(void)
+static int ICACHE_FLASH_ATTR fast_connect_load(void)
 {
-    //DTXT("WIFI_Run(): begin\n");
+    if(!system_rtc_mem_read(WIFI_RTC_ADDR, &ctx->m_Rtc, sizeof(ctx->m_Rtc))) {
+        return -1;
+    }
     
-    int rc = 0;
+    if(ctx->m_Rtc.m_Magic != WIFI_RTC_MAGIC || ctx->m_Rtc.m_Checksum != wifi_rtc_checksum(&ctx->m_Rtc)) {
+        DTXT("fast_connect_load(): no valid record\n");
+        return -1;
+    }
     
-    switch(WIFI_state) {
-        case wifi_disabled:                                                     // if we're mesh non-leaf or mesh leaf
-            break;
-            
-        case none:
-            //WIFI_state = do_wifi_connect();
-            //countdown(&timer1, CHECK_INTERVAL_SECONDS);
-            break;
-
-        case wifi_connect:
-            WIFI_state = do_wifi_connect();
-            countdown(&connect_check_timer,   CONNECT_CHECK_INTERVAL_SECONDS);
-            countdown(&connect_timeout_timer, CONNECT_TIMEOUT_SECONDS);
-            break;
-
-        case wifi_connect_in_progress:
-            if(wifi.m_WIFIMode != ap_fixed && expired(&connect_timeout_timer)) {
-                DTXT("WIFI_Run(): connect timeout\n");
-                
-                WIFI_state = wifi_disabled;
-            }
-            else if(expired(&connect_check_timer)) {
-                WIFI_state = do_wifi_check();
-                
-                countdown(&connect_check_timer, CONNECT_CHECK_INTERVAL_SECONDS);
-            }
-            break;
-
-        case wifi_connect_fail:
-            if(wifi.m_WIFIMode != ap_fixed) {
-                DTXT("WIFI_Run(): connect fail\n");
-                
-                WIFI_state = wifi_disabled;
-            }
-            else {
-                WIFI_state = do_wifi_connect();                                 // start again
-                countdown(&connect_check_timer, CONNECT_CHECK_INTERVAL_SECONDS);
-            }
-            break;
-
-        case wifi_connect_done:
-            WIFI_state = do_wifi_connect_done();
-            
-            if(wifi.m_OnConnectCallback != 0) {
-                wifi.m_OnConnectCallback(1, wifi.m_CallbackPtr);                // notify user
-            }
-            
-            countdown(&connect_check_timer, CONNECT_CHECK_INTERVAL_SECONDS);
-            break;
-            
-        case wifi_disconnect:
-            WIFI_state = do_wifi_disconnect();
-            break;
-            
-        case wifi_disconnect_in_progress:
-            break;
-            
-        case wifi_disconnect_done:
-            WIFI_state = do_wifi_disconnect_done();
-            
-            if(wifi.m_OnDisconnectCallback != 0) {
-                wifi.m_OnDisconnectCallback(1, wifi.m_CallbackPtr);             // notify user
-            }
-            break;
-            
-        case wifi_scan:
-            WIFI_state = do_wifi_scan();
-            break;
-
-        case wifi_scan_in_progress:
-            break;
-
-        case wifi_scan_done:
-            WIFI_state = do_wifi_scan_done();
-            break;
-
-        case wifi_scan_fail:
-            if(expired(&connect_check_timer)) {
-                WIFI_state = do_wifi_scan();
-                
-                countdown(&connect_check_timer, CONNECT_CHECK_INTERVAL_SECONDS);
-            }
-            break;
-            
-        case wifi_ready:
-            if(expired(&connect_check_timer)) {
-                WIFI_state_t state = do_wifi_check();
-                
-                if(state != wifi_connect_done) {
-                    if(wifi.m_WIFIMode == ap_fixed_auto) {
-                        WIFI_state = wifi_scan;
-                    }
-                    else {
-                        WIFI_state = state;                                     // something happened
-                    }
-                    //if(wifi.m_Callback != 0) {
-                    //    wifi.m_Callback(0, wifi.m_CallbackPtr);                 // notify user
-                    //}
-                }
-                
-                countdown(&connect_check_timer, CONNECT_CHECK_INTERVAL_SECONDS);
-            }
-            break;
-            
-        default:
-            DTXT("WIFI_Run(): WIFI_state default\n");
-            break;
+    ctx->m_ScanPlan.m_Known = ctx->m_Rtc.m_Channels & SCAN_CHANNELS;
+    
+    if(ctx->m_Rtc.m_Channel == 0) {
+        return -1;
     }
     
-    switch(WIFI_Mesh_state) {
-        case mesh_disabled:
-            break;
-            
-        case none:
-            if(WIFI_state == wifi_disabled) {
-                DTXT("WIFI_Run(): mesh - wifi disabled, start mesh connect\n");
-                WIFI_Mesh_state = mesh_connect;
-            }
-            break;
-            
-        case mesh_connect:
-            WIFI_Mesh_state = do_wifi_mesh_connect();
-            countdown(&mesh_check_timer, MESH_CHECK_INTERVAL_SECONDS);
-            break;
-            
-        case mesh_scan_in_progress:
-            break;
-            
-        case mesh_scan_done:
-            WIFI_Mesh_state = do_wifi_mesh_connect();
-            break;
-            
-        case mesh_connect_in_progress:
-            if(expired(&mesh_check_timer)) {
-                WIFI_Mesh_state = do_wifi_mesh_check();
-                
-                countdown(&mesh_check_timer, MESH_CHECK_INTERVAL_SECONDS);
-            }
-            break;
-            
-        case mesh_connect_done:
-            break;
-            
-        case mesh_connect_fail:
-            break;
-            
-        default:
-            DTXT("WIFI_Run(): WIFI_Mesh_state default\n");
-            break;
+    if(ctx->m_Wifi.m_WIFIMode == ap_fixed_auto) {
+        int i;
+        
+        for(i = 0; ctx->m_List[i].ssid != NULL && i < ctx->m_Rtc.m_Index; i++) {
+        }
+        
+        if(ctx->m_Rtc.m_Index == WIFI_RTC_NO_INDEX || ctx->m_List[i].ssid == NULL || wifi_ssid_hash(ctx->m_List[i].ssid, os_strlen(ctx->m_List[i].ssid)) != ctx->m_Rtc.m_SsidHash) {
+            DTXT("fast_connect_load(): AP list changed\n");
+            return -1;
+        }
+        
+        ctx->m_BestSsid = &ctx->m_List[i];
+        
+        os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.ssid), ctx->m_BestSsid->ssid);
+        
+        if(ctx->m_BestSsid->psw != NULL) {
+            os_strcpy((char*)(ctx->m_Wifi.m_StationConfig.password), ctx->m_BestSsid->psw);
+        }
+        else {
+            ctx->m_Wifi.m_StationConfig.password[0] = '\0';
+        }
+    }
+    else if(wifi_ssid_hash(ctx->m_Wifi.m_StationConfig.ssid, os_strlen((const char*)ctx->m_Wifi.m_StationConfig.ssid)) != ctx->m_Rtc.m_SsidHash) {
+        DTXT("fast_connect_load(): ssid changed\n");
+        return -1;
     }
     
-    /*switch(wifi.m_WIFIMode) {
-        case ap_fixed:
-            break;
-            
-        case mesh_root:
-            break;
-            
-        case mesh_non_leaf:
-            break;
-            
-        case mesh_leaf:
-            break;
-    }*/
+    os_memcpy(ctx->m_Wifi.m_StationConfig.bssid, ctx->m_Rtc.m_Bssid, sizeof(ctx->m_Wifi.m_StationConfig.bssid));
     
-    //DTXT("WIFI_Run(): end\n");
+    ctx->m_Wifi.m_StationConfig.bssid_set = 1;
+    ctx->m_Wifi.m_Channel                 = ctx->m_Rtc.m_Channel;
+    ctx->m_Wifi.m_FastConnect             = 1;
     
-    return rc;
-}
-/**
- * 
- * @return 
- */
-const char* WIFI_GetMAC(void)
-{
-    return wifi.m_Mac;
+    DTXT("fast_connect_load(): bssid = " BSSIDSTR ", channel = %d\n", BSSID2STR(ctx->m_Rtc.m_Bssid), ctx->m_Rtc.m_Channel);
+    
+    return 0;
 }
-
-/******************************************************************************************************************
- * private functions
- *
- */
-
 /**
  * 
  * @return 
  */
-static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_connect(void)
+static int ICACHE_FLASH_ATTR fast_connect_save(void)
 {
-    DTXT("do_wifi_connect(): begin\n");
+    WIFIRtc rtc;
     
-    switch(wifi.m_WIFIMode) {
-        case ap_fixed:
-        case ap_fixed_auto:
-            // required to call wifi_set_opmode before station_set_config
-            wifi_set_opmode_current(STATION_MODE);
-
-            wifi_station_set_config_current(&wifi.m_StationConfig);
-            wifi_station_connect();
-
-            wifi_station_set_auto_connect(1);
-            break;
-            
-        case mesh_root:
-            // required to call wifi_set_opmode before station_set_config
-            wifi_set_opmode_current(STATION_MODE);
-
-            wifi_station_set_config_current(&wifi.m_StationConfig);
-            wifi_station_connect();
-
-            wifi_station_set_auto_connect(1);
-            break;
-            
-        case mesh_non_leaf:
-            break;
-            
-        case mesh_leaf:
-            break;
+    os_memset(&rtc, 0, sizeof(rtc));
+    
+    if(ctx->m_Wifi.m_Channel == 0) {                                            // no connect event (polling)
+        ctx->m_Wifi.m_Channel = wifi_get_channel();
+        
+        if(ctx->m_Wifi.m_WIFIMode == ap_fixed_auto) {
+            os_memcpy(ctx->m_Wifi.m_Bssid, ctx->m_BestBssid, sizeof(ctx->m_Wifi.m_Bssid));
+        }
+    }
+    
+    os_memcpy(rtc.m_Bssid, ctx->m_Wifi.m_Bssid, sizeof(rtc.m_Bssid));
+    
+    if((rtc.m_Bssid[0] | rtc.m_Bssid[1] | rtc.m_Bssid[2] | rtc.m_Bssid[3] | rtc.m_Bssid[4] | rtc.m_Bssid[5]) == 0 || ctx->m_Wifi.m_Channel == 0) {
+        return -1;                                                              // don't know which AP we're on
     }
     
-    DTXT("do_wifi_connect(): end\n");
+    rtc.m_Magic    = WIFI_RTC_MAGIC;
+    rtc.m_SsidHash = wifi_ssid_hash(ctx->m_Wifi.m_StationConfig.ssid, os_strlen((const char*)ctx->m_Wifi.m_StationConfig.ssid));
+    ctx->m_ScanPlan.m_Known |= (1 << ctx->m_Wifi.m_Channel);
     
-    return wifi_connect_in_progress;
+    rtc.m_Channel  = ctx->m_Wifi.m_Channel;
+    rtc.m_Channels = ctx->m_ScanPlan.m_Known;
+    rtc.m_Index    = (ctx->m_Wifi.m_WIFIMode == ap_fixed_auto && ctx->m_BestSsid != NULL) ? (uint8_t)(ctx->m_BestSsid - ctx->m_List) : WIFI_RTC_NO_INDEX;
+#if defined(WITH_IP_CACHE)
+    rtc.m_Info     = ctx->m_Wifi.m_Info;
+#endif
+    rtc.m_Checksum = wifi_rtc_checksum(&rtc);
+    
+    if(os_memcmp(&rtc, &ctx->m_Rtc, sizeof(rtc)) == 0) {
+        return 0;                                                               // already there
+    }
+    
+    ctx->m_Rtc = rtc;
+    
+    DTXT("fast_connect_save(): bssid = " BSSIDSTR ", channel = %d\n", BSSID2STR(rtc.m_Bssid), rtc.m_Channel);
+    
+    return system_rtc_mem_write(WIFI_RTC_ADDR, &ctx->m_Rtc, sizeof(ctx->m_Rtc)) ? 0 : -1;
 }
 /**
+ * the cached AP did not answer; forget it and do it the slow way
  * 
  * @return 
  */
-static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_connect_done(void)
+static WIFI_state_t ICACHE_FLASH_ATTR fast_connect_fallback(void)
 {
-    DTXT("do_wifi_connect_done(): begin\n");
-    
-    WIFI_state_t state = wifi_ready;
+    DTXT("fast_connect_fallback(): begin\n");
     
-    wifi_get_ip_info(STATION_IF, &(wifi.m_Info));
+    wifi_station_disconnect();
     
-    DTXT("do_wifi_connect_done(): ip = %d.%d.%d.%d\n", ip4_addr1(&wifi.m_Info.ip), ip4_addr2(&wifi.m_Info.ip), ip4_addr3(&wifi.m_Info.ip), ip4_addr4(&wifi.m_Info.ip));
+    ctx->m_Rtc.m_Channel  = 0;                                                  // keep the known channels for the scan
+    ctx->m_Rtc.m_Checksum = wifi_rtc_checksum(&ctx->m_Rtc);
+    system_rtc_mem_write(WIFI_RTC_ADDR, &ctx->m_Rtc, sizeof(ctx->m_Rtc));
     
-    switch(wifi.m_WIFIMode) {
-        case ap_fixed:
-            DTXT("do_wifi_connect_done(): ap_fixed\n");
-            break;
-            
-        case ap_fixed_auto:
-            DTXT("do_wifi_connect_done(): ap_fixed_auto\n");
-            break;
-            
-        case mesh_root:
-            DTXT("do_wifi_connect_done(): mesh_root\n");
-            wifi_set_opmode_current(STATIONAP_MODE);
-            
-            mesh_status = MESH_STATUS_CONNECTED;
-
-            build_mesh_ap_ssid(mesh_status);
-        
-            wifi_softap_set_config_current(&wifi_mesh.m_ApConfig);
-
-            //setup_udp();
-            break;
-            
-        case mesh_non_leaf:
-            DTXT("do_wifi_connect_done(): mesh_non_leaf\n");
-            break;
-            
-        case mesh_leaf:
-            DTXT("do_wifi_connect_done(): mesh_leaf\n");
-            break;
-    }
-                
-    DTXT("do_wifi_connect_done(): end\n");
+    ctx->m_Wifi.m_FastConnect             = 0;
+    ctx->m_Wifi.m_Channel                 = 0;
+    ctx->m_Wifi.m_StationConfig.bssid_set = 0;
     
-    return state;
+    return (ctx->m_Wifi.m_WIFIMode == ap_fixed_auto) ? wifi_scan : wifi_connect;
 }
 /**
  * 
  * @return 
  */
-static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_disconnect(void)
+static int ICACHE_FLASH_ATTR resume_save(void)
 {
-    DTXT("do_wifi_disconnect(): begin\n");
+    WIFIResume r;
     
-    switch(wifi.m_WIFIMode) {
-        case ap_fixed:
-            wifi_station_set_auto_connect(0);
-            wifi_station_disconnect();
-            break;
-            
-        case ap_fixed_auto:
-            wifi_station_set_auto_connect(0);
-            wifi_station_disconnect();
-            break;
-            
-        case mesh_root:
-            wifi_station_set_auto_connect(0);
-            wifi_station_disconnect();
-
-            mesh_status = MESH_STATUS_NONE;
-
-            build_mesh_ap_ssid(mesh_status);
-            
-            wifi_softap_set_config(&wifi_mesh.m_ApConfig);
-            break;
-            
-        case mesh_non_leaf:
-            break;
-            
-        case mesh_leaf:
-            break;
+    os_memset(&r, 0, sizeof(r));
+    
+    r.m_Magic         = WIFI_RESUME_MAGIC;
+    r.m_WIFIMode      = (uint8_t)ctx->m_Wifi.m_WIFIMode;
+    r.m_EventDriven   = ctx->m_Wifi.m_EventDriven;
+    r.m_RetryCause    = ctx->m_Retry.m_Cause;
+    r.m_RetryAttempts = ctx->m_Retry.m_Attempts;
+    
+    os_memcpy(r.m_Mac, ctx->m_Wifi.m_Mac, sizeof(r.m_Mac));
+    os_memcpy(r.m_MeshPrefix, ctx->m_MeshPrefix, sizeof(r.m_MeshPrefix));
+    os_memcpy(r.m_MeshPostfix, ctx->m_MeshPostfix, sizeof(r.m_MeshPostfix));
+    
+    if(ctx->m_Wifi.m_WIFIMode != ap_fixed_auto) {                               // ap_fixed_auto takes it from wifi_list
+        os_memcpy(r.m_StationConfig.ssid, ctx->m_Wifi.m_StationConfig.ssid, sizeof(r.m_StationConfig.ssid));
+        os_memcpy(r.m_StationConfig.password, ctx->m_Wifi.m_StationConfig.password, sizeof(r.m_StationConfig.password));
     }
     
-    DTXT("do_wifi_disconnect(): end\n");
+    if(ctx->m_Wifi.m_WIFIMode != ap_fixed && ctx->m_Wifi.m_WIFIMode != ap_fixed_auto) {
+        r.m_ApConfig = ctx->m_Mesh.m_ApConfig;
+    }
     
-    return wifi_disconnect_in_progress;
+    r.m_Checksum = resume_checksum(&r);
+    
+    if(os_memcmp(&r, &ctx->m_Resume, sizeof(r)) == 0) {
+        return 0;                                                               // already there
+    }
+    
+    ctx->m_Resume = r;
+    
+    return system_rtc_mem_write(WIFI_RESUME_RTC_ADDR, &ctx->m_Resume, sizeof(ctx->m_Resume)) ? 0 : -1;
 }
 /**
  * 
+ * @param resume
  * @return 
  */
-static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_disconnect_done(void)
+static uint32_t ICACHE_FLASH_ATTR resume_checksum(const WIFIResume* resume)
 {
-    DTXT("do_wifi_disconnect_done(): begin\n");
-    
-    WIFI_state_t state = wifi_disabled;
-    
-    DTXT("do_wifi_disconnect_done(): end\n");
+    const uint8_t* p = &resume->m_WIFIMode;
     
-    return state;
+    return wifi_ssid_hash(p, (size_t)((const uint8_t*)resume + sizeof(*resume) - p));
 }
+#if defined(WITH_IP_CACHE)
 /**
+ * skip DHCP when we go straight back to the cached AP and have its last lease
+ */
+static void ICACHE_FLASH_ATTR ip_cache_apply(void)
+{
+    if(ctx->m_Wifi.m_FastConnect != 0 && ctx->m_Rtc.m_Info.ip.addr != 0 && ctx->m_Rtc.m_Info.gw.addr != 0 &&
+       os_memcmp(ctx->m_Rtc.m_Bssid, ctx->m_Wifi.m_StationConfig.bssid, sizeof(ctx->m_Rtc.m_Bssid)) == 0) { // not after roaming to another AP
+        DTXT("ip_cache_apply(): ip = %d.%d.%d.%d\n", IP2STR(&ctx->m_Rtc.m_Info.ip));
+        
+        wifi_station_dhcpc_stop();
+        wifi_set_ip_info(STATION_IF, &ctx->m_Rtc.m_Info);
+        
+        ctx->m_Wifi.m_StaticIp = IP_CACHE_APPLIED;
+    }
+    else if(ctx->m_Wifi.m_StaticIp != IP_CACHE_NONE) {
+        wifi_station_dhcpc_start();
+        
+        ctx->m_Wifi.m_StaticIp = IP_CACHE_NONE;
+    }
+}
+/**
+ * ask the gateway for its MAC; an answer within IP_CACHE_VERIFY_MS means the lease is still good on this network
  * 
  * @return 
  */
-static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_check(void)
+static WIFI_state_t ICACHE_FLASH_ATTR ip_cache_verify(void)
 {
-    WIFI_state_t state;
+    struct netif*    netif = eagle_lwip_getif(STATION_IF);
+    struct eth_addr* eth;
+    ip_addr_t*       ip;
     
-    uint8_t wifi_status = wifi_station_get_connect_status();
+    if(ctx->m_Wifi.m_StaticIp == IP_CACHE_APPLIED) {
+        etharp_request(netif, &ctx->m_Rtc.m_Info.gw);
+        deadline_set(DEADLINE_CONNECT_TIMEOUT, IP_CACHE_VERIFY_MS);
+        
+        ctx->m_Wifi.m_StaticIp = IP_CACHE_VERIFYING;
+        
+        return wifi_connect_verify;
+    }
     
-    switch(wifi_status) {
-        case STATION_IDLE:
-            DTXT("do_wifi_check(): STATION_IDLE\n");
-            state = wifi_connect_fail;
-            break;
-            
-        case STATION_GOT_IP:
-            //DTXT("do_wifi_check(): STATION_GOT_IP\n");
-            state = wifi_connect_done;
-            break;
-            
-        case STATION_WRONG_PASSWORD:
-            DTXT("do_wifi_check(): STATION_WRONG_PASSWORD\n");
-            state = wifi_connect_fail;
-            break;
-
-        case STATION_NO_AP_FOUND:
-            DTXT("do_wifi_check(): STATION_NO_AP_FOUND\n");
-            state = wifi_connect_fail;
-            break;
-
-        case STATION_CONNECT_FAIL:
-            DTXT("do_wifi_check(): STATION_CONNECT_FAIL\n");
-            state = wifi_connect_fail;
-            break;
+    if(etharp_find_addr(netif, &ctx->m_Rtc.m_Info.gw, &eth, &ip) >= 0) {
+        DDBG("ip_cache_verify(): gateway answered\n");
         
-        default:
-            DTXT("do_wifi_check(): wifi not connected; wifi_status = %d\n", wifi_status);
-            state = wifi_connect_fail;
-            break;
+        ctx->m_Wifi.m_StaticIp = IP_CACHE_VERIFIED;
+        
+        return wifi_connect_done;
     }
-                
-    return state;
+    
+    if(deadline_passed(DEADLINE_CONNECT_TIMEOUT)) {
+        return ip_cache_fallback();
+    }
+    
+    return wifi_connect_verify;
 }
 /**
+ * the cached lease is no good here; forget it and let DHCP do its thing on the current association
  * 
  * @return 
  */
-static WIFI_Mesh_state_t ICACHE_FLASH_ATTR do_wifi_mesh_connect(void)
+static WIFI_state_t ICACHE_FLASH_ATTR ip_cache_fallback(void)
 {
-    DTXT("do_wifi_mesh_connect(): begin\n");
-
-    wifi_station_set_auto_connect(0);
-    wifi_station_disconnect();
+    DTXT("ip_cache_fallback(): gateway did not answer, using DHCP\n");
     
-    // start scan
-    wifi_station_scan(NULL, &scan_done_callback);
+    os_memset(&ctx->m_Rtc.m_Info, 0, sizeof(ctx->m_Rtc.m_Info));
+    ctx->m_Rtc.m_Checksum = wifi_rtc_checksum(&ctx->m_Rtc);
+    system_rtc_mem_write(WIFI_RTC_ADDR, &ctx->m_Rtc, sizeof(ctx->m_Rtc));
     
-    DTXT("do_wifi_mesh_connect(): end\n");
+    wifi_station_dhcpc_start();
     
-    return mesh_scan_in_progress;
+    ctx->m_Wifi.m_StaticIp = IP_CACHE_NONE;
+    
+    deadline_set(DEADLINE_CONNECT_TIMEOUT, CONNECT_TIMEOUT_SECONDS * 1000u);
+    
+    return wifi_connect_in_progress;
 }
+#endif
 /**
  * 
+ * @param rtc
  * @return 
  */
-static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_scan(void)
+static uint32_t ICACHE_FLASH_ATTR wifi_rtc_checksum(const WIFIRtc* rtc)
 {
-    DTXT("do_wifi_scan(): begin\n");
-    
-    // ensure we are in station mode
-    wifi_set_opmode(STATION_MODE);
-   
-    bool rc = wifi_station_scan(NULL, scan_done_callback);
+    const uint8_t* p   = (const uint8_t*)&rtc->m_SsidHash;
+    const uint8_t* end = (const uint8_t*)rtc + sizeof(*rtc);
+    uint32_t       sum = 0x811C9DC5;
     
-    DTXT("do_wifi_scan(): end; rc = %s\n", rc ? "True" : "False");
+    while(p < end) {
+        sum = (sum ^ *p++) * 0x01000193;
+    }
     
-    return wifi_scan_in_progress;
+    return sum;
 }
 /**
+ * FNV-1a
  * 
+ * @param ssid
+ * @param length
  * @return 
  */
-static WIFI_state_t ICACHE_FLASH_ATTR do_wifi_scan_done(void)
+static uint32_t ICACHE_FLASH_ATTR wifi_ssid_hash(const void* ssid, size_t length)
 {
-    DTXT("do_wifi_scan_done(): begin\n");
-
-    WIFI_state_t state;
+    const uint8_t* p    = ssid;
+    uint32_t       hash = 0x811C9DC5;
     
-    if(wifi_best_ssid != NULL) {
-        os_strcpy((char*)(wifi.m_StationConfig.ssid), wifi_best_ssid->ssid);
-
-        if(wifi_best_ssid->psw != NULL) {
-            os_strcpy((char*)(wifi.m_StationConfig.password), wifi_best_ssid->psw);
-        }
-        else {
-            wifi.m_StationConfig.password[0] = '\0';
-        }
-        
-        state = wifi_connect;
-    }
-    else {
-        state = wifi_scan;
+    while(length-- > 0) {
+        hash = (hash ^ *p++) * 0x01000193;
     }
     
-    DTXT("do_wifi_scan_done(): end\n");
-    
-    return state;
+    return hash;
 }
+#if defined(WITH_LOG_RING)
 /**
+ * called from SDK callbacks too; must not touch the UART
  * 
- * @param arg
- * @param status
+ * @param fmt
+ * @param a
+ * @param b
+ * @param c
+ * @param d
  */
-static void ICACHE_FLASH_ATTR scan_done_callback(void* arg, STATUS status)
+static void wifi_log_put(const char* fmt, uintptr_t a, uintptr_t b, uintptr_t c, uintptr_t d)
 {
-    DTXT("scan_done_callback(): begin\n");
-
-    struct bss_info *bss = arg;
-    
-    sint8    best_rssi = -127;
-    WIFI_AP* s;
+    uint16_t next = (log_head + 1) % WIFI_LOG_RING_SIZE;
     
-    switch(status) {
-        case OK:
-            DTXT("scan_done_callback(): status == OK\n");
-            
-            while(bss) {
-                DTXT("%s %d %d %d\n", bss->ssid, bss->channel, bss->rssi, bss->authmode);
-                
-                s = wifi_find_ssid((const char*)bss->ssid);
-                
-                if(s != NULL) {
-                    if(bss->rssi > best_rssi) {
-                        best_rssi      = bss->rssi;
-                        wifi_best_ssid = s;
-                    }
-                }
-                
-                //DTXT("bssid: %02x:%02x:%02x:%02x:%02x:%02x\n", MAC2STR(inf->bssid));
-                //DTXT("ssid:  %s\n", (char*)inf->ssid);
-                //DTXT("rssi:  %d\n", inf->rssi);
-                
-                    //os()->jsonRpc()->getJEncoder()->setName("bssid");   os()->jsonRpc()->getJEncoder()->setString(b);
-                    //os()->jsonRpc()->getJEncoder()->setName("ssid");    os()->jsonRpc()->getJEncoder()->setString((char*)inf->ssid);
-                    //os()->jsonRpc()->getJEncoder()->setName("channel"); os()->jsonRpc()->getJEncoder()->setInt(inf->channel);
-                    //os()->jsonRpc()->getJEncoder()->setName("rssi");    os()->jsonRpc()->getJEncoder()->setInt(inf->rssi);
-                    //os()->jsonRpc()->getJEncoder()->setName("auth");    os()->jsonRpc()->getJEncoder()->setString(auth_to_string(b, inf->authmode));                            
-
-                bss = bss->next.stqe_next;
-            }
-            
-            WIFI_state = wifi_scan_done;
-            break;
-            
-        case FAIL:
-        case PENDING:
-        case BUSY:
-        case CANCEL:
-            DTXT("scan_done_callback(): status = %d\n", status);
-            WIFI_state = wifi_scan_fail;
-            break;
-    }
-
-    if (WIFI_Mesh_state != mesh_disabled) {
-        WIFI_Mesh_state = mesh_scan_done;
+    if(next == log_tail) {
+        log_dropped++;
+        return;
     }
     
-    DTXT("scan_done_callback(): end\n");    
+    WIFILog* r = &log_ring[log_head];
+    
+    r->m_Format = fmt;
+    r->m_Arg[0] = a;
+    r->m_Arg[1] = b;
+    r->m_Arg[2] = c;
+    r->m_Arg[3] = d;
+    
+    log_head = next;
 }
+#endif
 /**
  * 
- * @return 
  */
-static WIFI_Mesh_state_t ICACHE_FLASH_ATTR do_wifi_mesh_check(void)
+static void ICACHE_FLASH_ATTR config_load(void)
 {
-    uint8 stationCount = wifi_softap_get_station_num();
+    if(ctx->m_Flash.m_Loaded != 0) {
+        return;
+    }
     
-    DTXT("do_wifi_mesh_check(): stationCount = %d\n", stationCount);
+    ctx->m_Flash.m_OpMode      = wifi_get_opmode_default();
+    ctx->m_Flash.m_AutoConnect = wifi_station_get_auto_connect();
     
-    struct station_info *stationInfo = wifi_softap_get_station_info();
+    wifi_station_get_config_default(&ctx->m_Flash.m_StationConfig);
+    wifi_softap_get_config_default(&ctx->m_Flash.m_ApConfig);
     
-    if(stationInfo != NULL) {
-        while(stationInfo != NULL) {
-           DTXT("do_wifi_mesh_check(): station IP: %d.%d.%d.%d\n", IP2STR(&(stationInfo->ip)));
-           stationInfo = STAILQ_NEXT(stationInfo, next);
+    ctx->m_Flash.m_Loaded = 1;
+}
+/**
+ * 
+ * @param mode
+ * @param persist
+ * @return 
+ */
+static bool ICACHE_FLASH_ATTR config_opmode(uint8_t mode, uint8_t persist)
+{
+    if(persist != 0) {
+        config_load();                                                          // the _current calls don't need the flash copy
+        
+        if(ctx->m_Flash.m_OpMode != mode) {
+            ctx->m_Flash.m_OpMode = mode;
+            ctx->m_Flash.m_Writes++;
+            
+            return wifi_set_opmode(mode);
         }
         
-        wifi_softap_free_station_info();
+        ctx->m_Flash.m_Avoided++;
     }
     
-    //broadcast_udp();
-    
-    return WIFI_Mesh_state;
-    
-    if(WIFI_IsConnected() == 1) {
-        return mesh_connect_done;
-
-    }
-    else {
-        return mesh_connect_in_progress;
+    if(wifi_get_opmode() == mode) {
+        return true;
     }
+    
+    return wifi_set_opmode_current(mode);
 }
 /**
  * 
- * @param status
+ * @param config
+ * @param persist
  * @return 
  */
-int ICACHE_FLASH_ATTR build_mesh_ap_ssid(char status)
+static bool ICACHE_FLASH_ATTR config_station(struct station_config* config, uint8_t persist)
 {
-    char buf[2];
-    buf[0] = status;
-    buf[1] = '\0';
-
-    os_strcpy((char*)(wifi_mesh.m_ApConfig.ssid), mesh_prefix);
-    os_strcat((char*)(wifi_mesh.m_ApConfig.ssid), "_");
-    os_strcat((char*)(wifi_mesh.m_ApConfig.ssid), buf);
-    os_strcat((char*)(wifi_mesh.m_ApConfig.ssid), "_");
-    os_strcat((char*)(wifi_mesh.m_ApConfig.ssid), mesh_postfix);
-    
-    DTXT("build_mesh_ap_ssid(): %s\n", wifi_mesh.m_ApConfig.ssid);
+    if(persist != 0) {
+        config_load();
+        
+        struct station_config* f = &ctx->m_Flash.m_StationConfig;
+        
+        if(os_strncmp((const char*)f->ssid, (const char*)config->ssid, sizeof(f->ssid)) != 0 ||
+           os_strncmp((const char*)f->password, (const char*)config->password, sizeof(f->password)) != 0 ||
+           f->bssid_set != config->bssid_set ||
+           (config->bssid_set != 0 && os_memcmp(f->bssid, config->bssid, sizeof(f->bssid)) != 0)) {
+            *f = *config;
+            ctx->m_Flash.m_Writes++;
+            
+            return wifi_station_set_config(config);
+        }
+        
+        ctx->m_Flash.m_Avoided++;
+    }
     
-    return 0;
+    return wifi_station_set_config_current(config);
 }
 /**
  * 
- * @param ssid
+ * @param config
+ * @param persist
  * @return 
  */
-WIFI_AP* ICACHE_FLASH_ATTR wifi_find_ssid(const char* ssid)
+static bool ICACHE_FLASH_ATTR config_softap(struct softap_config* config, uint8_t persist)
 {
-    DTXT("wifi_find_ssid(): ssid = %s\n", ssid);
-    
-    WIFI_AP* p = wifi_list;
-    
-    while(p->ssid != NULL) {
-        DTXT("wifi_find_ssid(): p->ssid = %s\n", p->ssid);
+    if(persist != 0) {
+        config_load();
         
-        if(os_strcmp(p->ssid, ssid) == 0) {
-            return p;
+        struct softap_config* f = &ctx->m_Flash.m_ApConfig;
+        
+        if(os_strncmp((const char*)f->ssid, (const char*)config->ssid, sizeof(f->ssid)) != 0 ||
+           os_strncmp((const char*)f->password, (const char*)config->password, sizeof(f->password)) != 0 ||
+           f->ssid_len != config->ssid_len ||
+           f->channel != config->channel ||
+           f->authmode != config->authmode ||
+           f->ssid_hidden != config->ssid_hidden ||
+           f->max_connection != config->max_connection ||
+           f->beacon_interval != config->beacon_interval) {
+            *f = *config;
+            ctx->m_Flash.m_Writes++;
+            
+            return wifi_softap_set_config(config);
         }
         
-        p++;
+        ctx->m_Flash.m_Avoided++;
     }
     
-    return NULL;
+    return wifi_softap_set_config_current(config);
+}
+/**
+ * the SDK always persists this one
+ * 
+ * @param set
+ * @return 
+ */
+static bool ICACHE_FLASH_ATTR config_auto_connect(uint8_t set)
+{
+    config_load();
+    
+    if(ctx->m_Flash.m_AutoConnect == set) {
+        ctx->m_Flash.m_Avoided++;
+        return true;
+    }
+    
+    ctx->m_Flash.m_AutoConnect = set;
+    ctx->m_Flash.m_Writes++;
+    
+    return wifi_station_set_auto_connect(set);
 }
\ No newline at end of file
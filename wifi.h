@@ -31,10 +31,22 @@
 extern "C" {
 #endif
 
+#if defined(WIFI_HOST)
+#include "wifi_host.h"
+#else
 #include <user_interface.h>
+#endif
 
 typedef void (*WIFI_Callback)(uint8_t, void*);
 
+// an SDK callback gave WIFI_Run() something to do, see WIFI_SetWakeup()
+typedef void (*WIFI_Wakeup)(void*);
+
+#define WIFI_RUN_IDLE   -1                      // WIFI_Run(): nothing is due until an SDK callback
+
+// one node's state, see WIFI_CtxNew()
+typedef struct WIFI_Ctx WIFI_Ctx;
+
 typedef enum {
     ap_fixed,
     ap_fixed_auto,
@@ -48,6 +60,146 @@ typedef struct {
     const char*    psw;
 } WIFI_AP;
 
+// why the last connect attempt failed
+typedef enum {
+    retry_wrong_password,
+    retry_no_ap_found,                          // includes a scan that found none of our SSIDs
+    retry_connect_fail,                         // anything else (timeout, DHCP, lost link)
+    retry_causes
+} WIFI_RetryCause;
+
+#define WIFI_BACKOFF_MAX_MS     3600000         // highest WIFI_Backoff.max_ms
+
+// delay before attempt n (n = 0, 1, ...) is min(first_ms << n, max_ms), less up to jitter percent of it
+typedef struct {
+    uint32_t       first_ms;                    // 1 to max_ms; 0 would retry at once, in step with every other node
+    uint32_t       max_ms;                      // first_ms to WIFI_BACKOFF_MAX_MS
+    uint16_t       limit;                       // give up (wifi_disabled) after this many failures in a row; 0 = never
+} WIFI_Backoff;
+
+typedef struct {
+    WIFI_Backoff   cause[retry_causes];
+    uint8_t        jitter;                      // percent
+} WIFI_RetryPolicy;
+
+// WITH_AP_STATS: what ap_fixed_auto learnt about an SSID, all its BSSIDs together
+typedef struct {
+    uint16_t       attempts;
+    uint16_t       successes;
+    uint16_t       disconnects;                 // link lost after getting an IP
+    uint16_t       time_to_ip_ms;               // average, connect to IP
+} WIFI_APStats;
+
+#define WIFI_STATS_STATES       32              // WITH_STATE_STATS: room for the WIFI_state_t values in wifi.c, in enum order
+#define WIFI_STATS_MESH_STATES  8               // ... and the WIFI_Mesh_state_t values
+#define WIFI_STATS_BUCKETS      20              // 0: under 2 ms, n: 2^n to 2^(n+1) - 1 ms; the last one takes anything longer
+
+// WITH_STATE_STATS: why the link check found the station without an IP
+typedef enum {
+    check_idle,
+    check_wrong_password,
+    check_no_ap_found,
+    check_connect_fail,
+    check_connecting,                           // still associating, or waiting for DHCP
+    check_causes
+} WIFI_CheckCause;
+
+// WITH_STATE_STATS: where the time went since the last WIFI_ResetStats(); no padding, so it can be sent as it is
+typedef struct {
+    uint32_t       state_ms[WIFI_STATS_STATES]; // time in each state, to within a WIFI_Run() period
+    uint32_t       mesh_ms[WIFI_STATS_MESH_STATES];
+    uint16_t       state_entries[WIFI_STATS_STATES]; // state changes seen by WIFI_Run(); the counters stop at 65535
+    uint16_t       mesh_entries[WIFI_STATS_MESH_STATES];
+    uint16_t       check_fail[check_causes];
+    uint16_t       scan_ms[WIFI_STATS_BUCKETS]; // histograms: scan started -> results
+    uint16_t       ip_ms[WIFI_STATS_BUCKETS];   // wifi_station_connect() -> IP, per successful attempt
+    uint16_t       reconnect_ms[WIFI_STATS_BUCKETS]; // link lost -> IP again
+    uint8_t        state;                       // the current ones
+    uint8_t        mesh_state;
+} WIFI_Stats;
+
+#if !defined(WIFI_TRACE_SIZE)
+#define WIFI_TRACE_SIZE         64              // WITH_TRACE: records kept per node; a new one overwrites the oldest
+#endif
+#define WIFI_TRACE_HEADER       16              // WIFI_TraceDump(): "WT", version, state set, records, record size, lost, time
+#define WIFI_TRACE_RECORD       8               // ... then per record, little endian: time, WIFI_TraceEvent, a, b
+#define WIFI_TRACE_VERSION      1
+#define WIFI_TRACE_IP_CACHE     0x01            // state set: the optional WIFI_state_t values the node was built with
+#define WIFI_TRACE_SMARTLINK    0x02
+#define WIFI_TRACE_SMARTWEB     0x04
+
+// WITH_TRACE: what a trace record is about; times are in ms since the node was first used
+typedef enum {
+    trace_state = 1,                            // a: old WIFI_state_t (enum order in wifi.c), b: new one
+    trace_mesh_state,                           // a: old WIFI_Mesh_state_t, b: new one
+    trace_scan,                                 // a: BSSs seen, b: ours << 8 | best RSSI of ours as uint8_t
+    trace_mesh_scan,                            // a: BSSs seen, b: parents kept << 8 | RSSI of the first choice as uint8_t
+    trace_connect,                              // wifi_station_connect(); a: channel (0 = all), b: failures in a row before it
+    trace_got_ip,                               // a: channel, b: RSSI as int16_t
+    trace_check,                                // link check without an IP; a: station status, b: last disconnect reason
+    trace_disconnect,                           // SDK event; a: reason, b: WIFI_state_t at the time
+    trace_events
+} WIFI_TraceEvent;
+
+// radio power against latency while connected; scanning and connecting always run with the radio on
+typedef enum {
+    power_low_latency,                          // no sleep; without SDK events the link is polled every 5 s
+    power_balanced,                             // modem sleep, wake for every DTIM beacon (the SDK default)
+    power_low,                                  // light sleep, wake for every 3rd DTIM beacon; the link is polled every 120 s
+    power_policies
+} WIFI_PowerPolicy;
+
+#if !defined(WIFI_MESH_PORT)
+#define WIFI_MESH_PORT  4210                    // WITH_MESH_UDP: every node, both interfaces
+#endif
+#if !defined(WIFI_MESH_FRAME_SIZE)
+#define WIFI_MESH_FRAME_SIZE    512             // WITH_MESH_UDP: the largest datagram a node builds
+#endif
+#define WIFI_MESH_SEND_MAX      (WIFI_MESH_FRAME_SIZE - 12)     // WIFI_MeshSend(): longest message; frame and record header
+#define WIFI_MESH_SEND_TO_MAX   (WIFI_MESH_FRAME_SIZE - 18)     // WIFI_MeshSendTo(): ... and the destination MAC
+
+// WITH_MESH_UDP: a message from the node with station MAC 'origin'
+typedef void (*WIFI_MeshReceive)(const uint8_t* origin, const void* data, uint16_t length, void* ptr);
+
+// ap_fixed_auto: look for a better AP from the list while connected
+typedef struct {
+    sint8          threshold;                   // dBm; scan in the background below this (smoothed); 0 = no roaming
+    uint8_t        hysteresis;                  // dB a candidate must be stronger than the current AP
+    uint16_t       sample_s;                    // RSSI sampling interval
+    uint16_t       dwell_s;                     // time on an AP before the first background scan, and between scans
+} WIFI_RoamPolicy;
+
+#if !defined(WIFI_EVENT_SUBSCRIBERS)
+#define WIFI_EVENT_SUBSCRIBERS  8               // WIFI_Subscribe() slots per node; at most 16
+#endif
+#define WIFI_EVENT_MASK(type)   (1 << (type))   // WIFI_Subscribe()
+
+// what a WIFI_Event is about, and which of its fields are set
+typedef enum {
+    event_connected,                            // the station associated; mac, channel: the AP
+    event_got_ip,                               // wifi_ready, or joined the mesh; ip, channel
+    event_lost_ip,                              // no longer; reason: the last disconnect reason
+    event_scan_done,                            // any scan, ours or the SDK's; count: BSSs seen, reason: STATUS
+    event_roamed,                               // an IP on the AP a background scan found; mac, channel, rssi
+    event_mesh_parent,                          // joined the mesh; mac, channel: the parent, hops: ours
+    event_mesh_child,                           // a station joined our softAP; mac: the station, count: stations now
+    event_types
+} WIFI_EventType;
+
+typedef struct {
+    uint8_t        type;                        // WIFI_EventType
+    uint8_t        channel;
+    sint8          rssi;
+    uint8_t        hops;
+    uint8_t        mac[6];
+    uint16_t       count;
+    uint16_t       reason;
+    uint32_t       ip;
+} WIFI_Event;
+
+// called from WIFI_Run() (IP, roam and mesh events) or an SDK callback (the others); 'event' lasts for the call
+typedef void (*WIFI_EventHandler)(const WIFI_Event* event, void* ptr);
+
 /**
  * 
  * @param p1
@@ -71,6 +223,14 @@ int WIFI_InitializeEx(WIFI_AP list[]);
  * @return 
  */
 int WIFI_MeshInitialize(WIFI_Mode mode, const void* ssid, const void* pass, const char* prefix, const char* group);
+/**
+ * wake from deep sleep: restore what the last WIFI_*Initialize() set up from RTC memory and go straight to the
+ * cached AP, without touching the SDK's flash config
+ * 
+ * @param list      the WIFI_InitializeEx() list for ap_fixed_auto, else NULL
+ * @return -1 if there is nothing to resume (power-on, list given or missing); use WIFI_*Initialize() then
+ */
+int WIFI_Resume(WIFI_AP list[]);
 /**
  * 
  * @param on_connect
@@ -80,15 +240,165 @@ int WIFI_MeshInitialize(WIFI_Mode mode, const void* ssid, const void* pass, cons
  */
 int WIFI_SetCallback(WIFI_Callback on_connect, WIFI_Callback on_disconnect, void* ptr);
 /**
+ * 'wakeup' runs inside the SDK callback (scan done, Wi-Fi event); have it schedule WIFI_Run() soon, e.g. with a
+ * 0 ms os_timer, rather than call it
  * 
+ * @param wakeup    NULL = none; WIFI_Run() must then be called at least every few hundred ms
+ * @param ptr
  * @return 
  */
-int WIFI_IsConnected(void);
+int WIFI_SetWakeup(WIFI_Wakeup wakeup, void* ptr);
 /**
+ * call 'handler' for the events in 'mask'; subscribers are called in slot order, after the WIFI_SetCallback() pair,
+ * and stay subscribed across WIFI_*Initialize()
  * 
+ * @param mask      WIFI_EVENT_MASK() of each WIFI_EventType, or'ed
+ * @param handler
+ * @param ptr
+ * @return the slot, for WIFI_Unsubscribe(), or -1 when all WIFI_EVENT_SUBSCRIBERS are taken
+ */
+int WIFI_Subscribe(uint16_t mask, WIFI_EventHandler handler, void* ptr);
+/**
+ * may be called from a handler, for itself or another slot
+ * 
+ * @param slot
  * @return 
  */
+int WIFI_Unsubscribe(int slot);
+/**
+ * 1 (the default): the SDK's Wi-Fi events drive the state machine, and the link is polled every 60 s in case one is missed;
+ * 0: the link is polled every 15 s; kept across WIFI_*Initialize(), so it may be called before or after them
+ * 
+ * @param enable
+ * @return 
+ */
+int WIFI_SetEventDriven(int enable);
+/**
+ * applies to the station in every WIFI_Mode and to the mesh scan
+ * 
+ * @param policy    NULL = defaults
+ * @return -1 if jitter is over 100 or a WIFI_Backoff is out of range; the policy in use is kept then
+ */
+int WIFI_SetRetryPolicy(const WIFI_RetryPolicy* policy);
+/**
+ * 
+ * @param policy
+ * @return 
+ */
+int WIFI_GetRetryPolicy(WIFI_RetryPolicy* policy);
+/**
+ * 
+ * @param policy    NULL = defaults
+ * @return 
+ */
+int WIFI_SetRoamPolicy(const WIFI_RoamPolicy* policy);
+/**
+ * station only; the SDK does not sleep while the softAP is up (mesh modes)
+ * 
+ * @param policy
+ * @return 
+ */
+int WIFI_SetPowerPolicy(WIFI_PowerPolicy policy);
+/**
+ * 
+ * @return 
+ */
+int WIFI_IsConnected(void);
+/**
+ * do what is due; between calls nothing has to be polled, so the application can sleep
+ * 
+ * @return ms until WIFI_Run() has work again (0 = at once), or WIFI_RUN_IDLE when only the wakeup can change that
+ */
 int WIFI_Run(void);
+/**
+ * flash writes done / skipped because the persisted Wi-Fi configuration was already up to date
+ * 
+ * @param writes
+ * @param avoided
+ * @return 
+ */
+int WIFI_GetFlashWrites(uint32_t* writes, uint32_t* avoided);
+#if defined(WITH_AP_STATS)
+/**
+ * 
+ * @param ssid
+ * @param stats
+ * @return -1 if nothing is known about 'ssid'
+ */
+int WIFI_GetAPStats(const char* ssid, WIFI_APStats* stats);
+#endif
+#if defined(WITH_STATE_STATS)
+/**
+ * 
+ * @param stats
+ * @return 
+ */
+int WIFI_GetStats(WIFI_Stats* stats);
+/**
+ * 
+ * @return 
+ */
+int WIFI_ResetStats(void);
+#endif
+#if defined(WITH_TRACE)
+/**
+ * copy the event trace out, oldest record first; WIFI_HostTraceDecode() turns a saved dump back into a timeline
+ * 
+ * @param buffer
+ * @param size      WIFI_TRACE_HEADER + WIFI_TRACE_SIZE * WIFI_TRACE_RECORD holds all of it; less leaves out the oldest records
+ * @return bytes written, -1 if 'size' is less than WIFI_TRACE_HEADER
+ */
+int WIFI_TraceDump(uint8_t* buffer, uint16_t size);
+#endif
+/**
+ * next hop towards a node below us in the mesh: the station on our softAP it is reached through
+ * 
+ * @param mac
+ * @param ip        the station's address on our softAP
+ * @return -1 if 'mac' is not known below us, or its station has no lease yet
+ */
+int WIFI_MeshRoute(const uint8_t* mac, uint32_t* ip);
+#if defined(WITH_MESH_UDP)
+/**
+ * called for the messages this node gets: on the root those sent by the other nodes, elsewhere those sent by the root
+ * 
+ * @param receive
+ * @param ptr
+ * @return 
+ */
+int WIFI_MeshSetReceive(WIFI_MeshReceive receive, void* ptr);
+/**
+ * queue a message to the root, or from the root to every node; messages are batched into one datagram for up to
+ * 'delay_ms' (default 20)
+ * 
+ * @param data
+ * @param length    at most WIFI_MESH_SEND_MAX
+ * @return -1 when not connected, too long or all batch buffers are still being sent
+ */
+int WIFI_MeshSend(const void* data, uint16_t length);
+/**
+ * send a message down to one node; it goes out at once, along the routing tables of the nodes in between
+ * 
+ * @param mac       a node below us, see WIFI_MeshRoute()
+ * @param data
+ * @param length    at most WIFI_MESH_SEND_TO_MAX
+ * @return -1 when there is no route, it is too long or all batch buffers are still being sent
+ */
+int WIFI_MeshSendTo(const uint8_t* mac, const void* data, uint16_t length);
+/**
+ * 
+ * @param delay_ms  0 = one datagram per message
+ * @return 
+ */
+int WIFI_MeshSetBatching(uint16_t delay_ms);
+#endif
+/**
+ * write out log records deferred by WITH_LOG_RING; WIFI_Run() does a few per call
+ * 
+ * @param max       0 = all
+ * @return number of records written
+ */
+int WIFI_LogFlush(int max);
 /**
  * 
  * @return 
@@ -105,6 +415,147 @@ int WIFI_connect(void);
  */
 int WIFI_disconnect(void);
 
+/******************************************************************************************************************
+ * context handles; the functions above work on WIFI_CtxDefault(). The SDK calls back into the node last passed to
+ * one of these (on the host, select its SDK with WIFI_HostSelect() too).
+ */
+
+/**
+ * 
+ * @return NULL when out of memory
+ */
+WIFI_Ctx* WIFI_CtxNew(void);
+/**
+ * 
+ * @param ctx   not the default one
+ */
+void WIFI_CtxFree(WIFI_Ctx* ctx);
+/**
+ * 
+ * @return 
+ */
+WIFI_Ctx* WIFI_CtxDefault(void);
+/**
+ * WIFI_Initialize() on 'ctx'
+ */
+int WIFI_CtxInitialize(WIFI_Ctx* ctx, const void* p1, const void* p2);
+/**
+ * WIFI_InitializeEx() on 'ctx'
+ */
+int WIFI_CtxInitializeEx(WIFI_Ctx* ctx, WIFI_AP list[]);
+/**
+ * WIFI_MeshInitialize() on 'ctx'
+ */
+int WIFI_CtxMeshInitialize(WIFI_Ctx* ctx, WIFI_Mode mode, const void* ssid, const void* pass, const char* prefix, const char* group);
+/**
+ * WIFI_Resume() on 'ctx'
+ */
+int WIFI_CtxResume(WIFI_Ctx* ctx, WIFI_AP list[]);
+/**
+ * WIFI_SetCallback() on 'ctx'
+ */
+int WIFI_CtxSetCallback(WIFI_Ctx* ctx, WIFI_Callback on_connect, WIFI_Callback on_disconnect, void* ptr);
+/**
+ * WIFI_SetWakeup() on 'ctx'
+ */
+int WIFI_CtxSetWakeup(WIFI_Ctx* ctx, WIFI_Wakeup wakeup, void* ptr);
+/**
+ * WIFI_Subscribe() on 'ctx'
+ */
+int WIFI_CtxSubscribe(WIFI_Ctx* ctx, uint16_t mask, WIFI_EventHandler handler, void* ptr);
+/**
+ * WIFI_Unsubscribe() on 'ctx'
+ */
+int WIFI_CtxUnsubscribe(WIFI_Ctx* ctx, int slot);
+/**
+ * WIFI_SetEventDriven() on 'ctx'
+ */
+int WIFI_CtxSetEventDriven(WIFI_Ctx* ctx, int enable);
+/**
+ * WIFI_SetRetryPolicy() on 'ctx'
+ */
+int WIFI_CtxSetRetryPolicy(WIFI_Ctx* ctx, const WIFI_RetryPolicy* policy);
+/**
+ * WIFI_SetRoamPolicy() on 'ctx'
+ */
+int WIFI_CtxSetRoamPolicy(WIFI_Ctx* ctx, const WIFI_RoamPolicy* policy);
+/**
+ * WIFI_SetPowerPolicy() on 'ctx'
+ */
+int WIFI_CtxSetPowerPolicy(WIFI_Ctx* ctx, WIFI_PowerPolicy policy);
+/**
+ * WIFI_GetRetryPolicy() on 'ctx'
+ */
+int WIFI_CtxGetRetryPolicy(WIFI_Ctx* ctx, WIFI_RetryPolicy* policy);
+/**
+ * WIFI_IsConnected() on 'ctx'
+ */
+int WIFI_CtxIsConnected(WIFI_Ctx* ctx);
+/**
+ * WIFI_connect() on 'ctx'
+ */
+int WIFI_CtxConnect(WIFI_Ctx* ctx);
+/**
+ * WIFI_disconnect() on 'ctx'
+ */
+int WIFI_CtxDisconnect(WIFI_Ctx* ctx);
+/**
+ * WIFI_Run() on 'ctx'
+ */
+int WIFI_CtxRun(WIFI_Ctx* ctx);
+/**
+ * WIFI_GetFlashWrites() on 'ctx'
+ */
+int WIFI_CtxGetFlashWrites(WIFI_Ctx* ctx, uint32_t* writes, uint32_t* avoided);
+#if defined(WITH_AP_STATS)
+/**
+ * WIFI_GetAPStats() on 'ctx'
+ */
+int WIFI_CtxGetAPStats(WIFI_Ctx* ctx, const char* ssid, WIFI_APStats* stats);
+#endif
+#if defined(WITH_STATE_STATS)
+/**
+ * WIFI_GetStats() on 'ctx'
+ */
+int WIFI_CtxGetStats(WIFI_Ctx* ctx, WIFI_Stats* stats);
+/**
+ * WIFI_ResetStats() on 'ctx'
+ */
+int WIFI_CtxResetStats(WIFI_Ctx* ctx);
+#endif
+#if defined(WITH_TRACE)
+/**
+ * WIFI_TraceDump() on 'ctx'
+ */
+int WIFI_CtxTraceDump(WIFI_Ctx* ctx, uint8_t* buffer, uint16_t size);
+#endif
+/**
+ * WIFI_MeshRoute() on 'ctx'
+ */
+int WIFI_CtxMeshRoute(WIFI_Ctx* ctx, const uint8_t* mac, uint32_t* ip);
+#if defined(WITH_MESH_UDP)
+/**
+ * WIFI_MeshSetReceive() on 'ctx'
+ */
+int WIFI_CtxMeshSetReceive(WIFI_Ctx* ctx, WIFI_MeshReceive receive, void* ptr);
+/**
+ * WIFI_MeshSetBatching() on 'ctx'
+ */
+int WIFI_CtxMeshSetBatching(WIFI_Ctx* ctx, uint16_t delay_ms);
+/**
+ * WIFI_MeshSend() on 'ctx'
+ */
+int WIFI_CtxMeshSend(WIFI_Ctx* ctx, const void* data, uint16_t length);
+/**
+ * WIFI_MeshSendTo() on 'ctx'
+ */
+int WIFI_CtxMeshSendTo(WIFI_Ctx* ctx, const uint8_t* mac, const void* data, uint16_t length);
+#endif
+/**
+ * WIFI_GetMAC() on 'ctx'
+ */
+const char* WIFI_CtxGetMAC(WIFI_Ctx* ctx);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -0,0 +1,2098 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+#if defined(WIFI_HOST)
+
+#include "wifi.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+#define HOST_MAX_AP             64
+#define HOST_MAX_STATION        8
+#define HOST_MAX_EVENT          16
+#define HOST_SCAN_CHANNELS      14
+#define HOST_RTC_BLOCKS         192
+#define HOST_RTC_USER_BLOCK     64
+#define HOST_PARAM_AREAS        4
+#define HOST_PARAM_SIZE         4096
+#define HOST_MAX_FRAME          16                                              // datagrams on the air or queued for it
+#define HOST_MAX_PCB            4
+#define HOST_HEADROOM           42                                              // Ethernet + IP + UDP headers
+#define HOST_PBUF_RX            0x80                                            // pbuf flag: came from WIFI_HostUdpInject()
+
+/******************************************************************************************************************
+ * local var's
+ *
+ */
+
+typedef struct HostAP
+{
+    char                    m_Ssid[33];
+    char                    m_Psw[65];
+    uint8                   m_Bssid[6];
+    uint8                   m_Channel;
+    sint8                   m_Rssi;
+    uint8                   m_Full;                                             // turns away new stations
+    uint32                  m_From;
+    uint32                  m_Until;
+} HostAP;
+
+typedef enum {
+    sta_idle = 0,
+    sta_assoc,
+    sta_dhcp,
+    sta_up,
+    sta_retry
+} HostStaPhase;
+
+typedef struct HostScan
+{
+    scan_done_cb_t          m_Callback;
+    uint32                  m_Due;
+    uint8                   m_Ssid[33];
+    uint8                   m_Bssid[6];
+    uint8                   m_HasSsid;
+    uint8                   m_HasBssid;
+    uint8                   m_Channel;
+} HostScan;
+
+typedef struct HostFrame
+{
+    struct pbuf*            m_Pbuf;
+    const uint8*            m_Data;                     // UDP payload
+    uint16                  m_Length;
+    uint8                   m_If;
+    ip_addr_t               m_Dst;
+    uint64_t                m_Due;                      // us; end of the transmission
+} HostFrame;
+
+typedef struct Host
+{
+    uint32                  m_Now;
+    uint32                  m_Epoch;                    // m_Now at the last WIFI_HostReset()
+    int                     m_Verbose;
+    WIFI_HostTiming         m_Timing;
+    
+    HostAP                  m_AP[HOST_MAX_AP];
+    int                     m_APCount;
+    
+    uint8                   m_Mac[6];
+    uint32                  m_Random;                   // xorshift32 state
+    uint8                   m_OpMode;
+    uint8                   m_Channel;
+    struct station_config   m_StationConfig;
+    struct softap_config    m_SoftAPConfig;
+    uint8                   m_Reconnect;
+    
+    HostStaPhase            m_Phase;
+    uint32                  m_PhaseDue;
+    uint8                   m_Status;
+    uint8                   m_Wanted;
+    int                     m_Connected;                // index into m_AP
+    struct ip_info          m_Info;
+    uint8                   m_DhcpcStopped;
+    struct ip_info          m_Static;                   // wifi_set_ip_info() with the DHCP client stopped
+    
+    struct netif            m_Netif[2];
+    ip_addr_t               m_ArpIp;                    // last etharp_request()
+    uint32                  m_ArpDue;                   // when the reply arrives; 0 = never
+    
+    HostScan                m_Scan;
+    
+    uint8                   m_SleepType;
+    uint8                   m_SleepLevel;
+    uint8                   m_ListenInterval;
+    uint8                   m_AssocListen;              // listen interval the AP was given at association; 0 = every DTIM
+    uint32                  m_RadioRem;                 // m_RadioOnMs remainder, in ms x m_WakeMs
+    
+    struct station_info     m_Station[HOST_MAX_STATION];
+    int                     m_StationCount;
+    
+    wifi_event_handler_cb_t m_EventCallback;
+    System_Event_t          m_Event[HOST_MAX_EVENT];
+    int                     m_EventCount;
+    uint8                   m_Wake;                     // WIFI_HostWake() since WIFI_HostRunTickless() last called WIFI_Run()
+    
+    struct udp_pcb          m_Pcb[HOST_MAX_PCB];
+    uint8                   m_PcbUsed[HOST_MAX_PCB];
+    HostFrame               m_Frame[HOST_MAX_FRAME];    // sent, in order of m_Due
+    int                     m_FrameCount;
+    uint64_t                m_NowUs;                    // m_Now x 1000, or when the frame being handled ended
+    uint64_t                m_AirBusy;                  // us; the channel is taken until then
+    WIFI_HostUdpSink        m_Sink;
+    void*                   m_SinkPtr;
+    
+    WIFI_HostCounters       m_Counters;
+} Host;
+
+typedef struct HostFlash
+{
+    uint8                   m_OpMode;
+    uint8                   m_AutoConnect;
+    struct station_config   m_StationConfig;
+    struct softap_config    m_SoftAPConfig;
+} HostFlash;
+
+typedef struct HostParam
+{
+    uint16                  m_Sector;                   // 0 = unused
+    uint8                   m_Data[HOST_PARAM_SIZE];
+} HostParam;
+
+struct HostNode
+{
+    Host                    m_Host;
+    uint32                  m_Rtc[HOST_RTC_BLOCKS];     // survives WIFI_HostReset()
+    HostFlash               m_Flash;                    // survives WIFI_HostPowerCycle() too
+    HostParam               m_Param[HOST_PARAM_AREAS];  // system_param_*(); flash, like m_Flash
+};
+
+static WIFI_HostNode  host_first;
+static WIFI_HostNode* host_node = &host_first;                                  // the chip the SDK calls go to, see WIFI_HostSelect()
+
+#define host                    (host_node->m_Host)
+#define host_rtc                (host_node->m_Rtc)
+#define host_flash              (host_node->m_Flash)
+#define host_param              (host_node->m_Param)
+
+static const WIFI_HostTiming default_timing = {
+    120,                                                                        // m_ScanChannelMs
+    1680,                                                                       // m_SearchMs
+    350,                                                                        // m_AssocMs
+    600,                                                                        // m_DhcpMs
+    1000,                                                                       // m_RetryMs
+    5,                                                                          // m_ArpMs
+    102,                                                                        // m_DtimMs; 100 TU beacons, DTIM 1
+    3,                                                                          // m_WakeMs
+    300,                                                                        // m_FrameUs
+    1000                                                                        // m_ByteNs; 8 Mbit/s
+};
+
+const ip_addr_t ip_addr_any       = { 0x00000000 };
+const ip_addr_t ip_addr_broadcast = { 0xFFFFFFFF };
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param evt
+ */
+static void host_post_event(const System_Event_t* evt);
+/**
+ * 
+ * @param reason
+ */
+static void host_sta_lost(uint8 reason);
+/**
+ * 
+ * @return 
+ */
+static void host_sta_fire(void);
+/**
+ * 
+ */
+static void host_scan_fire(void);
+/**
+ * 
+ * @param ap
+ * @return 
+ */
+static int host_ap_visible(int ap);
+/**
+ * 
+ * @return 
+ */
+static int host_find_ap(void);
+/**
+ * 
+ * @return 
+ */
+static uint32 host_search_ms(void);
+/**
+ * account for the radio from now until 'until'
+ * 
+ * @param until
+ */
+static void host_radio(uint32 until);
+/**
+ * 
+ * @param ms
+ * @param wake      stop early at WIFI_HostWake()
+ */
+static void host_advance(uint32 ms, int wake);
+/**
+ * 
+ * @param length
+ * @return 
+ */
+static struct pbuf* host_pbuf_new(uint16 length, uint16 headroom);
+/**
+ * queue a datagram for the air; the channel is shared, so it starts when the previous one has ended
+ * 
+ * @param frame
+ * @return 
+ */
+static int host_air(HostFrame* frame);
+/**
+ * 
+ */
+static void host_frame_fire(void);
+
+/******************************************************************************************************************
+ * simulation control
+ *
+ */
+
+/**
+ * 
+ */
+void WIFI_HostReset(void)
+{
+    static const uint8 mac[6] = { 0x5c, 0xcf, 0x7f, 0x00, 0x00, 0x01 };
+    
+    uint32 now = host.m_Now;                                                    // the clock keeps running, like a reboot
+    int    i;
+    
+    for(i = 0; i < host.m_FrameCount; i++) {
+        pbuf_free(host.m_Frame[i].m_Pbuf);                                      // the library's pool buffers keep their own reference
+    }
+    
+    memset(&host, 0, sizeof(host));
+    
+    host.m_Now       = now;
+    host.m_NowUs     = (uint64_t)now * 1000u;
+    host.m_Epoch     = now;
+    host.m_Verbose   = 1;
+    host.m_Timing    = default_timing;
+    host.m_Connected = -1;
+    host.m_Status    = STATION_IDLE;
+    
+    host.m_SleepType      = MODEM_SLEEP_T;                                      // SDK defaults
+    host.m_SleepLevel     = MIN_SLEEP_T;
+    host.m_ListenInterval = 1;
+    
+    host.m_OpMode        = host_flash.m_OpMode;                                 // the SDK boots from what is in flash
+    host.m_StationConfig = host_flash.m_StationConfig;
+    host.m_SoftAPConfig  = host_flash.m_SoftAPConfig;
+    
+    WIFI_HostSetMAC(mac);
+}
+/**
+ * 
+ */
+void WIFI_HostPowerCycle(void)
+{
+    memset(host_rtc, 0, sizeof(host_rtc));
+    
+    WIFI_HostReset();
+}
+/**
+ * 
+ * @return 
+ */
+WIFI_HostNode* WIFI_HostNodeNew(void)
+{
+    WIFI_HostNode* node = calloc(1, sizeof(WIFI_HostNode));
+    WIFI_HostNode* prev;
+    
+    if(node == NULL) {
+        return NULL;
+    }
+    
+    prev = WIFI_HostSelect(node);
+    
+    host.m_Now = prev->m_Host.m_Now;                                            // one clock for all of them
+    WIFI_HostReset();
+    
+    WIFI_HostSelect(prev);
+    
+    return node;
+}
+/**
+ * 
+ * @param node
+ */
+void WIFI_HostNodeFree(WIFI_HostNode* node)
+{
+    WIFI_HostNode* prev;
+    int            i;
+    
+    if(node == NULL || node == &host_first) {
+        return;
+    }
+    
+    prev = WIFI_HostSelect(node);
+    
+    for(i = 0; i < host.m_FrameCount; i++) {
+        pbuf_free(host.m_Frame[i].m_Pbuf);
+    }
+    
+    WIFI_HostSelect((prev != node) ? prev : NULL);
+    
+    free(node);
+}
+/**
+ * 
+ * @param node
+ * @return 
+ */
+WIFI_HostNode* WIFI_HostSelect(WIFI_HostNode* node)
+{
+    WIFI_HostNode* prev = host_node;
+    
+    host_node = (node != NULL) ? node : &host_first;
+    
+    return prev;
+}
+/**
+ * 
+ * @param timing
+ */
+void WIFI_HostSetTiming(const WIFI_HostTiming* timing)
+{
+    host.m_Timing = *timing;
+}
+/**
+ * 
+ * @param timing
+ */
+void WIFI_HostGetTiming(WIFI_HostTiming* timing)
+{
+    *timing = host.m_Timing;
+}
+/**
+ * 
+ * @param verbose
+ */
+void WIFI_HostSetVerbose(int verbose)
+{
+    host.m_Verbose = verbose;
+}
+/**
+ * 
+ * @param mac
+ */
+void WIFI_HostSetMAC(const uint8* mac)
+{
+    memcpy(host.m_Mac, mac, sizeof(host.m_Mac));
+    
+    host.m_Random = 0x9E3779B9u ^ ((uint32)mac[2] << 24 | (uint32)mac[3] << 16 | (uint32)mac[4] << 8 | mac[5]);
+}
+/**
+ * 
+ * @param ssid
+ * @param psw
+ * @param bssid
+ * @param channel
+ * @param rssi
+ * @return 
+ */
+int WIFI_HostAddAP(const char* ssid, const char* psw, const uint8* bssid, uint8 channel, sint8 rssi)
+{
+    if(host.m_APCount >= HOST_MAX_AP) {
+        return -1;
+    }
+    
+    HostAP* ap = &host.m_AP[host.m_APCount];
+    
+    memset(ap, 0, sizeof(*ap));
+    strncpy(ap->m_Ssid, ssid, sizeof(ap->m_Ssid) - 1);
+    
+    if(psw != NULL) {
+        strncpy(ap->m_Psw, psw, sizeof(ap->m_Psw) - 1);
+    }
+    
+    memcpy(ap->m_Bssid, bssid, sizeof(ap->m_Bssid));
+    
+    ap->m_Channel = channel;
+    ap->m_Rssi    = rssi;
+    
+    return host.m_APCount++;
+}
+/**
+ * 
+ * @param ap
+ * @param from_ms
+ * @param until_ms
+ * @return 
+ */
+int WIFI_HostScheduleAP(int ap, uint32 from_ms, uint32 until_ms)
+{
+    if(ap < 0 || ap >= host.m_APCount) {
+        return -1;
+    }
+    
+    host.m_AP[ap].m_From  = from_ms;
+    host.m_AP[ap].m_Until = until_ms;
+    
+    return 0;
+}
+/**
+ * 
+ * @param ap
+ * @param rssi
+ * @return 
+ */
+int WIFI_HostSetAPRssi(int ap, sint8 rssi)
+{
+    if(ap < 0 || ap >= host.m_APCount) {
+        return -1;
+    }
+    
+    host.m_AP[ap].m_Rssi = rssi;
+    
+    return 0;
+}
+/**
+ * 
+ * @param ap
+ * @param full
+ * @return 
+ */
+int WIFI_HostSetAPFull(int ap, int full)
+{
+    if(ap < 0 || ap >= host.m_APCount) {
+        return -1;
+    }
+    
+    host.m_AP[ap].m_Full = (full != 0) ? 1 : 0;
+    
+    return 0;
+}
+/**
+ * 
+ * @param ap
+ * @param ssid
+ * @return 
+ */
+int WIFI_HostSetAPSsid(int ap, const char* ssid)
+{
+    if(ap < 0 || ap >= host.m_APCount) {
+        return -1;
+    }
+    
+    memset(host.m_AP[ap].m_Ssid, 0, sizeof(host.m_AP[ap].m_Ssid));
+    strncpy(host.m_AP[ap].m_Ssid, ssid, sizeof(host.m_AP[ap].m_Ssid) - 1);
+    
+    return 0;
+}
+/**
+ * 
+ * @return 
+ */
+int WIFI_HostConnectedAP(void)
+{
+    return (host.m_Phase == sta_dhcp || host.m_Phase == sta_up) ? host.m_Connected : -1;
+}
+/**
+ * 
+ * @param mac
+ * @param ip
+ * @return 
+ */
+int WIFI_HostAddStation(const uint8* mac, uint32 ip)
+{
+    if(host.m_StationCount >= HOST_MAX_STATION || (host.m_OpMode & SOFTAP_MODE) == 0) {
+        return -1;
+    }
+    
+    struct station_info* sta = &host.m_Station[host.m_StationCount];
+    
+    memcpy(sta->bssid, mac, sizeof(sta->bssid));
+    sta->ip.addr = ip;
+    
+    System_Event_t evt;
+    
+    memset(&evt, 0, sizeof(evt));
+    evt.event = EVENT_SOFTAPMODE_STACONNECTED;
+    memcpy(evt.event_info.sta_connected.mac, mac, 6);
+    evt.event_info.sta_connected.aid = (uint8)(host.m_StationCount + 1);
+    
+    host_post_event(&evt);
+    
+    memset(&evt, 0, sizeof(evt));
+    evt.event = EVENT_SOFTAPMODE_DISTRIBUTE_STA_IP;                             // the DHCP server right after
+    memcpy(evt.event_info.distribute_sta_ip.mac, mac, 6);
+    evt.event_info.distribute_sta_ip.ip.addr = ip;
+    evt.event_info.distribute_sta_ip.aid     = (uint8)(host.m_StationCount + 1);
+    
+    host_post_event(&evt);
+    
+    return host.m_StationCount++;
+}
+/**
+ * 
+ * @param mac
+ * @return 
+ */
+int WIFI_HostRemoveStation(const uint8* mac)
+{
+    int i;
+    
+    for(i = 0; i < host.m_StationCount; i++) {
+        if(memcmp(host.m_Station[i].bssid, mac, 6) == 0) {
+            System_Event_t evt;
+            
+            memset(&evt, 0, sizeof(evt));
+            evt.event = EVENT_SOFTAPMODE_STADISCONNECTED;
+            memcpy(evt.event_info.sta_disconnected.mac, mac, 6);
+            evt.event_info.sta_disconnected.aid = (uint8)(i + 1);
+            
+            host.m_Station[i] = host.m_Station[--host.m_StationCount];
+            
+            host_post_event(&evt);
+            
+            return 0;
+        }
+    }
+    
+    return -1;
+}
+/**
+ * 
+ * @param if_index
+ * @param src
+ * @param port
+ * @param data
+ * @param length
+ * @return 
+ */
+int WIFI_HostUdpInject(uint8 if_index, const ip_addr_t* src, uint16 port, const void* data, uint16 length)
+{
+    struct pbuf* p    = host_pbuf_new(length, HOST_HEADROOM);
+    ip_addr_t    addr = *src;
+    int          i;
+    
+    p->flags |= HOST_PBUF_RX;
+    memcpy(p->payload, data, length);
+    
+    for(i = 0; i < HOST_MAX_PCB; i++) {
+        struct udp_pcb* pcb = &host.m_Pcb[i];
+        
+        if(host.m_PcbUsed[i] != 0 && pcb->local_port == port && pcb->recv != NULL) {
+            host.m_Counters.m_UdpRx++;
+            
+            pcb->recv(pcb->recv_arg, pcb, p, &addr, port);                      // the callback owns the pbuf now
+            return 0;
+        }
+    }
+    
+    pbuf_free(p);
+    
+    return -1;
+}
+/**
+ * 
+ * @param sink
+ * @param ptr
+ */
+void WIFI_HostSetUdpSink(WIFI_HostUdpSink sink, void* ptr)
+{
+    host.m_Sink    = sink;
+    host.m_SinkPtr = ptr;
+}
+/**
+ * 
+ * @return 
+ */
+uint64_t WIFI_HostNowUs(void)
+{
+    return host.m_NowUs;
+}
+/**
+ * 
+ * @return 
+ */
+uint32 WIFI_HostNow(void)
+{
+    return host.m_Now;
+}
+/**
+ * 
+ * @return 
+ */
+uint32 WIFI_HostElapsed(void)
+{
+    return host.m_Now - host.m_Epoch;
+}
+/**
+ * 
+ * @param counters
+ */
+void WIFI_HostGetCounters(WIFI_HostCounters* counters)
+{
+    *counters = host.m_Counters;
+}
+/**
+ * 
+ * @param ms
+ */
+void WIFI_HostAdvance(uint32 ms)
+{
+    host_advance(ms, 0);
+}
+/**
+ * 
+ * @param duration_ms
+ * @param step_ms
+ */
+void WIFI_HostRun(uint32 duration_ms, uint32 step_ms)
+{
+    uint32 end = host.m_Now + duration_ms;
+    
+    while(host.m_Now < end) {
+        WIFI_Run();
+        WIFI_HostAdvance(step_ms);
+    }
+}
+/**
+ * 
+ * @param ptr
+ */
+void WIFI_HostWake(void* ptr)
+{
+    host.m_Wake = 1;
+}
+/**
+ * 
+ * @param duration_ms
+ * @return 
+ */
+uint32 WIFI_HostRunTickless(uint32 duration_ms)
+{
+    uint32 end   = host.m_Now + duration_ms;
+    uint32 calls = 0;
+    
+    WIFI_SetWakeup(WIFI_HostWake, NULL);
+    
+    while(host.m_Now < end) {
+        host.m_Wake = 0;
+        
+        int next = WIFI_Run();
+        
+        calls++;
+        
+        if(next == WIFI_RUN_IDLE || (uint32)next > end - host.m_Now) {
+            next = (int)(end - host.m_Now);
+        }
+        
+        host_advance((uint32)next, 1);
+    }
+    
+    return calls;
+}
+
+/******************************************************************************************************************
+ * osapi.h / timer.h
+ *
+ */
+
+/**
+ * 
+ * @param fmt
+ * @return 
+ */
+int WIFI_HostPrintf(const char* fmt, ...)
+{
+    if(host.m_Verbose == 0) {
+        return 0;
+    }
+    
+    va_list ap;
+    
+    va_start(ap, fmt);
+    int rc = vprintf(fmt, ap);
+    va_end(ap);
+    
+    return rc;
+}
+/**
+ * 
+ * @return 
+ */
+unsigned long os_random(void)
+{
+    uint32 x = host.m_Random;
+    
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    
+    host.m_Random = x;
+    
+    return x;
+}
+/**
+ * 
+ * @return 
+ */
+uint32 system_get_time(void)
+{
+    return host.m_Now * 1000;
+}
+/**
+ * 
+ * @param src_addr
+ * @param des_addr
+ * @param load_size
+ * @return 
+ */
+bool system_rtc_mem_read(uint8 src_addr, void* des_addr, uint16 load_size)
+{
+    if(src_addr < HOST_RTC_USER_BLOCK || src_addr * 4u + load_size > sizeof(host_rtc)) {
+        return false;
+    }
+    
+    memcpy(des_addr, &host_rtc[src_addr], load_size);
+    
+    return true;
+}
+/**
+ * 
+ * @param des_addr
+ * @param src_addr
+ * @param save_size
+ * @return 
+ */
+bool system_rtc_mem_write(uint8 des_addr, const void* src_addr, uint16 save_size)
+{
+    if(des_addr < HOST_RTC_USER_BLOCK || des_addr * 4u + save_size > sizeof(host_rtc)) {
+        return false;
+    }
+    
+    memcpy(&host_rtc[des_addr], src_addr, save_size);
+    
+    return true;
+}
+/**
+ * 
+ * @param start_sec
+ * @param param
+ * @param len
+ * @return 
+ */
+bool system_param_save_with_protect(uint16 start_sec, void* param, uint16 len)
+{
+    int i;
+    
+    if(start_sec == 0 || len > HOST_PARAM_SIZE) {
+        return false;
+    }
+    
+    for(i = 0; i < HOST_PARAM_AREAS && host_param[i].m_Sector != 0 && host_param[i].m_Sector != start_sec; i++) {
+    }
+    
+    if(i == HOST_PARAM_AREAS) {
+        return false;
+    }
+    
+    host.m_Counters.m_FlashWrites++;
+    
+    host_param[i].m_Sector = start_sec;
+    memset(host_param[i].m_Data, 0xFF, sizeof(host_param[i].m_Data));
+    memcpy(host_param[i].m_Data, param, len);
+    
+    return true;
+}
+/**
+ * 
+ * @param start_sec
+ * @param offset
+ * @param param
+ * @param len
+ * @return 
+ */
+bool system_param_load(uint16 start_sec, uint16 offset, void* param, uint16 len)
+{
+    int i;
+    
+    host.m_Counters.m_FlashReads++;
+    
+    if(offset + len > HOST_PARAM_SIZE) {
+        return false;
+    }
+    
+    for(i = 0; i < HOST_PARAM_AREAS && host_param[i].m_Sector != start_sec; i++) {
+    }
+    
+    if(start_sec == 0 || i == HOST_PARAM_AREAS) {
+        memset(param, 0xFF, len);                                               // erased flash
+    }
+    else {
+        memcpy(param, &host_param[i].m_Data[offset], len);
+    }
+    
+    return true;
+}
+/**
+ * 
+ * @param timer
+ */
+void InitTimer(Timer* timer)
+{
+    timer->end_time = 0;
+}
+/**
+ * 
+ * @param timer
+ * @return 
+ */
+char expired(Timer* timer)
+{
+    return ((sint32)(timer->end_time - host.m_Now) <= 0) ? 1 : 0;
+}
+/**
+ * 
+ * @param timer
+ * @param ms
+ */
+void countdown_ms(Timer* timer, unsigned int ms)
+{
+    timer->end_time = host.m_Now + ms;
+}
+/**
+ * 
+ * @param timer
+ * @param seconds
+ */
+void countdown(Timer* timer, unsigned int seconds)
+{
+    timer->end_time = host.m_Now + seconds * 1000;
+}
+/**
+ * 
+ * @param timer
+ * @return 
+ */
+int left_ms(Timer* timer)
+{
+    sint32 left = (sint32)(timer->end_time - host.m_Now);
+    
+    return (left < 0) ? 0 : left;
+}
+
+/******************************************************************************************************************
+ * user_interface.h
+ *
+ */
+
+/**
+ * 
+ * @return 
+ */
+uint8 wifi_get_opmode(void)
+{
+    return host.m_OpMode;
+}
+/**
+ * 
+ * @return 
+ */
+uint8 wifi_get_opmode_default(void)
+{
+    host.m_Counters.m_FlashReads++;
+    
+    return host_flash.m_OpMode;
+}
+/**
+ * 
+ * @param opmode
+ * @return 
+ */
+bool wifi_set_opmode(uint8 opmode)
+{
+    host.m_Counters.m_FlashWrites++;
+    
+    if(opmode <= STATIONAP_MODE) {
+        host_flash.m_OpMode = opmode;
+    }
+    
+    return wifi_set_opmode_current(opmode);
+}
+/**
+ * 
+ * @param opmode
+ * @return 
+ */
+bool wifi_set_opmode_current(uint8 opmode)
+{
+    host.m_Counters.m_SetOpmode++;
+    
+    if(opmode > STATIONAP_MODE) {
+        return false;
+    }
+    
+    if((opmode & STATION_MODE) == 0 && host.m_Phase != sta_idle) {
+        host.m_Wanted = 0;
+        host_sta_lost(REASON_ASSOC_LEAVE);
+        
+        host.m_Phase  = sta_idle;
+        host.m_Status = STATION_IDLE;
+    }
+    
+    if((opmode & SOFTAP_MODE) == 0) {
+        host.m_StationCount = 0;
+    }
+    
+    host.m_OpMode = opmode;
+    
+    return true;
+}
+/**
+ * 
+ * @param if_index
+ * @param macaddr
+ * @return 
+ */
+bool wifi_get_macaddr(uint8 if_index, uint8* macaddr)
+{
+    memcpy(macaddr, host.m_Mac, 6);
+    
+    if(if_index == SOFTAP_IF) {
+        macaddr[0] |= 0x02;
+    }
+    
+    return true;
+}
+/**
+ * 
+ * @param if_index
+ * @param info
+ * @return 
+ */
+bool wifi_get_ip_info(uint8 if_index, struct ip_info* info)
+{
+    if(if_index == SOFTAP_IF) {
+        IP4_ADDR(&info->ip,      192, 168, 4, 1);
+        IP4_ADDR(&info->netmask, 255, 255, 255, 0);
+        IP4_ADDR(&info->gw,      192, 168, 4, 1);
+    }
+    else {
+        *info = host.m_Info;
+    }
+    
+    return true;
+}
+/**
+ * 
+ * @param if_index
+ * @param info
+ * @return 
+ */
+bool wifi_set_ip_info(uint8 if_index, struct ip_info* info)
+{
+    if(if_index == STATION_IF) {
+        if(host.m_DhcpcStopped == 0) {
+            return false;                                                       // like the SDK: stop the DHCP client first
+        }
+        
+        host.m_Static = *info;
+        host.m_Info   = *info;
+    }
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+bool wifi_station_dhcpc_start(void)
+{
+    host.m_DhcpcStopped = 0;
+    
+    if(host.m_Phase == sta_up) {                                                // get a lease on the current association
+        memset(&host.m_Info, 0, sizeof(host.m_Info));
+        
+        host.m_Phase    = sta_dhcp;
+        host.m_PhaseDue = host.m_Now + host.m_Timing.m_DhcpMs;
+        host.m_Status   = STATION_CONNECTING;
+    }
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+bool wifi_station_dhcpc_stop(void)
+{
+    host.m_DhcpcStopped = 1;
+    
+    return true;
+}
+/**
+ * 
+ * @param channel
+ * @return 
+ */
+bool wifi_set_channel(uint8 channel)
+{
+    if(channel < 1 || channel > 13) {
+        return false;
+    }
+    
+    host.m_Channel = channel;
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+uint8 wifi_get_channel(void)
+{
+    if(host.m_Phase == sta_up || host.m_Phase == sta_dhcp) {
+        return host.m_AP[host.m_Connected].m_Channel;
+    }
+    
+    return host.m_Channel;
+}
+/**
+ * 
+ * @param cb
+ */
+void wifi_set_event_handler_cb(wifi_event_handler_cb_t cb)
+{
+    host.m_EventCallback = cb;
+}
+/**
+ * 
+ * @param type
+ * @return 
+ */
+bool wifi_set_sleep_type(enum sleep_type type)
+{
+    host.m_SleepType = (uint8)type;
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+enum sleep_type wifi_get_sleep_type(void)
+{
+    return (enum sleep_type)host.m_SleepType;
+}
+/**
+ * 
+ * @param level
+ * @return 
+ */
+bool wifi_set_sleep_level(enum sleep_level level)
+{
+    host.m_SleepLevel = (uint8)level;
+    
+    return true;
+}
+/**
+ * takes effect at the next association
+ * 
+ * @param interval
+ * @return 
+ */
+bool wifi_set_listen_interval(uint8 interval)
+{
+    if(interval == 0 || interval > 10) {
+        return false;
+    }
+    
+    host.m_ListenInterval = interval;
+    
+    return true;
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_station_get_config(struct station_config* config)
+{
+    *config = host.m_StationConfig;
+    
+    return true;
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_station_get_config_default(struct station_config* config)
+{
+    host.m_Counters.m_FlashReads++;
+    
+    *config = host_flash.m_StationConfig;
+    
+    return true;
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_station_set_config(struct station_config* config)
+{
+    host.m_Counters.m_FlashWrites++;
+    
+    host_flash.m_StationConfig = *config;
+    
+    return wifi_station_set_config_current(config);
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_station_set_config_current(struct station_config* config)
+{
+    host.m_Counters.m_ConfigWrites++;
+    
+    host.m_StationConfig = *config;
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+bool wifi_station_connect(void)
+{
+    if((host.m_OpMode & STATION_MODE) == 0) {
+        return false;
+    }
+    
+    host.m_Counters.m_Connects++;
+    
+    if(host.m_Phase == sta_up || host.m_Phase == sta_dhcp) {
+        return true;
+    }
+    
+    host.m_Wanted   = 1;
+    host.m_Phase    = sta_assoc;
+    host.m_PhaseDue = host.m_Now + host_search_ms() + host.m_Timing.m_AssocMs;
+    host.m_Status   = STATION_CONNECTING;
+    
+    host.m_Counters.m_Assocs++;
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+bool wifi_station_disconnect(void)
+{
+    if((host.m_OpMode & STATION_MODE) == 0) {
+        return false;
+    }
+    
+    host.m_Wanted = 0;
+    
+    if(host.m_Phase != sta_idle) {
+        host_sta_lost(REASON_ASSOC_LEAVE);
+        
+        host.m_Phase = sta_idle;
+    }
+    
+    host.m_Status = STATION_IDLE;
+    
+    return true;
+}
+/**
+ * 
+ * @param config
+ * @param cb
+ * @return 
+ */
+bool wifi_station_scan(struct scan_config* config, scan_done_cb_t cb)
+{
+    if((host.m_OpMode & STATION_MODE) == 0 || host.m_Scan.m_Callback != NULL) {
+        return false;
+    }
+    
+    HostScan* scan = &host.m_Scan;
+    
+    host.m_Counters.m_Scans++;
+    
+    memset(scan, 0, sizeof(*scan));
+    
+    if(config != NULL) {
+        if(config->ssid != NULL) {
+            strncpy((char*)scan->m_Ssid, (const char*)config->ssid, sizeof(scan->m_Ssid) - 1);
+            scan->m_HasSsid = 1;
+        }
+        
+        if(config->bssid != NULL) {
+            memcpy(scan->m_Bssid, config->bssid, sizeof(scan->m_Bssid));
+            scan->m_HasBssid = 1;
+        }
+        
+        scan->m_Channel = config->channel;
+    }
+    
+    uint32 ms = host.m_Timing.m_ScanChannelMs * ((scan->m_Channel != 0) ? 1 : HOST_SCAN_CHANNELS);
+    
+    scan->m_Callback = cb;
+    scan->m_Due      = host.m_Now + ms;
+    
+    host.m_Counters.m_ScanMs += ms;
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+uint8 wifi_station_get_connect_status(void)
+{
+    host.m_Counters.m_StatusPolls++;
+    
+    return host.m_Status;
+}
+/**
+ * 
+ * @return 
+ */
+uint8 wifi_station_get_auto_connect(void)
+{
+    host.m_Counters.m_FlashReads++;
+    
+    return host_flash.m_AutoConnect;
+}
+/**
+ * 
+ * @param set
+ * @return 
+ */
+bool wifi_station_set_auto_connect(uint8 set)
+{
+    host.m_Counters.m_FlashWrites++;                                            // the SDK persists this one too
+    
+    host_flash.m_AutoConnect = set;
+    
+    return true;
+}
+/**
+ * 
+ * @param set
+ * @return 
+ */
+bool wifi_station_set_reconnect_policy(bool set)
+{
+    host.m_Reconnect = set ? 1 : 0;                                             // RAM only
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+sint8 wifi_station_get_rssi(void)
+{
+    if(host.m_Phase != sta_up) {
+        return 31;
+    }
+    
+    return host.m_AP[host.m_Connected].m_Rssi;
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_softap_get_config(struct softap_config* config)
+{
+    *config = host.m_SoftAPConfig;
+    
+    return true;
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_softap_get_config_default(struct softap_config* config)
+{
+    host.m_Counters.m_FlashReads++;
+    
+    *config = host_flash.m_SoftAPConfig;
+    
+    return true;
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_softap_set_config(struct softap_config* config)
+{
+    host.m_Counters.m_FlashWrites++;
+    
+    host_flash.m_SoftAPConfig = *config;
+    
+    return wifi_softap_set_config_current(config);
+}
+/**
+ * 
+ * @param config
+ * @return 
+ */
+bool wifi_softap_set_config_current(struct softap_config* config)
+{
+    host.m_Counters.m_ConfigWrites++;
+    
+    host.m_SoftAPConfig = *config;
+    
+    return true;
+}
+/**
+ * 
+ * @return 
+ */
+uint8 wifi_softap_get_station_num(void)
+{
+    return (uint8)host.m_StationCount;
+}
+/**
+ * 
+ * @return 
+ */
+struct station_info* wifi_softap_get_station_info(void)
+{
+    int i;
+    
+    host.m_Counters.m_StationLists++;
+    
+    if(host.m_StationCount == 0) {
+        return NULL;
+    }
+    
+    for(i = 0; i < host.m_StationCount; i++) {
+        host.m_Station[i].next.stqe_next = (i + 1 < host.m_StationCount) ? &host.m_Station[i + 1] : NULL;
+    }
+    
+    return &host.m_Station[0];
+}
+/**
+ * 
+ */
+void wifi_softap_free_station_info(void)
+{
+}
+
+/******************************************************************************************************************
+ * lwip
+ *
+ */
+
+/**
+ * 
+ * @param index
+ * @return 
+ */
+struct netif* eagle_lwip_getif(uint8 index)
+{
+    host.m_Netif[index].num = index;
+    
+    return &host.m_Netif[index];
+}
+/**
+ * only the gateway of the AP we are on answers
+ * 
+ * @param netif
+ * @param ipaddr
+ * @return 
+ */
+err_t etharp_request(struct netif* netif, ip_addr_t* ipaddr)
+{
+    ip_addr_t gw;
+    
+    host.m_ArpIp  = *ipaddr;
+    host.m_ArpDue = 0;
+    
+    if(host.m_Phase == sta_up) {
+        IP4_ADDR(&gw, 10, 0, host.m_Connected, 1);
+        
+        if(gw.addr == ipaddr->addr) {
+            host.m_ArpDue = host.m_Now + host.m_Timing.m_ArpMs;
+        }
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param netif
+ * @param ipaddr
+ * @param eth_ret
+ * @param ip_ret
+ * @return index into the ARP table or -1
+ */
+sint8 etharp_find_addr(struct netif* netif, ip_addr_t* ipaddr, struct eth_addr** eth_ret, ip_addr_t** ip_ret)
+{
+    static struct eth_addr eth;
+    
+    if(host.m_ArpDue == 0 || host.m_ArpDue > host.m_Now || host.m_ArpIp.addr != ipaddr->addr || host.m_Phase != sta_up) {
+        return -1;
+    }
+    
+    memcpy(eth.addr, host.m_AP[host.m_Connected].m_Bssid, sizeof(eth.addr));
+    
+    *eth_ret = &eth;
+    *ip_ret  = &host.m_ArpIp;
+    
+    return 0;
+}
+
+/******************************************************************************************************************
+ * lwip (pbuf.h, udp.h)
+ *
+ */
+
+/**
+ * PBUF_RAM only; the other types are allocated the same way
+ * 
+ * @param layer
+ * @param length
+ * @param type
+ * @return 
+ */
+struct pbuf* pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+    static const uint16 headroom[] = { HOST_HEADROOM, HOST_HEADROOM - 8, 14, 0 };
+    
+    host.m_Counters.m_PbufAllocs++;
+    
+    return host_pbuf_new(length, headroom[layer]);
+}
+/**
+ * 
+ * @param p
+ * @return number of pbufs freed
+ */
+u8_t pbuf_free(struct pbuf* p)
+{
+    u8_t count = 0;
+    
+    while(p != NULL && --p->ref == 0) {
+        struct pbuf* next = p->next;
+        
+        free(p);
+        count++;
+        
+        p = next;
+    }
+    
+    return count;
+}
+/**
+ * 
+ * @param p
+ */
+void pbuf_ref(struct pbuf* p)
+{
+    p->ref++;
+}
+/**
+ * 
+ * @param p
+ * @param header_size
+ * @return 0 if there was room
+ */
+u8_t pbuf_header(struct pbuf* p, s16_t header_size)
+{
+    uint8* payload = (uint8*)p->payload - header_size;
+    
+    if(payload < (uint8*)(p + 1) || (header_size < 0 && -header_size > p->len)) {
+        return 1;
+    }
+    
+    p->payload  = payload;
+    p->len     += header_size;
+    p->tot_len += header_size;
+    
+    return 0;
+}
+/**
+ * 
+ * @return 
+ */
+struct udp_pcb* udp_new(void)
+{
+    int i;
+    
+    for(i = 0; i < HOST_MAX_PCB; i++) {
+        if(host.m_PcbUsed[i] == 0) {
+            memset(&host.m_Pcb[i], 0, sizeof(host.m_Pcb[i]));
+            host.m_PcbUsed[i] = 1;
+            
+            return &host.m_Pcb[i];
+        }
+    }
+    
+    return NULL;
+}
+/**
+ * 
+ * @param pcb
+ */
+void udp_remove(struct udp_pcb* pcb)
+{
+    host.m_PcbUsed[pcb - host.m_Pcb] = 0;
+}
+/**
+ * 
+ * @param pcb
+ * @param ipaddr
+ * @param port
+ * @return 
+ */
+err_t udp_bind(struct udp_pcb* pcb, ip_addr_t* ipaddr, u16_t port)
+{
+    int i;
+    
+    for(i = 0; i < HOST_MAX_PCB; i++) {
+        if(host.m_PcbUsed[i] != 0 && &host.m_Pcb[i] != pcb && host.m_Pcb[i].local_port == port) {
+            return ERR_USE;
+        }
+    }
+    
+    pcb->local_port = port;
+    
+    return ERR_OK;
+}
+/**
+ * 
+ * @param pcb
+ * @param recv
+ * @param recv_arg
+ */
+void udp_recv(struct udp_pcb* pcb, udp_recv_fn recv, void* recv_arg)
+{
+    pcb->recv     = recv;
+    pcb->recv_arg = recv_arg;
+}
+/**
+ * like lwIP: the headers go in front of 'p' when it has the room, otherwise into a new pbuf chained in front of it;
+ * either way the payload pointer of 'p' is not put back
+ * 
+ * @param pcb
+ * @param p
+ * @param dst_ip
+ * @param dst_port
+ * @param netif
+ * @return 
+ */
+err_t udp_sendto_if(struct udp_pcb* pcb, struct pbuf* p, ip_addr_t* dst_ip, u16_t dst_port, struct netif* netif)
+{
+    HostFrame frame;
+    
+    if((netif->num == STATION_IF && host.m_Phase != sta_up) || (netif->num == SOFTAP_IF && (host.m_OpMode & SOFTAP_MODE) == 0)) {
+        return ERR_RTE;
+    }
+    
+    memset(&frame, 0, sizeof(frame));
+    
+    frame.m_Data   = p->payload;
+    frame.m_Length = p->tot_len;
+    frame.m_If     = netif->num;
+    frame.m_Dst    = *dst_ip;
+    
+    if(host.m_FrameCount == HOST_MAX_FRAME) {
+        host.m_Counters.m_UdpDropped++;
+        return ERR_MEM;
+    }
+    
+    if(pbuf_header(p, HOST_HEADROOM) == 0) {
+        frame.m_Pbuf = p;
+        
+        pbuf_ref(p);                                                            // the driver holds it until it is sent
+        
+        if((p->flags & HOST_PBUF_RX) != 0) {
+            host.m_Counters.m_UdpForwarded++;
+        }
+    }
+    else {
+        frame.m_Pbuf       = pbuf_alloc(PBUF_RAW, HOST_HEADROOM, PBUF_RAM);
+        frame.m_Pbuf->next = p;
+        
+        pbuf_ref(p);
+    }
+    
+    host_air(&frame);
+    
+    host.m_Counters.m_UdpTx++;
+    host.m_Counters.m_UdpTxBytes += frame.m_Length;
+    
+    return ERR_OK;
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * 
+ * @param evt
+ */
+static void host_post_event(const System_Event_t* evt)
+{
+    if(host.m_EventCount < HOST_MAX_EVENT) {
+        host.m_Event[host.m_EventCount++] = *evt;
+    }
+}
+/**
+ * the station lost (or gave up) its association; tell the library and let the SDK retry if it still wants to
+ * 
+ * @param reason
+ */
+static void host_sta_lost(uint8 reason)
+{
+    System_Event_t evt;
+    
+    memset(&evt, 0, sizeof(evt));
+    evt.event = EVENT_STAMODE_DISCONNECTED;
+    evt.event_info.disconnected.reason = reason;
+    
+    if(host.m_Connected >= 0) {
+        HostAP* ap = &host.m_AP[host.m_Connected];
+        
+        memcpy(evt.event_info.disconnected.ssid, ap->m_Ssid, sizeof(evt.event_info.disconnected.ssid));
+        memcpy(evt.event_info.disconnected.bssid, ap->m_Bssid, sizeof(evt.event_info.disconnected.bssid));
+        evt.event_info.disconnected.ssid_len = (uint8)strlen(ap->m_Ssid);
+    }
+    
+    host_post_event(&evt);
+    
+    memset(&host.m_Info, 0, sizeof(host.m_Info));
+    
+    host.m_Connected = -1;
+    host.m_Phase     = sta_retry;
+    host.m_PhaseDue  = host.m_Now + host.m_Timing.m_RetryMs;
+    
+    switch(reason) {
+        case REASON_NO_AP_FOUND:
+            host.m_Status = STATION_NO_AP_FOUND;
+            break;
+        
+        case REASON_AUTH_FAIL:
+        case REASON_4WAY_HANDSHAKE_TIMEOUT:
+            host.m_Status = STATION_WRONG_PASSWORD;
+            break;
+        
+        default:
+            host.m_Status = STATION_CONNECTING;
+            break;
+    }
+}
+/**
+ * 
+ */
+static void host_sta_fire(void)
+{
+    System_Event_t evt;
+    
+    memset(&evt, 0, sizeof(evt));
+    
+    switch(host.m_Phase) {
+        case sta_assoc: {
+            int     i  = host_find_ap();
+            HostAP* ap = (i >= 0) ? &host.m_AP[i] : NULL;
+            
+            if(ap == NULL) {
+                host_sta_lost(REASON_NO_AP_FOUND);
+            }
+            else if(strcmp(ap->m_Psw, (const char*)host.m_StationConfig.password) != 0) {
+                host_sta_lost(REASON_AUTH_FAIL);
+            }
+            else if(ap->m_Full != 0) {
+                host_sta_lost(REASON_ASSOC_TOOMANY);
+            }
+            else {
+                host.m_Connected   = i;
+                host.m_AssocListen = (host.m_SleepLevel == MAX_SLEEP_T) ? host.m_ListenInterval : 0;
+                host.m_Phase       = sta_dhcp;
+                host.m_PhaseDue  = host.m_Now + ((host.m_DhcpcStopped != 0) ? 0 : host.m_Timing.m_DhcpMs);
+                
+                evt.event = EVENT_STAMODE_CONNECTED;
+                memcpy(evt.event_info.connected.ssid, ap->m_Ssid, sizeof(evt.event_info.connected.ssid));
+                memcpy(evt.event_info.connected.bssid, ap->m_Bssid, sizeof(evt.event_info.connected.bssid));
+                evt.event_info.connected.ssid_len = (uint8)strlen(ap->m_Ssid);
+                evt.event_info.connected.channel  = ap->m_Channel;
+                
+                host_post_event(&evt);
+            }
+            break;
+        }
+        
+        case sta_dhcp:
+            if(host.m_DhcpcStopped != 0) {
+                host.m_Info = host.m_Static;                                    // static IP; nothing to wait for
+            }
+            else {
+                IP4_ADDR(&host.m_Info.ip,      10, 0, host.m_Connected, 100 + host.m_Mac[5]);
+                IP4_ADDR(&host.m_Info.netmask, 255, 255, 255, 0);
+                IP4_ADDR(&host.m_Info.gw,      10, 0, host.m_Connected, 1);
+            }
+            
+            host.m_Phase  = sta_up;
+            host.m_Status = STATION_GOT_IP;
+            
+            evt.event = EVENT_STAMODE_GOT_IP;
+            evt.event_info.got_ip.ip   = host.m_Info.ip;
+            evt.event_info.got_ip.mask = host.m_Info.netmask;
+            evt.event_info.got_ip.gw   = host.m_Info.gw;
+            
+            host_post_event(&evt);
+            break;
+        
+        case sta_retry:
+            if(host.m_Wanted != 0) {
+                host.m_Phase    = sta_assoc;
+                host.m_PhaseDue = host.m_Now + host_search_ms() + host.m_Timing.m_AssocMs;
+                host.m_Status   = STATION_CONNECTING;
+                
+                host.m_Counters.m_Assocs++;
+            }
+            else {
+                host.m_Phase = sta_idle;
+            }
+            break;
+        
+        default:
+            break;
+    }
+}
+/**
+ * 
+ */
+static void host_scan_fire(void)
+{
+    HostScan         scan = host.m_Scan;
+    struct bss_info* list = calloc((size_t)(host.m_APCount + 1), sizeof(struct bss_info));
+    struct bss_info* tail = NULL;
+    struct bss_info* head = NULL;
+    int              i;
+    
+    host.m_Scan.m_Callback = NULL;                                              // allow a new scan from inside the callback
+    
+    for(i = 0; i < host.m_APCount; i++) {
+        HostAP* ap = &host.m_AP[i];
+        
+        if(host_ap_visible(i) == 0) {
+            continue;
+        }
+        
+        if(scan.m_HasSsid != 0 && strcmp(ap->m_Ssid, (const char*)scan.m_Ssid) != 0) {
+            continue;
+        }
+        
+        if(scan.m_HasBssid != 0 && memcmp(ap->m_Bssid, scan.m_Bssid, 6) != 0) {
+            continue;
+        }
+        
+        if(scan.m_Channel != 0 && scan.m_Channel != ap->m_Channel) {
+            continue;
+        }
+        
+        struct bss_info* bss = &list[i];
+        
+        memcpy(bss->bssid, ap->m_Bssid, sizeof(bss->bssid));
+        strncpy((char*)bss->ssid, ap->m_Ssid, sizeof(bss->ssid));
+        
+        bss->ssid_len = (uint8)strlen(ap->m_Ssid);
+        bss->channel  = ap->m_Channel;
+        bss->rssi     = ap->m_Rssi;
+        bss->authmode = (ap->m_Psw[0] != '\0') ? AUTH_WPA2_PSK : AUTH_OPEN;
+        
+        host.m_Counters.m_ScanResults++;
+        
+        if(tail != NULL) {
+            tail->next.stqe_next = bss;
+        }
+        else {
+            head = bss;
+        }
+        
+        tail = bss;
+    }
+    
+    struct timespec t0;
+    struct timespec t1;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    scan.m_Callback(head, OK);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    
+    host.m_Counters.m_ScanCallbacks++;
+    host.m_Counters.m_ScanCallbackNs += (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000u + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+    
+    free(list);
+}
+/**
+ * 
+ * @param ap
+ * @return 
+ */
+static int host_ap_visible(int ap)
+{
+    HostAP* p = &host.m_AP[ap];
+    uint32  t = host.m_Now - host.m_Epoch;
+    
+    if(t < p->m_From) {
+        return 0;
+    }
+    
+    if(p->m_Until != 0 && t >= p->m_Until) {
+        return 0;
+    }
+    
+    return 1;
+}
+/**
+ * 
+ * @return 
+ */
+static int host_find_ap(void)
+{
+    int i;
+    int best = -1;
+    
+    for(i = 0; i < host.m_APCount; i++) {
+        HostAP* ap = &host.m_AP[i];
+        
+        if(host_ap_visible(i) == 0 || strcmp(ap->m_Ssid, (const char*)host.m_StationConfig.ssid) != 0) {
+            continue;
+        }
+        
+        if(host.m_StationConfig.bssid_set != 0 && memcmp(ap->m_Bssid, host.m_StationConfig.bssid, 6) != 0) {
+            continue;
+        }
+        
+        if(best < 0 || ap->m_Rssi > host.m_AP[best].m_Rssi) {
+            best = i;
+        }
+    }
+    
+    return best;
+}
+/**
+ * with a BSSID and the right channel the station goes straight to that AP instead of sweeping for it
+ * 
+ * @return 
+ */
+static uint32 host_search_ms(void)
+{
+    int i = host_find_ap();
+    
+    if(i >= 0 && host.m_StationConfig.bssid_set != 0 && host.m_Channel == host.m_AP[i].m_Channel) {
+        return 0;
+    }
+    
+    return host.m_Timing.m_SearchMs;
+}
+/**
+ * 
+ * @param ms
+ * @param wake
+ */
+static void host_advance(uint32 ms, int wake)
+{
+    uint32 end = host.m_Now + ms;
+    
+    for(;;) {
+        // deliver whatever the previous step (or the library) queued
+        while(host.m_EventCount > 0) {
+            System_Event_t evt = host.m_Event[0];
+            
+            memmove(&host.m_Event[0], &host.m_Event[1], sizeof(System_Event_t) * (size_t)(host.m_EventCount - 1));
+            host.m_EventCount--;
+            
+            if(host.m_EventCallback != NULL) {
+                host.m_EventCallback(&evt);
+            }
+        }
+        
+        if(wake != 0 && host.m_Wake != 0) {
+            end = host.m_Now;                                                   // WIFI_Run() has work
+            break;
+        }
+        
+        uint32 due  = end;
+        int    what = 0;
+        
+        if(host.m_Phase != sta_idle && host.m_Phase != sta_up && host.m_PhaseDue <= due) {
+            due  = host.m_PhaseDue;
+            what = 1;
+        }
+        
+        if(host.m_Scan.m_Callback != NULL && host.m_Scan.m_Due < due) {
+            due  = host.m_Scan.m_Due;
+            what = 2;
+        }
+        
+        if(host.m_Phase == sta_up) {
+            uint32 until = host.m_AP[host.m_Connected].m_Until;
+            
+            if(until != 0 && host.m_Epoch + until < due) {
+                until = host.m_Epoch + until;
+                due  = (until > host.m_Now) ? until : host.m_Now;
+                what = 3;
+            }
+        }
+        
+        if(host.m_FrameCount > 0 && (host.m_Frame[0].m_Due + 999) / 1000 < due) {
+            due  = (uint32)((host.m_Frame[0].m_Due + 999) / 1000);
+            what = 4;
+        }
+        
+        if(what == 0) {
+            break;
+        }
+        
+        if(due > host.m_Now) {
+            host_radio(due);
+            host.m_Now   = due;
+            host.m_NowUs = (uint64_t)due * 1000u;
+        }
+        
+        switch(what) {
+            case 1:
+                host_sta_fire();
+                break;
+            
+            case 2:
+                host_scan_fire();
+                break;
+            
+            case 3:
+                host_sta_lost(REASON_BEACON_TIMEOUT);
+                break;
+            
+            case 4:
+                host_frame_fire();
+                break;
+        }
+    }
+    
+    host_radio(end);
+    host.m_Now   = end;
+    host.m_NowUs = (uint64_t)end * 1000u;
+}
+/**
+ * on while scanning, associating or with the softAP up; while connected the station sleeps between the DTIM
+ * beacons it listens to, unless the sleep type is NONE_SLEEP_T
+ * 
+ * @param until
+ */
+static void host_radio(uint32 until)
+{
+    uint32 ms = until - host.m_Now;
+    uint32 period;
+    
+    if(until <= host.m_Now || host.m_OpMode == NULL_MODE) {
+        return;
+    }
+    
+    if(host.m_Phase != sta_up || host.m_SleepType == NONE_SLEEP_T || host.m_OpMode != STATION_MODE || host.m_Scan.m_Callback != NULL) {
+        host.m_Counters.m_RadioOnMs += ms;
+        return;
+    }
+    
+    period = host.m_Timing.m_DtimMs * ((host.m_AssocListen != 0) ? host.m_AssocListen : 1);
+    
+    host.m_RadioRem             += ms * host.m_Timing.m_WakeMs;
+    host.m_Counters.m_RadioOnMs += host.m_RadioRem / period;
+    host.m_RadioRem             %= period;
+}
+/**
+ * 
+ * @param length
+ * @param headroom
+ * @return 
+ */
+static struct pbuf* host_pbuf_new(uint16 length, uint16 headroom)
+{
+    struct pbuf* p = malloc(sizeof(struct pbuf) + headroom + length);
+    
+    memset(p, 0, sizeof(*p));
+    
+    p->payload = (uint8*)(p + 1) + headroom;
+    p->len     = length;
+    p->tot_len = length;
+    p->type    = PBUF_RAM;
+    p->ref     = 1;
+    
+    return p;
+}
+/**
+ * 
+ * @param frame
+ * @return 
+ */
+static int host_air(HostFrame* frame)
+{
+    uint64_t start = WIFI_HostNowUs();
+    
+    if(host.m_FrameCount == HOST_MAX_FRAME) {
+        return -1;
+    }
+    
+    if(host.m_AirBusy > start) {
+        start = host.m_AirBusy;
+    }
+    
+    frame->m_Due   = start + host.m_Timing.m_FrameUs + ((uint64_t)(frame->m_Length + HOST_HEADROOM) * host.m_Timing.m_ByteNs) / 1000u;
+    host.m_AirBusy = frame->m_Due;
+    
+    host.m_Frame[host.m_FrameCount++] = *frame;
+    
+    return 0;
+}
+/**
+ * 
+ */
+static void host_frame_fire(void)
+{
+    HostFrame frame = host.m_Frame[0];
+    
+    memmove(&host.m_Frame[0], &host.m_Frame[1], sizeof(HostFrame) * (size_t)(host.m_FrameCount - 1));
+    host.m_FrameCount--;
+    
+    host.m_NowUs = frame.m_Due;                                                 // what the sink sends goes out after this one
+    
+    if(host.m_Sink != NULL) {
+        host.m_Sink(frame.m_If, &frame.m_Dst, frame.m_Data, frame.m_Length, frame.m_Due, host.m_SinkPtr);
+    }
+    
+    pbuf_free(frame.m_Pbuf);
+}
+
+#endif  /* WIFI_HOST */
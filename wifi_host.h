@@ -0,0 +1,705 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+/* 
+ * Host (Linux) stand-in for the parts of the ESP8266 Non-OS SDK and timer.h used by wifi.c.
+ * 
+ * Build wifi.c and wifi_host.c with -DWIFI_HOST; the WIFI_Host* functions script the radio
+ * environment and drive a virtual clock.
+ */
+
+#ifndef WIFI_HOST_H
+#define	WIFI_HOST_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+/******************************************************************************************************************
+ * c_types.h
+ *
+ */
+
+typedef uint8_t     uint8;
+typedef int8_t      sint8;
+typedef uint16_t    uint16;
+typedef int16_t     sint16;
+typedef uint32_t    uint32;
+typedef int32_t     sint32;
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+
+/******************************************************************************************************************
+ * queue.h
+ *
+ */
+
+#define STAILQ_ENTRY(type)                                              \
+    struct {                                                            \
+        struct type *stqe_next;                                         \
+    }
+
+#define STAILQ_NEXT(elm, field)     ((elm)->field.stqe_next)
+
+/******************************************************************************************************************
+ * osapi.h
+ *
+ */
+
+int WIFI_HostPrintf(const char* fmt, ...);
+
+#define os_printf(...)          WIFI_HostPrintf(__VA_ARGS__)
+#define os_sprintf              sprintf
+#define os_strcpy               strcpy
+#define os_strncpy              strncpy
+#define os_strcat               strcat
+#define os_strcmp               strcmp
+#define os_strncmp              strncmp
+#define os_strlen               strlen
+#define os_memcpy               memcpy
+#define os_memcmp               memcmp
+#define os_memset               memset
+#define os_bzero(p, n)          memset((p), 0, (n))
+#define os_zalloc(n)            calloc(1, (n))
+#define os_free                 free
+
+unsigned long os_random(void);                  // seeded from the MAC, so nodes given different MACs differ
+
+/******************************************************************************************************************
+ * ip_addr.h
+ *
+ */
+
+struct ip_addr {
+    uint32 addr;
+};
+
+typedef struct ip_addr ip_addr_t;
+
+struct ip_info {
+    struct ip_addr ip;
+    struct ip_addr netmask;
+    struct ip_addr gw;
+};
+
+#define IP4_ADDR(ipaddr, a, b, c, d)                                    \
+        (ipaddr)->addr = ((uint32)((d) & 0xff) << 24) |                 \
+                         ((uint32)((c) & 0xff) << 16) |                 \
+                         ((uint32)((b) & 0xff) << 8)  |                 \
+                          (uint32)((a) & 0xff)
+
+#define ip4_addr1(ipaddr)       (((uint8*)(ipaddr))[0])
+#define ip4_addr2(ipaddr)       (((uint8*)(ipaddr))[1])
+#define ip4_addr3(ipaddr)       (((uint8*)(ipaddr))[2])
+#define ip4_addr4(ipaddr)       (((uint8*)(ipaddr))[3])
+
+#define ip4_addr1_16(ipaddr)    ((uint16)ip4_addr1(ipaddr))
+#define ip4_addr2_16(ipaddr)    ((uint16)ip4_addr2(ipaddr))
+#define ip4_addr3_16(ipaddr)    ((uint16)ip4_addr3(ipaddr))
+#define ip4_addr4_16(ipaddr)    ((uint16)ip4_addr4(ipaddr))
+
+#define IP2STR(ipaddr)          ip4_addr1_16(ipaddr), ip4_addr2_16(ipaddr), ip4_addr3_16(ipaddr), ip4_addr4_16(ipaddr)
+
+/******************************************************************************************************************
+ * user_interface.h
+ *
+ */
+
+typedef enum {
+    OK = 0,
+    FAIL,
+    PENDING,
+    BUSY,
+    CANCEL
+} STATUS;
+
+#define NULL_MODE           0x00
+#define STATION_MODE        0x01
+#define SOFTAP_MODE         0x02
+#define STATIONAP_MODE      0x03
+
+#define STATION_IF          0x00
+#define SOFTAP_IF           0x01
+
+#define MAC2STR(a)          (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+#define MACSTR              "%02x:%02x:%02x:%02x:%02x:%02x"
+
+typedef enum _auth_mode {
+    AUTH_OPEN = 0,
+    AUTH_WEP,
+    AUTH_WPA_PSK,
+    AUTH_WPA2_PSK,
+    AUTH_WPA_WPA2_PSK,
+    AUTH_MAX
+} AUTH_MODE;
+
+enum {
+    STATION_IDLE = 0,
+    STATION_CONNECTING,
+    STATION_WRONG_PASSWORD,
+    STATION_NO_AP_FOUND,
+    STATION_CONNECT_FAIL,
+    STATION_GOT_IP
+};
+
+enum sleep_type {
+    NONE_SLEEP_T = 0,
+    LIGHT_SLEEP_T,
+    MODEM_SLEEP_T
+};
+
+enum sleep_level {
+    MIN_SLEEP_T,
+    MAX_SLEEP_T                                 // honours the listen interval
+};
+
+struct station_config {
+    uint8 ssid[32];
+    uint8 password[64];
+    uint8 bssid_set;
+    uint8 bssid[6];
+};
+
+struct softap_config {
+    uint8       ssid[32];
+    uint8       password[64];
+    uint8       ssid_len;
+    uint8       channel;
+    AUTH_MODE   authmode;
+    uint8       ssid_hidden;
+    uint8       max_connection;
+    uint16      beacon_interval;
+};
+
+struct scan_config {
+    uint8*  ssid;
+    uint8*  bssid;
+    uint8   channel;
+    uint8   show_hidden;
+};
+
+struct bss_info {
+    STAILQ_ENTRY(bss_info)  next;
+    uint8                   bssid[6];
+    uint8                   ssid[32];
+    uint8                   ssid_len;
+    uint8                   channel;
+    sint8                   rssi;
+    AUTH_MODE               authmode;
+    uint8                   is_hidden;
+    sint16                  freq_offset;
+    sint16                  freqcal_val;
+    uint8*                  esp_mesh_ie;
+};
+
+struct station_info {
+    STAILQ_ENTRY(station_info)  next;
+    uint8                       bssid[6];
+    struct ip_addr              ip;
+};
+
+typedef void (*scan_done_cb_t)(void* arg, STATUS status);
+
+enum {
+    REASON_UNSPECIFIED              = 1,
+    REASON_AUTH_EXPIRE              = 2,
+    REASON_AUTH_LEAVE               = 3,
+    REASON_ASSOC_EXPIRE             = 4,
+    REASON_ASSOC_TOOMANY            = 5,
+    REASON_NOT_AUTHED               = 6,
+    REASON_NOT_ASSOCED              = 7,
+    REASON_ASSOC_LEAVE              = 8,
+    REASON_ASSOC_NOT_AUTHED         = 9,
+    REASON_4WAY_HANDSHAKE_TIMEOUT   = 15,
+    REASON_BEACON_TIMEOUT           = 200,
+    REASON_NO_AP_FOUND              = 201,
+    REASON_AUTH_FAIL                = 202,
+    REASON_ASSOC_FAIL               = 203,
+    REASON_HANDSHAKE_TIMEOUT        = 204
+};
+
+enum {
+    EVENT_STAMODE_CONNECTED = 0,
+    EVENT_STAMODE_DISCONNECTED,
+    EVENT_STAMODE_AUTHMODE_CHANGE,
+    EVENT_STAMODE_GOT_IP,
+    EVENT_STAMODE_DHCP_TIMEOUT,
+    EVENT_SOFTAPMODE_STACONNECTED,
+    EVENT_SOFTAPMODE_STADISCONNECTED,
+    EVENT_SOFTAPMODE_PROBEREQRECVED,
+    EVENT_OPMODE_CHANGED,
+    EVENT_SOFTAPMODE_DISTRIBUTE_STA_IP,
+    EVENT_MAX
+};
+
+typedef struct {
+    uint8 ssid[32];
+    uint8 ssid_len;
+    uint8 bssid[6];
+    uint8 channel;
+} Event_StaMode_Connected_t;
+
+typedef struct {
+    uint8 ssid[32];
+    uint8 ssid_len;
+    uint8 bssid[6];
+    uint8 reason;
+} Event_StaMode_Disconnected_t;
+
+typedef struct {
+    uint8 old_mode;
+    uint8 new_mode;
+} Event_StaMode_AuthMode_Change_t;
+
+typedef struct {
+    struct ip_addr ip;
+    struct ip_addr mask;
+    struct ip_addr gw;
+} Event_StaMode_Got_IP_t;
+
+typedef struct {
+    uint8 mac[6];
+    uint8 aid;
+} Event_SoftAPMode_StaConnected_t;
+
+typedef struct {
+    uint8 mac[6];
+    uint8 aid;
+} Event_SoftAPMode_StaDisconnected_t;
+
+typedef struct {
+    int   rssi;
+    uint8 mac[6];
+} Event_SoftAPMode_ProbeReqRecved_t;
+
+typedef struct {
+    uint8 old_opmode;
+    uint8 new_opmode;
+} Event_OpMode_Change_t;
+
+typedef struct {
+    uint8          mac[6];
+    struct ip_addr ip;
+    uint8          aid;
+} Event_SoftAPMode_Distribute_Sta_IP_t;
+
+typedef union {
+    Event_StaMode_Connected_t           connected;
+    Event_StaMode_Disconnected_t        disconnected;
+    Event_StaMode_AuthMode_Change_t     auth_change;
+    Event_StaMode_Got_IP_t              got_ip;
+    Event_SoftAPMode_StaConnected_t     sta_connected;
+    Event_SoftAPMode_StaDisconnected_t  sta_disconnected;
+    Event_SoftAPMode_ProbeReqRecved_t   ap_probereqrecved;
+    Event_OpMode_Change_t               opmode_changed;
+    Event_SoftAPMode_Distribute_Sta_IP_t distribute_sta_ip;
+} Event_Info_u;
+
+typedef struct _esp_event {
+    uint32       event;
+    Event_Info_u event_info;
+} System_Event_t;
+
+typedef void (*wifi_event_handler_cb_t)(System_Event_t* event);
+
+uint32  system_get_time(void);
+bool    system_rtc_mem_read(uint8 src_addr, void* des_addr, uint16 load_size);
+bool    system_rtc_mem_write(uint8 des_addr, const void* src_addr, uint16 save_size);
+bool    system_param_save_with_protect(uint16 start_sec, void* param, uint16 len);
+bool    system_param_load(uint16 start_sec, uint16 offset, void* param, uint16 len);
+
+uint8   wifi_get_opmode(void);
+uint8   wifi_get_opmode_default(void);
+bool    wifi_set_opmode(uint8 opmode);
+bool    wifi_set_opmode_current(uint8 opmode);
+bool    wifi_get_macaddr(uint8 if_index, uint8* macaddr);
+bool    wifi_get_ip_info(uint8 if_index, struct ip_info* info);
+bool    wifi_set_ip_info(uint8 if_index, struct ip_info* info);
+bool    wifi_station_dhcpc_start(void);
+bool    wifi_station_dhcpc_stop(void);
+bool    wifi_set_channel(uint8 channel);
+uint8   wifi_get_channel(void);
+void    wifi_set_event_handler_cb(wifi_event_handler_cb_t cb);
+bool    wifi_set_sleep_type(enum sleep_type type);
+enum sleep_type wifi_get_sleep_type(void);
+bool    wifi_set_sleep_level(enum sleep_level level);
+bool    wifi_set_listen_interval(uint8 interval);
+
+bool    wifi_station_get_config(struct station_config* config);
+bool    wifi_station_get_config_default(struct station_config* config);
+bool    wifi_station_set_config(struct station_config* config);
+bool    wifi_station_set_config_current(struct station_config* config);
+bool    wifi_station_connect(void);
+bool    wifi_station_disconnect(void);
+bool    wifi_station_scan(struct scan_config* config, scan_done_cb_t cb);
+uint8   wifi_station_get_connect_status(void);
+uint8   wifi_station_get_auto_connect(void);
+bool    wifi_station_set_auto_connect(uint8 set);
+bool    wifi_station_set_reconnect_policy(bool set);
+sint8   wifi_station_get_rssi(void);
+
+bool    wifi_softap_get_config(struct softap_config* config);
+bool    wifi_softap_get_config_default(struct softap_config* config);
+bool    wifi_softap_set_config(struct softap_config* config);
+bool    wifi_softap_set_config_current(struct softap_config* config);
+uint8   wifi_softap_get_station_num(void);
+struct station_info* wifi_softap_get_station_info(void);
+void    wifi_softap_free_station_info(void);
+
+/******************************************************************************************************************
+ * lwip (netif.h, etharp.h)
+ *
+ */
+
+typedef sint8 err_t;
+
+struct netif {
+    uint8 num;
+};
+
+struct eth_addr {
+    uint8 addr[6];
+};
+
+struct netif* eagle_lwip_getif(uint8 index);
+err_t   etharp_request(struct netif* netif, ip_addr_t* ipaddr);
+sint8   etharp_find_addr(struct netif* netif, ip_addr_t* ipaddr, struct eth_addr** eth_ret, ip_addr_t** ip_ret);
+
+/******************************************************************************************************************
+ * lwip (pbuf.h, udp.h)
+ *
+ */
+
+typedef uint8       u8_t;
+typedef uint16      u16_t;
+typedef sint16      s16_t;
+
+#define ERR_OK                  0
+#define ERR_MEM                 -1
+#define ERR_RTE                 -4
+#define ERR_USE                 -8
+
+typedef enum {
+    PBUF_TRANSPORT,
+    PBUF_IP,
+    PBUF_LINK,
+    PBUF_RAW
+} pbuf_layer;
+
+typedef enum {
+    PBUF_RAM,
+    PBUF_ROM,
+    PBUF_REF,
+    PBUF_POOL
+} pbuf_type;
+
+struct pbuf {
+    struct pbuf*    next;
+    void*           payload;
+    u16_t           tot_len;
+    u16_t           len;
+    u8_t            type;
+    u8_t            flags;
+    u16_t           ref;
+};
+
+struct udp_pcb;
+
+typedef void (*udp_recv_fn)(void* arg, struct udp_pcb* pcb, struct pbuf* p, ip_addr_t* addr, u16_t port);
+
+struct udp_pcb {
+    u16_t           local_port;
+    udp_recv_fn     recv;
+    void*           recv_arg;
+};
+
+extern const ip_addr_t ip_addr_any;
+extern const ip_addr_t ip_addr_broadcast;
+
+#define IP_ADDR_ANY             ((ip_addr_t*)&ip_addr_any)
+#define IP_ADDR_BROADCAST       ((ip_addr_t*)&ip_addr_broadcast)
+
+struct pbuf* pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+u8_t    pbuf_free(struct pbuf* p);
+void    pbuf_ref(struct pbuf* p);
+u8_t    pbuf_header(struct pbuf* p, s16_t header_size);
+
+struct udp_pcb* udp_new(void);
+void    udp_remove(struct udp_pcb* pcb);
+err_t   udp_bind(struct udp_pcb* pcb, ip_addr_t* ipaddr, u16_t port);
+void    udp_recv(struct udp_pcb* pcb, udp_recv_fn recv, void* recv_arg);
+err_t   udp_sendto_if(struct udp_pcb* pcb, struct pbuf* p, ip_addr_t* dst_ip, u16_t dst_port, struct netif* netif);
+
+/******************************************************************************************************************
+ * timer.h
+ *
+ */
+
+typedef struct Timer {
+    uint32 end_time;
+} Timer;
+
+void    InitTimer(Timer* timer);
+char    expired(Timer* timer);
+void    countdown_ms(Timer* timer, unsigned int ms);
+void    countdown(Timer* timer, unsigned int seconds);
+int     left_ms(Timer* timer);
+
+/******************************************************************************************************************
+ * simulation control
+ *
+ */
+
+typedef struct {
+    uint32  m_ScanChannelMs;                    // time spent on each channel of a scan
+    uint32  m_SearchMs;                         // time the station needs to find the AP; skipped when BSSID and channel are given
+    uint32  m_AssocMs;                          // authentication + association + 4-way handshake
+    uint32  m_DhcpMs;                           // DHCP exchange
+    uint32  m_RetryMs;                          // SDK internal reconnect interval after a failed attempt
+    uint32  m_ArpMs;                            // gateway ARP round trip
+    uint32  m_DtimMs;                           // the APs' DTIM period (beacon interval x DTIM count)
+    uint32  m_WakeMs;                           // radio on per DTIM beacon listened to while sleeping
+    uint32  m_FrameUs;                          // channel access, preamble and ACK of one frame
+    uint32  m_ByteNs;                           // air time per byte at the data rate actually achieved
+} WIFI_HostTiming;
+
+typedef struct {
+    uint32  m_Scans;                            // wifi_station_scan()
+    uint32  m_ScanMs;                           // time spent scanning
+    uint32  m_ScanResults;                      // bss_info entries handed to scan callbacks
+    uint32  m_ScanCallbacks;
+    uint64_t m_ScanCallbackNs;                  // host CPU time spent inside scan callbacks
+    uint32  m_SetOpmode;                        // wifi_set_opmode() + wifi_set_opmode_current()
+    uint32  m_ConfigWrites;                     // station + softAP set_config, both variants
+    uint32  m_FlashWrites;                      // SDK calls that persist to flash
+    uint32  m_FlashReads;                       // SDK calls that read the persisted config (the _default getters and such)
+    uint32  m_Connects;                         // wifi_station_connect()
+    uint32  m_Assocs;                           // association attempts (probe + auth), the SDK's own retries included
+    uint32  m_StatusPolls;                      // wifi_station_get_connect_status()
+    uint32  m_StationLists;                     // wifi_softap_get_station_info()
+    uint32  m_RadioOnMs;                        // receiver/transmitter powered
+    uint32  m_PbufAllocs;                       // pbuf_alloc(), the header pbufs udp_sendto_if() adds included
+    uint32  m_UdpTx;                            // datagrams sent
+    uint32  m_UdpTxBytes;                       // UDP payload bytes sent
+    uint32  m_UdpForwarded;                     // datagrams sent in the pbuf they were received in
+    uint32  m_UdpRx;                            // datagrams handed to a udp_recv() callback
+    uint32  m_UdpDropped;                       // sends refused because the transmit queue was full
+} WIFI_HostCounters;
+
+// a datagram has left the antenna
+typedef void (*WIFI_HostUdpSink)(uint8 if_index, const ip_addr_t* dst, const void* data, uint16 length, uint64_t done_us, void* ptr);
+
+// one simulated chip: its SDK state, RTC memory and flash
+typedef struct HostNode WIFI_HostNode;
+
+/**
+ * reset the fake SDK (AP table, station, softAP, pending callbacks, counters); the virtual clock keeps running
+ */
+void WIFI_HostReset(void);
+/**
+ * lose RTC memory as well; flash (persisted opmode/config/auto connect) survives both
+ */
+void WIFI_HostPowerCycle(void);
+/**
+ * another chip, reset and with the selected one's clock; the first one always exists
+ * 
+ * @return NULL when out of memory
+ */
+WIFI_HostNode* WIFI_HostNodeNew(void);
+/**
+ * 
+ * @param node
+ */
+void WIFI_HostNodeFree(WIFI_HostNode* node);
+/**
+ * make every SDK call and every other WIFI_Host*() function act on 'node'; the SDK callbacks it delivers go to the
+ * WIFI_Ctx of the last WIFI_Ctx*() call, so select the matching one (e.g. with WIFI_CtxRun()) before advancing
+ * 
+ * @param node      NULL for the first one
+ * @return the node selected until now
+ */
+WIFI_HostNode* WIFI_HostSelect(WIFI_HostNode* node);
+/**
+ * 
+ * @param timing
+ */
+void WIFI_HostSetTiming(const WIFI_HostTiming* timing);
+/**
+ * 
+ * @param timing
+ */
+void WIFI_HostGetTiming(WIFI_HostTiming* timing);
+/**
+ * 
+ * @param verbose
+ */
+void WIFI_HostSetVerbose(int verbose);
+/**
+ * 
+ * @param mac
+ */
+void WIFI_HostSetMAC(const uint8* mac);
+/**
+ * 
+ * @param ssid
+ * @param psw       NULL or "" for an open AP
+ * @param bssid
+ * @param channel
+ * @param rssi
+ * @return index of the AP or -1
+ */
+int WIFI_HostAddAP(const char* ssid, const char* psw, const uint8* bssid, uint8 channel, sint8 rssi);
+/**
+ * make an AP visible only within [from_ms, until_ms) after the last reset; until_ms == 0 means forever
+ * 
+ * @param ap
+ * @param from_ms
+ * @param until_ms
+ * @return 
+ */
+int WIFI_HostScheduleAP(int ap, uint32 from_ms, uint32 until_ms);
+/**
+ * 
+ * @param ap
+ * @param rssi
+ * @return 
+ */
+int WIFI_HostSetAPRssi(int ap, sint8 rssi);
+/**
+ * a full AP rejects the association with REASON_ASSOC_TOOMANY, like a softAP at max_connection
+ * 
+ * @param ap
+ * @param full
+ * @return 
+ */
+int WIFI_HostSetAPFull(int ap, int full);
+/**
+ * a softAP that renames itself; stations on it stay
+ * 
+ * @param ap
+ * @param ssid
+ * @return 
+ */
+int WIFI_HostSetAPSsid(int ap, const char* ssid);
+/**
+ * 
+ * @return the AP the station is associated with (DHCP running or done), or -1
+ */
+int WIFI_HostConnectedAP(void);
+/**
+ * associate a client with our softAP
+ * 
+ * @param mac
+ * @param ip
+ * @return 
+ */
+int WIFI_HostAddStation(const uint8* mac, uint32 ip);
+/**
+ * 
+ * @param mac
+ * @return 
+ */
+int WIFI_HostRemoveStation(const uint8* mac);
+/**
+ * receive a datagram on 'if_index' from 'src'; it goes to the udp_recv() callback bound to 'port' right away, the
+ * sender's air time is the sender's
+ * 
+ * @param if_index
+ * @param src
+ * @param port
+ * @param data
+ * @param length
+ * @return 
+ */
+int WIFI_HostUdpInject(uint8 if_index, const ip_addr_t* src, uint16 port, const void* data, uint16 length);
+/**
+ * 
+ * @param sink      called for every datagram sent, when its transmission ends
+ * @param ptr
+ */
+void WIFI_HostSetUdpSink(WIFI_HostUdpSink sink, void* ptr);
+/**
+ * 
+ * @return virtual time in microseconds, for the UDP air time model
+ */
+uint64_t WIFI_HostNowUs(void);
+/**
+ * 
+ * @return virtual time in milliseconds
+ */
+uint32 WIFI_HostNow(void);
+/**
+ * 
+ * @return milliseconds since the last WIFI_HostReset()
+ */
+uint32 WIFI_HostElapsed(void);
+/**
+ * 
+ * @param counters
+ */
+void WIFI_HostGetCounters(WIFI_HostCounters* counters);
+/**
+ * advance the virtual clock, delivering scan results and Wi-Fi events as they become due
+ * 
+ * @param ms
+ */
+void WIFI_HostAdvance(uint32 ms);
+/**
+ * call WIFI_Run() every step_ms of virtual time for duration_ms
+ * 
+ * @param duration_ms
+ * @param step_ms
+ */
+void WIFI_HostRun(uint32 duration_ms, uint32 step_ms);
+/**
+ * WIFI_Wakeup hook for the host: makes WIFI_HostRunTickless() call WIFI_Run() now
+ * 
+ * @param ptr       unused
+ */
+void WIFI_HostWake(void* ptr);
+/**
+ * call WIFI_Run() only when it asks for it (its return value) or WIFI_HostWake()
+ * fires, for duration_ms of virtual time
+ * 
+ * @param duration_ms
+ * @return number of WIFI_Run() calls
+ */
+uint32 WIFI_HostRunTickless(uint32 duration_ms);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* WIFI_HOST_H */
@@ -0,0 +1,1429 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+#if defined(WIFI_HOST)
+
+#include "wifi_host_bench.h"
+#include <stdlib.h>
+
+#define BENCH_MAX_RUNS          1000
+#define BENCH_STEP_MS           10
+#define BENCH_LIMIT_MS          120000
+#define BENCH_LATE_AP_MS        20000
+#define BENCH_NEIGHBOURS        5
+#define BENCH_DENSE_NEIGHBOURS  60
+#define BENCH_CALLBACK_APS      50
+#define BENCH_CALLBACK_MAX_APS  64
+#define BENCH_CALLBACK_MS       600000
+#define BENCH_REBOOT_DOWN_MS    30000
+#define BENCH_REBOOT_UP_MS      90000
+#define BENCH_STORM_BIN_MS      100
+#define BENCH_STORM_BINS        (BENCH_LIMIT_MS / BENCH_STORM_BIN_MS)
+#define BENCH_POWER_MS          3600000
+#define BENCH_POWER_STEP_MS     100
+#define BENCH_MESH_MAX_NODES    48
+#define BENCH_MESH_SPACING_M    20                                              // grid; the root sits in the corner next to the router
+#define BENCH_MESH_VISIBLE_DBM  -90
+#define BENCH_MESH_CHILDREN     4                                               // softap_config.max_connection
+#define BENCH_MESH_LEAF_EVERY   4
+#define BENCH_FORWARD_MS        2000
+#define BENCH_FORWARD_DRAIN_MS  1000
+#define BENCH_FORWARD_MAX       20000                                           // messages
+#define BENCH_FORWARD_LENGTH    500                                             // longest message
+#define BENCH_ROUTES_MS         3600000
+#define BENCH_ROUTES_STEP_MS    100
+#define BENCH_ROUTES_CHURN_MS   30000
+#define BENCH_ROUTES_MAX        64                                              // descendants
+
+#define BENCH_PREFIX            "bench"
+#define BENCH_SSID              "bench_ap"
+#define BENCH_PSW               "bench_psw"
+#define BENCH_ROOT_SSID         "bench_100_5CCF7F0000FF"                        // a mesh root's softAP, see build_mesh_ap_ssid()
+
+/******************************************************************************************************************
+ * local var's
+ *
+ */
+
+static uint32 bench_connected_at;
+static uint32 bench_seed;
+static uint8  bench_swapped;
+static uint8  bench_resume;                                                     // boot with WIFI_Resume() when it has a record
+static uint64_t bench_init_ns;
+#if defined(WITH_MESH_UDP)
+static WIFI_HostForward bench_forward;
+static int      bench_forward_hops;
+static uint32   bench_forward_samples[BENCH_FORWARD_MAX];
+static uint64_t bench_forward_bytes;
+static uint64_t bench_forward_last;                                             // us; last message out of the chain
+static uint64_t bench_forward_ns;
+static uint32   bench_forward_count;                                            // datagrams passed on by the sink
+#endif
+
+static WIFI_AP bench_list[] = {
+    { "bench_other_1",  "other_psw" },
+    { BENCH_SSID,       BENCH_PSW },
+    { "bench_other_2",  "other_psw" },
+    { NULL,             NULL }
+};
+
+static const char* mode_names[] = {
+    "ap_fixed",
+    "ap_fixed_auto",
+    "mesh_root",
+    "mesh_non_leaf",
+    "mesh_leaf"
+};
+
+static const char* policy_names[] = {
+    "low_latency",
+    "balanced",
+    "low"
+};
+
+static const char* scenario_names[] = {
+    "normal",
+    "wrong_password",
+    "no_ap",
+    "late_ap",
+    "wake",
+    "dense",
+    "ap_reboot"
+};
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param status
+ * @param ptr
+ */
+static void bench_on_connect(uint8_t status, void* ptr);
+/**
+ * 
+ * @param lo
+ * @param hi
+ * @return 
+ */
+static uint32 bench_rand(uint32 lo, uint32 hi);
+/**
+ * 
+ * @param mode
+ * @param scenario
+ */
+static void bench_setup(WIFI_Mode mode, WIFI_HostScenario scenario);
+/**
+ * 
+ * @param mode
+ * @param scenario
+ */
+static void bench_boot(WIFI_Mode mode, WIFI_HostScenario scenario);
+/**
+ * 
+ * @param a
+ * @param b
+ * @return 
+ */
+static int bench_compare(const void* a, const void* b);
+/**
+ * 
+ */
+static void bench_timing(void);
+/**
+ * log-distance path loss, exponent 3, -40 dBm at 1 m, +-3 dB of fading
+ * 
+ * @param dx        metres
+ * @param dy
+ * @return 
+ */
+static sint8 bench_rssi(int dx, int dy);
+#if defined(WITH_MESH_UDP)
+/**
+ * the node sent a datagram; pass it on to the next hop of the chain, or take the messages out at the end of it
+ * 
+ * @param if_index
+ * @param dst
+ * @param data
+ * @param length
+ * @param done_us
+ * @param ptr
+ */
+static void bench_forward_sink(uint8 if_index, const ip_addr_t* dst, const void* data, uint16 length, uint64_t done_us, void* ptr);
+#endif
+
+/******************************************************************************************************************
+ * public functions
+ *
+ */
+
+/**
+ * 
+ * @param mode
+ * @param scenario
+ * @param runs
+ * @param report
+ * @return 
+ */
+int WIFI_HostBenchmark(WIFI_Mode mode, WIFI_HostScenario scenario, int runs, WIFI_HostReport* report)
+{
+    static uint32 samples[BENCH_MAX_RUNS];
+    
+    int run;
+    
+    if(runs <= 0 || runs > BENCH_MAX_RUNS) {
+        return -1;
+    }
+    
+    memset(report, 0, sizeof(*report));
+    
+    for(run = 0; run < runs; run++) {
+        bench_seed = 0x2545F491u * (uint32)(run + 1);
+        
+        bench_setup(mode, scenario);
+        
+        while(bench_connected_at == 0 && WIFI_HostElapsed() < BENCH_LIMIT_MS) {
+            WIFI_Run();
+            WIFI_HostAdvance(BENCH_STEP_MS);
+            
+            report->m_Iterations++;
+        }
+        
+        WIFI_HostCounters c;
+        
+        WIFI_HostGetCounters(&c);
+        
+        report->m_Counters.m_Scans        += c.m_Scans;
+        report->m_Counters.m_ScanMs       += c.m_ScanMs;
+        report->m_Counters.m_ScanResults  += c.m_ScanResults;
+        report->m_Counters.m_SetOpmode    += c.m_SetOpmode;
+        report->m_Counters.m_ConfigWrites += c.m_ConfigWrites;
+        report->m_Counters.m_FlashWrites  += c.m_FlashWrites;
+        report->m_Counters.m_Connects     += c.m_Connects;
+        report->m_Counters.m_FlashReads   += c.m_FlashReads;
+        report->m_InitNs                  += bench_init_ns;
+        
+        if(bench_connected_at != 0) {
+            report->m_Connected++;
+            samples[run] = bench_connected_at;
+        }
+        else {
+            samples[run] = BENCH_LIMIT_MS;
+        }
+    }
+    
+    qsort(samples, (size_t)runs, sizeof(samples[0]), bench_compare);
+    
+    report->m_Runs = (uint32)runs;
+    report->m_P50  = samples[((runs - 1) * 50) / 100];
+    report->m_P99  = samples[((runs - 1) * 99) / 100];
+    
+    return 0;
+}
+/**
+ * 
+ * @param mode
+ * @param scenario
+ * @param report
+ */
+void WIFI_HostBenchmarkPrint(WIFI_Mode mode, WIFI_HostScenario scenario, const WIFI_HostReport* report)
+{
+    double n = (report->m_Runs != 0) ? (double)report->m_Runs : 1.0;
+    
+    printf("%-14s %-15s %4u/%-4u p50 %6u ms  p99 %6u ms  run() %8.1f  scan %5.1f (%6.0f ms, %6.1f bss)  opmode %5.1f  config %5.1f  flash %5.1f\n",
+            mode_names[mode],
+            scenario_names[scenario],
+            report->m_Connected,
+            report->m_Runs,
+            report->m_P50,
+            report->m_P99,
+            report->m_Iterations / n,
+            report->m_Counters.m_Scans / n,
+            report->m_Counters.m_ScanMs / n,
+            report->m_Counters.m_ScanResults / n,
+            report->m_Counters.m_SetOpmode / n,
+            report->m_Counters.m_ConfigWrites / n,
+            report->m_Counters.m_FlashWrites / n);
+}
+/**
+ * 
+ * @param aps
+ * @param visible
+ * @param ns
+ * @return 
+ */
+int WIFI_HostBenchmarkScanCallback(int aps, int visible, uint32* ns)
+{
+    static WIFI_AP list[BENCH_CALLBACK_MAX_APS + 1];
+    static char    names[BENCH_CALLBACK_MAX_APS][24];
+    
+    uint8 bssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    int   i;
+    
+    if(aps > BENCH_CALLBACK_MAX_APS) {
+        return -1;
+    }
+    
+    WIFI_HostPowerCycle();
+    WIFI_HostSetVerbose(0);
+    
+    for(i = 0; i < aps; i++) {
+        os_sprintf(names[i], "office_%02d", i);
+        
+        list[i].ssid = names[i];
+        list[i].psw  = BENCH_PSW;
+    }
+    
+    list[aps].ssid = NULL;
+    list[aps].psw  = NULL;
+    
+    for(i = 0; i < visible; i++) {
+        char ssid[24];
+        
+        os_sprintf(ssid, "visitor_%02d", i);
+        
+        bssid[5] = (uint8)i;
+        WIFI_HostAddAP(ssid, "visitor_psw", bssid, (uint8)(1 + i % 13), -70);
+    }
+    
+    WIFI_InitializeEx(list);
+    WIFI_HostRun(BENCH_CALLBACK_MS, BENCH_STEP_MS);
+    
+    WIFI_HostCounters c;
+    
+    WIFI_HostGetCounters(&c);
+    
+    *ns = (c.m_ScanCallbacks != 0) ? (uint32)(c.m_ScanCallbackNs / c.m_ScanCallbacks) : 0;
+    
+    return 0;
+}
+/**
+ * 
+ * @param mode
+ * @param nodes
+ * @param storm
+ * @return 
+ */
+int WIFI_HostBenchmarkStorm(WIFI_Mode mode, int nodes, WIFI_HostStorm* storm)
+{
+    static uint32 samples[BENCH_MAX_RUNS];
+    static uint32 bins[BENCH_STORM_BINS];
+    
+    int node;
+    int i;
+    
+    if(nodes <= 0 || nodes > BENCH_MAX_RUNS) {
+        return -1;
+    }
+    
+    memset(storm, 0, sizeof(*storm));
+    memset(bins, 0, sizeof(bins));
+    
+    for(node = 0; node < nodes; node++) {
+        uint8  mac[6] = { 0x5c, 0xcf, 0x7f, 0x01, 0x00, 0x00 };
+        uint32 assocs = 0;
+        
+        bench_seed = 0x2545F491u * (uint32)(node + 1);
+        
+        bench_setup(mode, host_scenario_ap_reboot);
+        
+        mac[4] = (uint8)(node >> 8);
+        mac[5] = (uint8)node;
+        WIFI_HostSetMAC(mac);                                                   // each node draws its own jitter
+        
+        samples[node] = BENCH_LIMIT_MS;
+        
+        while(WIFI_HostElapsed() < BENCH_REBOOT_UP_MS + BENCH_LIMIT_MS) {
+            WIFI_HostCounters c;
+            uint32            now;
+            
+            WIFI_Run();
+            WIFI_HostAdvance(BENCH_STEP_MS);
+            
+            WIFI_HostGetCounters(&c);
+            
+            now = WIFI_HostElapsed();
+            
+            if(now > BENCH_REBOOT_UP_MS && c.m_Assocs != assocs) {
+                bins[(now - BENCH_REBOOT_UP_MS - 1) / BENCH_STORM_BIN_MS] += c.m_Assocs - assocs;
+            }
+            
+            assocs = c.m_Assocs;
+            
+            if(now == BENCH_REBOOT_DOWN_MS) {
+                bench_connected_at = 0;                                         // only the reconnect counts
+            }
+            else if(now > BENCH_REBOOT_UP_MS && bench_connected_at != 0) {
+                samples[node] = bench_connected_at - BENCH_REBOOT_UP_MS;
+                storm->m_Reconnected++;
+                break;
+            }
+        }
+        
+        storm->m_Attempts += assocs;
+    }
+    
+    for(i = 0; i < BENCH_STORM_BINS; i++) {
+        if(bins[i] > storm->m_Peak) {
+            storm->m_Peak = bins[i];
+        }
+    }
+    
+    qsort(samples, (size_t)nodes, sizeof(samples[0]), bench_compare);
+    
+    storm->m_Nodes = (uint32)nodes;
+    storm->m_P50   = samples[((nodes - 1) * 50) / 100];
+    storm->m_P99   = samples[((nodes - 1) * 99) / 100];
+    
+    return 0;
+}
+/**
+ * 
+ * @param mode
+ * @param resume
+ * @param runs
+ * @param report
+ * @return 
+ */
+int WIFI_HostBenchmarkResume(WIFI_Mode mode, int resume, int runs, WIFI_HostReport* report)
+{
+    int rc;
+    
+    bench_resume = (resume != 0) ? 1 : 0;
+    
+    rc = WIFI_HostBenchmark(mode, host_scenario_wake, runs, report);
+    
+    bench_resume = 0;
+    
+    return rc;
+}
+/**
+ * 
+ * @param mode
+ * @param policy
+ * @param runs
+ * @param power
+ * @return 
+ */
+int WIFI_HostBenchmarkPower(WIFI_Mode mode, WIFI_PowerPolicy policy, int runs, WIFI_HostPower* power)
+{
+    static uint32 samples[BENCH_MAX_RUNS];
+    
+    uint64_t radio = 0;
+    uint64_t polls = 0;
+    int      run;
+    
+    if(runs <= 0 || runs > BENCH_MAX_RUNS) {
+        return -1;
+    }
+    
+    memset(power, 0, sizeof(*power));
+    
+    WIFI_SetPowerPolicy(policy);
+    
+    for(run = 0; run < runs; run++) {
+        WIFI_HostCounters before;
+        WIFI_HostCounters after;
+        
+        bench_seed = 0x2545F491u * (uint32)(run + 1);
+        
+        bench_setup(mode, host_scenario_normal);
+        
+        while(bench_connected_at == 0 && WIFI_HostElapsed() < BENCH_LIMIT_MS) {
+            WIFI_Run();
+            WIFI_HostAdvance(BENCH_STEP_MS);
+        }
+        
+        if(bench_connected_at == 0) {
+            samples[run] = BENCH_LIMIT_MS;
+            continue;
+        }
+        
+        samples[run] = bench_connected_at;
+        
+        WIFI_HostGetCounters(&before);
+        WIFI_HostRun(BENCH_POWER_MS, BENCH_POWER_STEP_MS);
+        WIFI_HostGetCounters(&after);
+        
+        radio += after.m_RadioOnMs - before.m_RadioOnMs;
+        polls += after.m_StatusPolls - before.m_StatusPolls;
+        
+        power->m_Connected++;
+    }
+    
+    WIFI_SetPowerPolicy(power_balanced);
+    
+    qsort(samples, (size_t)runs, sizeof(samples[0]), bench_compare);
+    
+    power->m_Runs = (uint32)runs;
+    power->m_P50  = samples[((runs - 1) * 50) / 100];
+    
+    if(power->m_Connected != 0) {
+        power->m_RadioOnMs = (uint32)(radio / power->m_Connected);
+        power->m_Polls     = (uint32)(polls / power->m_Connected);
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param mode
+ * @param tickless
+ * @param runs
+ * @param report
+ * @return 
+ */
+int WIFI_HostBenchmarkTickless(WIFI_Mode mode, int tickless, int runs, WIFI_HostTickless* report)
+{
+    static uint32 samples[BENCH_MAX_RUNS];
+    
+    uint64_t boot = 0;
+    uint64_t hour = 0;
+    int      run;
+    
+    if(runs <= 0 || runs > BENCH_MAX_RUNS) {
+        return -1;
+    }
+    
+    memset(report, 0, sizeof(*report));
+    
+    for(run = 0; run < runs; run++) {
+        bench_seed = 0x2545F491u * (uint32)(run + 1);
+        
+        bench_setup(mode, host_scenario_normal);
+        
+        if(tickless != 0) {
+            boot += WIFI_HostRunTickless(BENCH_LIMIT_MS);
+        }
+        else {
+            WIFI_HostRun(BENCH_LIMIT_MS, BENCH_POWER_STEP_MS);
+            
+            boot += BENCH_LIMIT_MS / BENCH_POWER_STEP_MS;
+        }
+        
+        if(bench_connected_at == 0) {
+            samples[run] = BENCH_LIMIT_MS;
+            continue;
+        }
+        
+        samples[run] = bench_connected_at;
+        
+        if(tickless != 0) {
+            hour += WIFI_HostRunTickless(BENCH_POWER_MS);
+        }
+        else {
+            WIFI_HostRun(BENCH_POWER_MS, BENCH_POWER_STEP_MS);
+            
+            hour += BENCH_POWER_MS / BENCH_POWER_STEP_MS;
+        }
+        
+        report->m_Connected++;
+    }
+    
+    WIFI_SetWakeup(NULL, NULL);
+    
+    qsort(samples, (size_t)runs, sizeof(samples[0]), bench_compare);
+    
+    report->m_Runs      = (uint32)runs;
+    report->m_P50       = samples[((runs - 1) * 50) / 100];
+    report->m_BootCalls = (uint32)(boot / (uint32)runs);
+    
+    if(report->m_Connected != 0) {
+        report->m_HourCalls = (uint32)(hour / report->m_Connected);
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param nodes
+ * @param mesh
+ * @return 
+ */
+int WIFI_HostBenchmarkMesh(int nodes, WIFI_HostMesh* mesh)
+{
+    static uint32 samples[BENCH_MESH_MAX_NODES];
+    static char   ssid[BENCH_MESH_MAX_NODES][33];                               // softAP of a joined non-leaf, "" otherwise
+    static uint8  bssid[BENCH_MESH_MAX_NODES][6];
+    static sint8  depth[BENCH_MESH_MAX_NODES];
+    static uint8  children[BENCH_MESH_MAX_NODES];
+    static int    order[BENCH_MESH_MAX_NODES];
+    
+    const uint8 router[6] = { 0x02, 0x00, 0x00, 0x00, 0xAA, 0x01 };
+    int         columns   = 1;
+    int         i;
+    int         j;
+    
+    if(nodes <= 0 || nodes > BENCH_MESH_MAX_NODES) {
+        return -1;
+    }
+    
+    memset(mesh, 0, sizeof(*mesh));
+    memset(ssid, 0, sizeof(ssid));
+    memset(children, 0, sizeof(children));
+    
+    while(columns * columns < nodes) {
+        columns++;
+    }
+    
+    // nearest to the root first, so that every node has somewhere to go
+    for(i = 0; i < nodes; i++) {
+        int d = (i % columns) * (i % columns) + (i / columns) * (i / columns);
+        
+        for(j = i; j > 0 && (order[j - 1] % columns) * (order[j - 1] % columns) + (order[j - 1] / columns) * (order[j - 1] / columns) > d; j--) {
+            order[j] = order[j - 1];
+        }
+        
+        order[j] = i;
+    }
+    
+    for(i = 0; i < nodes; i++) {
+        int               node   = order[i];
+        int               x      = (node % columns) * BENCH_MESH_SPACING_M;
+        int               y      = (node / columns) * BENCH_MESH_SPACING_M;
+        uint8             mac[6] = { 0x5c, 0xcf, 0x7f, 0x02, 0x00, (uint8)node };
+        WIFI_Mode         mode   = (node == 0) ? mesh_root : (node % BENCH_MESH_LEAF_EVERY == BENCH_MESH_LEAF_EVERY - 1) ? mesh_leaf : mesh_non_leaf;
+        WIFI_HostCounters c;
+        sint8             rssi;
+        
+        bench_seed = 0x2545F491u * (uint32)(node + 1);
+        
+        WIFI_HostPowerCycle();
+        WIFI_HostSetVerbose(0);
+        WIFI_HostSetMAC(mac);
+        
+        bench_timing();
+        
+        rssi = bench_rssi(x + BENCH_MESH_SPACING_M / 2, y + BENCH_MESH_SPACING_M / 2);
+        
+        if(rssi >= BENCH_MESH_VISIBLE_DBM) {
+            WIFI_HostAddAP(BENCH_SSID, BENCH_PSW, router, 6, rssi);
+        }
+        
+        for(j = 0; j < nodes; j++) {
+            int ap;
+            
+            if(ssid[j][0] == '\0') {
+                continue;
+            }
+            
+            rssi = bench_rssi(x - (j % columns) * BENCH_MESH_SPACING_M, y - (j / columns) * BENCH_MESH_SPACING_M);
+            
+            if(rssi < BENCH_MESH_VISIBLE_DBM) {
+                continue;
+            }
+            
+            ap = WIFI_HostAddAP(ssid[j], "", bssid[j], 6, rssi);
+            
+            WIFI_HostSetAPFull(ap, children[j] >= BENCH_MESH_CHILDREN);
+        }
+        
+        bench_connected_at = 0;
+        
+        WIFI_MeshInitialize(mode, BENCH_SSID, BENCH_PSW, BENCH_PREFIX, NULL);
+        WIFI_SetCallback(bench_on_connect, NULL, NULL);
+        
+        while(bench_connected_at == 0 && WIFI_HostElapsed() < BENCH_LIMIT_MS) {
+            WIFI_Run();
+            WIFI_HostAdvance(BENCH_STEP_MS);
+        }
+        
+        WIFI_HostGetCounters(&c);
+        
+        mesh->m_Scans  += c.m_Scans;
+        mesh->m_Assocs += c.m_Assocs;
+        
+        if(bench_connected_at == 0) {
+            samples[i] = BENCH_LIMIT_MS;
+            continue;
+        }
+        
+        samples[i]  = bench_connected_at;
+        depth[node] = 0;
+        
+        if(node != 0) {
+            struct station_config parent;
+            
+            wifi_station_get_config(&parent);
+            
+            for(j = 0; j < nodes; j++) {
+                if(ssid[j][0] != '\0' && memcmp(parent.bssid, bssid[j], sizeof(bssid[j])) == 0) {
+                    depth[node] = (sint8)(depth[j] + 1);
+                    children[j]++;
+                    break;
+                }
+            }
+        }
+        
+        if(mode != mesh_leaf) {
+            struct softap_config ap;
+            
+            wifi_softap_get_config(&ap);
+            
+            memcpy(ssid[node], ap.ssid, sizeof(ap.ssid));
+            memcpy(bssid[node], mac, sizeof(bssid[node]));
+            bssid[node][0] = 0x5e;                                              // softAP MAC, locally administered
+        }
+        
+        mesh->m_Joined++;
+        mesh->m_Depth += (uint32)depth[node];
+        
+        if((uint32)depth[node] > mesh->m_MaxDepth) {
+            mesh->m_MaxDepth = (uint32)depth[node];
+        }
+    }
+    
+    qsort(samples, (size_t)nodes, sizeof(samples[0]), bench_compare);
+    
+    mesh->m_Nodes = (uint32)nodes;
+    mesh->m_P50   = samples[((nodes - 1) * 50) / 100];
+    mesh->m_P99   = samples[((nodes - 1) * 99) / 100];
+    
+    return 0;
+}
+#if defined(WITH_MESH_UDP)
+/**
+ * 
+ * @param hops
+ * @param batch_ms
+ * @param length
+ * @param rate
+ * @param forward
+ * @return 
+ */
+int WIFI_HostBenchmarkForward(int hops, int batch_ms, int length, int rate, WIFI_HostForward* forward)
+{
+    uint8             message[BENCH_FORWARD_LENGTH];
+    WIFI_HostCounters before;
+    WIFI_HostCounters after;
+    uint64_t          start;
+    uint32            due = 0;                                                  // messages owed, x 1000
+    uint32            n;
+    
+    if(hops <= 0 || length < (int)sizeof(uint64_t) || length > BENCH_FORWARD_LENGTH || rate <= 0) {
+        return -1;
+    }
+    
+    memset(&bench_forward, 0, sizeof(bench_forward));
+    memset(message, 0xA5, sizeof(message));
+    
+    bench_forward_hops  = hops;
+    bench_forward_bytes = 0;
+    bench_forward_last  = 0;
+    bench_forward_ns    = 0;
+    bench_forward_count = 0;
+    bench_seed          = 0x2545F491u;
+    
+    bench_setup(mesh_non_leaf, host_scenario_normal);
+    
+    while(bench_connected_at == 0 && WIFI_HostElapsed() < BENCH_LIMIT_MS) {
+        WIFI_Run();
+        WIFI_HostAdvance(BENCH_STEP_MS);
+    }
+    
+    if(bench_connected_at == 0) {
+        return -1;
+    }
+    
+    WIFI_MeshSetBatching((uint16_t)batch_ms);
+    WIFI_HostSetUdpSink(bench_forward_sink, NULL);
+    WIFI_HostGetCounters(&before);
+    
+    start = WIFI_HostNowUs();
+    
+    for(n = 0; n < BENCH_FORWARD_MS + BENCH_FORWARD_DRAIN_MS; n++) {
+        for(due += (n < BENCH_FORWARD_MS) ? (uint32)rate : 0; due >= 1000; due -= 1000) {
+            uint64_t now = WIFI_HostNowUs();
+            
+            memcpy(message, &now, sizeof(now));                                 // sent at, read back at the end of the chain
+            
+            if(WIFI_MeshSend(message, (uint16_t)length) == 0) {
+                bench_forward.m_Sent++;
+            }
+            else {
+                bench_forward.m_Refused++;
+            }
+        }
+        
+        WIFI_Run();
+        WIFI_HostAdvance(1);
+    }
+    
+    WIFI_HostGetCounters(&after);
+    WIFI_HostSetUdpSink(NULL, NULL);
+    WIFI_MeshSetBatching(20);
+    
+    if(bench_forward.m_Delivered > 0) {
+        qsort(bench_forward_samples, (size_t)bench_forward.m_Delivered, sizeof(bench_forward_samples[0]), bench_compare);
+        
+        bench_forward.m_P50Us = bench_forward_samples[((bench_forward.m_Delivered - 1) * 50) / 100];
+        bench_forward.m_P99Us = bench_forward_samples[((bench_forward.m_Delivered - 1) * 99) / 100];
+    }
+    
+    if(bench_forward_count > 0) {
+        bench_forward.m_ForwardNs = (uint32)(bench_forward_ns / bench_forward_count);
+    }
+    
+    if(bench_forward_last > start) {
+        bench_forward.m_Kbps = (uint32)(bench_forward_bytes * 8000u / (bench_forward_last - start));
+    }
+    
+    bench_forward.m_PbufAllocs = after.m_PbufAllocs - before.m_PbufAllocs;
+    bench_forward.m_ZeroCopy   = after.m_UdpForwarded - before.m_UdpForwarded;
+    
+    *forward = bench_forward;
+    
+    return 0;
+}
+#endif
+/**
+ * 
+ * @param children
+ * @param descendants
+ * @param routes
+ * @return 
+ */
+int WIFI_HostBenchmarkRoutes(int children, int descendants, WIFI_HostRoutes* routes)
+{
+    uint8             present[8]                    = { 0 };
+    uint8             announced[BENCH_ROUTES_MAX]   = { 0 };                    // sent a message since its child joined
+    uint64_t          ns                            = 0;
+    WIFI_HostCounters before;
+    WIFI_HostCounters after;
+    uint32            t;
+    int               k;
+    int               d;
+    
+    if(children <= 0 || children > 8 || descendants < 0 || descendants > BENCH_ROUTES_MAX) {
+        return -1;
+    }
+    
+#if !defined(WITH_MESH_UDP)
+    descendants = 0;                                                            // only learnt from forwarded messages
+#endif
+    
+    memset(routes, 0, sizeof(*routes));
+    
+    bench_seed = 0x2545F491u;
+    
+    bench_setup(mesh_non_leaf, host_scenario_normal);
+    
+    while(bench_connected_at == 0 && WIFI_HostElapsed() < BENCH_LIMIT_MS) {
+        WIFI_Run();
+        WIFI_HostAdvance(BENCH_STEP_MS);
+    }
+    
+    if(bench_connected_at == 0) {
+        return -1;
+    }
+    
+    WIFI_HostGetCounters(&before);
+    
+    for(t = 0; t < BENCH_ROUTES_MS; t += BENCH_ROUTES_STEP_MS) {
+        uint8 mac[6] = { 0x02, 0x00, 0x00, 0x01, 0x00, 0x00 };
+        
+        k = -1;
+        
+        if(t < (uint32)children * BENCH_ROUTES_STEP_MS) {
+            k = (int)(t / BENCH_ROUTES_STEP_MS);                                // all of them to begin with, one per step
+        }
+        else if(t % BENCH_ROUTES_CHURN_MS == 0) {
+            k = (int)bench_rand(0, (uint32)children - 1);
+        }
+        
+        if(k >= 0) {
+            mac[5] = (uint8)k;
+            
+            if(present[k] == 0) {
+                WIFI_HostAddStation(mac, 0x0A04A8C0u + ((uint32)k << 24));      // 192.168.4.10 + k
+            }
+            else {
+                WIFI_HostRemoveStation(mac);
+                
+                for(d = k; d < descendants; d += children) {
+                    announced[d] = 0;
+                }
+            }
+            
+            present[k] ^= 1;
+            routes->m_Events++;
+        }
+        
+        WIFI_Run();
+        WIFI_HostAdvance(BENCH_ROUTES_STEP_MS);
+        
+#if defined(WITH_MESH_UDP)
+        if(t % 1000 == 0) {                                                     // once the lease is out
+            for(k = 0; k < children; k++) {
+                uint8     frame[4 + BENCH_ROUTES_MAX * 8] = { 0xE5, 1, 0, 0 };  // see mesh_udp_deliver()
+                uint16    length                          = 4;
+                ip_addr_t child;
+                
+                for(d = k; d < descendants && present[k] != 0; d += children) {
+                    uint8 record[8] = { 0x02, 0x00, 0x00, 0x02, 0x00, (uint8)d, 0, 0 };
+                    
+                    memcpy(frame + length, record, sizeof(record));
+                    
+                    length += sizeof(record);
+                    frame[3]++;
+                    announced[d] = 1;
+                }
+                
+                if(frame[3] != 0) {
+                    IP4_ADDR(&child, 192, 168, 4, 10 + k);
+                    
+                    WIFI_HostUdpInject(SOFTAP_IF, &child, WIFI_MESH_PORT, frame, length);
+                }
+            }
+        }
+#endif
+        
+        struct timespec t0;
+        struct timespec t1;
+        uint32          found = 0;
+        uint32          stale = 0;
+        
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        
+        for(k = 0; k < children + descendants; k++) {
+            uint8  mac[6] = { 0x02, 0x00, 0x00, 0x01, 0x00, (uint8)k };
+            int    via    = k;
+            uint8  known  = (k < children) ? present[k] : 0;
+            uint32 ip     = 0;
+            
+            if(k >= children) {
+                mac[3] = 0x02;
+                mac[5] = (uint8)(k - children);
+                via    = (k - children) % children;
+                known  = present[via] & announced[k - children];
+            }
+            
+            if(WIFI_MeshRoute(mac, &ip) == 0) {
+                found++;
+                stale += (known == 0 || ip != 0x0A04A8C0u + ((uint32)via << 24)) ? 1 : 0;
+            }
+            else {
+                stale += (known != 0) ? 1 : 0;
+            }
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        
+        ns += (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000u + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+        
+        routes->m_Lookups += (uint32)(children + descendants);
+        routes->m_Stale   += stale;
+        routes->m_Routes   = found;
+    }
+    
+    WIFI_HostGetCounters(&after);
+    
+    routes->m_StationLists = after.m_StationLists - before.m_StationLists;
+    routes->m_LookupNs     = (uint32)(ns / routes->m_Lookups);
+    
+    return 0;
+}
+/**
+ * 
+ * @param runs
+ * @return 
+ */
+int WIFI_HostBenchmarkSuite(int runs)
+{
+    int mode;
+    int scenario;
+    int nodes;
+    
+    printf("%-14s %-15s %9s  (per run averages; failed runs count as %u ms)\n", "mode", "scenario", "connected", BENCH_LIMIT_MS);
+    
+    for(mode = ap_fixed; mode <= mesh_leaf; mode++) {
+        for(scenario = host_scenario_normal; scenario <= host_scenario_dense; scenario++) {
+            WIFI_HostReport report;
+            
+            if(WIFI_HostBenchmark((WIFI_Mode)mode, (WIFI_HostScenario)scenario, runs, &report) != 0) {
+                return -1;
+            }
+            
+            WIFI_HostBenchmarkPrint((WIFI_Mode)mode, (WIFI_HostScenario)scenario, &report);
+        }
+    }
+    
+    printf("\n%-14s %-15s %11s  (%d nodes; AP down at %u ms, back at %u ms)\n", "mode", "policy", "reconnected", runs, BENCH_REBOOT_DOWN_MS, BENCH_REBOOT_UP_MS);
+    
+    for(mode = ap_fixed; mode <= mesh_root; mode++) {
+        WIFI_RetryPolicy lockstep;
+        int              jitter;
+        
+        // same backoff without jitter, then the defaults
+        for(jitter = 0; jitter <= 1; jitter++) {
+            WIFI_HostStorm storm;
+            
+            WIFI_SetRetryPolicy(NULL);
+            
+            if(jitter == 0) {
+                WIFI_GetRetryPolicy(&lockstep);
+                lockstep.jitter = 0;
+                WIFI_SetRetryPolicy(&lockstep);
+            }
+            
+            if(WIFI_HostBenchmarkStorm((WIFI_Mode)mode, runs, &storm) != 0) {
+                return -1;
+            }
+            
+            printf("%-14s %-15s %5u/%-5u  p50 %6u ms  p99 %6u ms  peak %4u assoc/%d ms  %6.1f assoc/node\n",
+                    mode_names[mode],
+                    (jitter == 0) ? "no jitter" : "default",
+                    storm.m_Reconnected,
+                    storm.m_Nodes,
+                    storm.m_P50,
+                    storm.m_P99,
+                    storm.m_Peak,
+                    BENCH_STORM_BIN_MS,
+                    (double)storm.m_Attempts / storm.m_Nodes);
+        }
+    }
+    
+    WIFI_SetRetryPolicy(NULL);
+    
+    printf("\n%-14s %-15s %9s  (%d runs; wake after a successful connect, per wake)\n", "mode", "boot", "connected", runs);
+    
+    for(mode = ap_fixed; mode <= mesh_root; mode++) {
+        int resume;
+        
+        for(resume = 0; resume <= 1; resume++) {
+            WIFI_HostReport report;
+            
+            if(WIFI_HostBenchmarkResume((WIFI_Mode)mode, resume, runs, &report) != 0) {
+                return -1;
+            }
+            
+            printf("%-14s %-15s %4u/%-4u p50 %6u ms  p99 %6u ms  flash reads %4.1f  opmode %4.1f  config %4.1f  flash writes %4.1f  init %6.1f us\n",
+                    mode_names[mode],
+                    (resume == 0) ? "initialize" : "resume",
+                    report.m_Connected,
+                    report.m_Runs,
+                    report.m_P50,
+                    report.m_P99,
+                    (double)report.m_Counters.m_FlashReads / report.m_Runs,
+                    (double)report.m_Counters.m_SetOpmode / report.m_Runs,
+                    (double)report.m_Counters.m_ConfigWrites / report.m_Runs,
+                    (double)report.m_Counters.m_FlashWrites / report.m_Runs,
+                    (double)report.m_InitNs / report.m_Runs / 1000.0);
+        }
+    }
+    
+    printf("\n%-14s %-15s %9s  (%d runs; one hour connected after init)\n", "mode", "power policy", "connected", runs);
+    
+    for(mode = ap_fixed; mode <= ap_fixed_auto; mode++) {
+        int policy;
+        
+        for(policy = power_low_latency; policy < power_policies; policy++) {
+            WIFI_HostPower power;
+            
+            if(WIFI_HostBenchmarkPower((WIFI_Mode)mode, (WIFI_PowerPolicy)policy, runs, &power) != 0) {
+                return -1;
+            }
+            
+            printf("%-14s %-15s %4u/%-4u p50 %6u ms  radio on %7.1f s/h (%5.1f%%)  link polls %4u/h\n",
+                    mode_names[mode],
+                    policy_names[policy],
+                    power.m_Connected,
+                    power.m_Runs,
+                    power.m_P50,
+                    power.m_RadioOnMs / 1000.0,
+                    power.m_RadioOnMs * 100.0 / BENCH_POWER_MS,
+                    power.m_Polls);
+        }
+    }
+    
+    printf("\n%-14s %-15s %9s  (%d runs; WIFI_Run() calls in the first %u s, then in an hour connected)\n", "mode", "main loop", "connected", runs, BENCH_LIMIT_MS / 1000);
+    
+    for(mode = ap_fixed; mode <= mesh_root; mode++) {
+        int tickless;
+        
+        for(tickless = 0; tickless <= 1; tickless++) {
+            WIFI_HostTickless report;
+            
+            if(WIFI_HostBenchmarkTickless((WIFI_Mode)mode, tickless, runs, &report) != 0) {
+                return -1;
+            }
+            
+            printf("%-14s %-15s %4u/%-4u p50 %6u ms  boot %6u calls  connected %6u calls/h\n",
+                    mode_names[mode],
+                    (tickless == 0) ? "poll 100 ms" : "tickless",
+                    report.m_Connected,
+                    report.m_Runs,
+                    report.m_P50,
+                    report.m_BootCalls,
+                    report.m_HourCalls);
+        }
+    }
+    
+    printf("\n%-14s %9s  (%d m grid, root in the corner, every %dth node a leaf, %d stations per softAP)\n", "nodes", "joined", BENCH_MESH_SPACING_M, BENCH_MESH_LEAF_EVERY, BENCH_MESH_CHILDREN);
+    
+    for(nodes = 9; nodes <= BENCH_MESH_MAX_NODES; nodes *= 2) {
+        WIFI_HostMesh mesh;
+        
+        if(WIFI_HostBenchmarkMesh(nodes, &mesh) != 0) {
+            return -1;
+        }
+        
+        printf("%-14u %4u/%-4u p50 %6u ms  p99 %6u ms  depth max %u mean %3.1f  scans %4.1f/node  assoc %4.1f/node\n",
+                mesh.m_Nodes,
+                mesh.m_Joined,
+                mesh.m_Nodes,
+                mesh.m_P50,
+                mesh.m_P99,
+                mesh.m_MaxDepth,
+                (mesh.m_Joined != 0) ? (double)mesh.m_Depth / mesh.m_Joined : 0.0,
+                (double)mesh.m_Scans / mesh.m_Nodes,
+                (double)mesh.m_Assocs / mesh.m_Nodes);
+    }
+    
+    printf("\n%-14s %-17s %11s  (one hour, a station joins or leaves every %d s)\n", "children", "below them", "stale", BENCH_ROUTES_CHURN_MS / 1000);
+    
+    for(nodes = 4; nodes <= 8; nodes *= 2) {
+        WIFI_HostRoutes routes;
+        
+        if(WIFI_HostBenchmarkRoutes(nodes, 4 * nodes, &routes) != 0) {
+            return -1;
+        }
+        
+        printf("%-14d %-17d %5u/%-7u routes %3u  events %4u  station lists %4u/h  %3u ns/lookup\n",
+                nodes,
+#if defined(WITH_MESH_UDP)
+                4 * nodes,
+#else
+                0,
+#endif
+                routes.m_Stale,
+                routes.m_Lookups,
+                routes.m_Routes,
+                routes.m_Events,
+                routes.m_StationLists,
+                routes.m_LookupNs);
+    }
+    
+#if defined(WITH_MESH_UDP)
+    printf("\n%-14s %-17s %11s  (%d s of sending; one channel, the chain shares it)\n", "hops", "load", "delivered", BENCH_FORWARD_MS / 1000);
+    
+    for(scenario = 0; scenario < 4; scenario++) {
+        static const int load[4][3] = {
+            { 20, 32, 50 },                                                     // batch ms, bytes, messages/s
+            { 0,  32, 50 },
+            { 20, 32, 2000 },
+            { 0,  32, 2000 }
+        };
+        
+        for(nodes = 1; nodes <= 8; nodes *= 2) {
+            WIFI_HostForward forward;
+            char             name[24];
+            
+            if(WIFI_HostBenchmarkForward(nodes, load[scenario][0], load[scenario][1], load[scenario][2], &forward) != 0) {
+                return -1;
+            }
+            
+            os_sprintf(name, "%d/s, batch %d", load[scenario][2], load[scenario][0]);
+            
+            printf("%-14d %-17s %5u/%-5u p50 %6u us  p99 %6u us  %5u kbit/s  %4.2f datagrams/msg  allocs %u  zero copy %u  %u ns/forward\n",
+                    nodes,
+                    name,
+                    forward.m_Delivered,
+                    forward.m_Sent + forward.m_Refused,
+                    forward.m_P50Us,
+                    forward.m_P99Us,
+                    forward.m_Kbps,
+                    (forward.m_Delivered != 0) ? (double)forward.m_Datagrams / forward.m_Delivered : 0.0,
+                    forward.m_PbufAllocs,
+                    forward.m_ZeroCopy,
+                    forward.m_ForwardNs);
+        }
+    }
+    
+#endif
+    uint32 ns;
+    
+    if(WIFI_HostBenchmarkScanCallback(BENCH_CALLBACK_APS, BENCH_DENSE_NEIGHBOURS, &ns) == 0) {
+        printf("scan_done_callback(): %d APs configured, %d BSSs visible: %u ns per callback\n", BENCH_CALLBACK_APS, BENCH_DENSE_NEIGHBOURS, ns);
+    }
+    
+    return 0;
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * 
+ * @param status
+ * @param ptr
+ */
+static void bench_on_connect(uint8_t status, void* ptr)
+{
+    if(bench_connected_at == 0) {
+        bench_connected_at = WIFI_HostElapsed();
+    }
+}
+/**
+ * 
+ * @param lo
+ * @param hi
+ * @return 
+ */
+static uint32 bench_rand(uint32 lo, uint32 hi)
+{
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    
+    return lo + (bench_seed >> 8) % (hi - lo + 1);
+}
+/**
+ * prepare one run; the 'wake' scenario first connects once so the next boot finds its RTC memory filled in
+ * 
+ * @param mode
+ * @param scenario
+ */
+static void bench_setup(WIFI_Mode mode, WIFI_HostScenario scenario)
+{
+    uint32 seed = bench_seed;
+    
+    WIFI_HostPowerCycle();
+    
+    if(scenario == host_scenario_wake || scenario == host_scenario_dense) {
+        bench_boot(mode, scenario);
+        
+        while(bench_connected_at == 0 && WIFI_HostElapsed() < BENCH_LIMIT_MS) {
+            WIFI_Run();
+            WIFI_HostAdvance(BENCH_STEP_MS);
+        }
+        
+        bench_seed = seed;                                                      // same environment after the reboot
+        
+        if(scenario == host_scenario_dense) {
+            bench_swapped = 1;
+        }
+    }
+    
+    bench_boot(mode, scenario);
+    
+    bench_swapped = 0;
+}
+/**
+ * reboot: build the radio environment and initialize the library
+ * 
+ * @param mode
+ * @param scenario
+ */
+static void bench_boot(WIFI_Mode mode, WIFI_HostScenario scenario)
+{
+    uint8           bssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    const char*     psw      = (scenario == host_scenario_wrong_password) ? "wrong_psw" : BENCH_PSW;
+    int             i;
+    
+    WIFI_HostReset();
+    WIFI_HostSetVerbose(0);
+    
+    bench_timing();
+    
+    for(i = 0; i < ((scenario == host_scenario_dense) ? BENCH_DENSE_NEIGHBOURS : BENCH_NEIGHBOURS); i++) {
+        char ssid[24];
+        
+        os_sprintf(ssid, "neighbour_%d", i);
+        
+        bssid[4] = (uint8)(i >> 8);
+        bssid[5] = (uint8)(0x10 + i);
+        WIFI_HostAddAP(ssid, "neighbour_psw", bssid, (uint8)(1 + (i * 5) % 13), (sint8)bench_rand(-90, -50));
+    }
+    
+    if(scenario != host_scenario_no_ap) {
+        int ap;
+        
+        bssid[4] = 0xAA;
+        bssid[5] = (bench_swapped != 0) ? 0x02 : 0x01;
+        ap       = WIFI_HostAddAP((mode == mesh_non_leaf || mode == mesh_leaf) ? BENCH_ROOT_SSID : BENCH_SSID,
+                                  (mode == mesh_non_leaf || mode == mesh_leaf) ? "" : BENCH_PSW,
+                                  bssid,
+                                  6,
+                                  (sint8)bench_rand(-70, -55));
+        
+        if(scenario == host_scenario_late_ap) {
+            WIFI_HostScheduleAP(ap, BENCH_LATE_AP_MS, 0);
+        }
+        else if(scenario == host_scenario_ap_reboot) {
+            WIFI_HostScheduleAP(ap, 0, BENCH_REBOOT_DOWN_MS);
+            
+            ap = WIFI_HostAddAP((mode == mesh_non_leaf || mode == mesh_leaf) ? BENCH_ROOT_SSID : BENCH_SSID,
+                                (mode == mesh_non_leaf || mode == mesh_leaf) ? "" : BENCH_PSW,
+                                bssid,
+                                6,
+                                (sint8)bench_rand(-70, -55));
+            
+            WIFI_HostScheduleAP(ap, BENCH_REBOOT_UP_MS, 0);
+        }
+    }
+    
+    bench_connected_at = 0;
+    bench_list[1].psw  = psw;
+    
+    struct timespec t0;
+    struct timespec t1;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    
+    if(bench_resume == 0 || WIFI_Resume((mode == ap_fixed_auto) ? bench_list : NULL) != 0) {
+        switch(mode) {
+            case ap_fixed:
+                WIFI_Initialize(BENCH_SSID, psw);
+                break;
+            
+            case ap_fixed_auto:
+                WIFI_InitializeEx(bench_list);
+                break;
+            
+            default:
+                WIFI_MeshInitialize(mode, BENCH_SSID, psw, BENCH_PREFIX, NULL);
+                break;
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    
+    bench_init_ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000u + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+    
+    WIFI_SetCallback(bench_on_connect, NULL, NULL);
+}
+/**
+ * 
+ * @param a
+ * @param b
+ * @return 
+ */
+static int bench_compare(const void* a, const void* b)
+{
+    uint32 x = *(const uint32*)a;
+    uint32 y = *(const uint32*)b;
+    
+    return (x > y) - (x < y);
+}
+/**
+ * +-25% around the default timings
+ */
+static void bench_timing(void)
+{
+    WIFI_HostTiming timing;
+    
+    WIFI_HostGetTiming(&timing);
+    
+    timing.m_ScanChannelMs = bench_rand(timing.m_ScanChannelMs * 3 / 4, timing.m_ScanChannelMs * 5 / 4);
+    timing.m_SearchMs      = bench_rand(timing.m_SearchMs * 3 / 4,      timing.m_SearchMs * 5 / 4);
+    timing.m_AssocMs       = bench_rand(timing.m_AssocMs * 3 / 4,       timing.m_AssocMs * 5 / 4);
+    timing.m_DhcpMs        = bench_rand(timing.m_DhcpMs * 3 / 4,        timing.m_DhcpMs * 5 / 4);
+    
+    WIFI_HostSetTiming(&timing);
+}
+/**
+ * 
+ * @param dx
+ * @param dy
+ * @return 
+ */
+static sint8 bench_rssi(int dx, int dy)
+{
+    static const uint8 db[10] = { 0, 0, 3, 5, 6, 7, 8, 8, 9, 10 };           // 10 * log10(1..9)
+    
+    uint32 d2     = (uint32)(dx * dx + dy * dy);
+    uint32 decade = 1;
+    int    loss   = 0;                                                          // 10 * log10(d2)
+    
+    while(d2 >= decade * 10) {
+        decade *= 10;
+        loss   += 10;
+    }
+    
+    loss += db[d2 / decade];
+    
+    return (sint8)(-40 - loss * 3 / 2 + (int)bench_rand(0, 6) - 3);
+}
+#if defined(WITH_MESH_UDP)
+/**
+ * 
+ * @param if_index
+ * @param dst
+ * @param data
+ * @param length
+ * @param done_us
+ * @param ptr
+ */
+static void bench_forward_sink(uint8 if_index, const ip_addr_t* dst, const void* data, uint16 length, uint64_t done_us, void* ptr)
+{
+    const uint8* frame  = data;                                                 // 4 byte header, then MAC + length + message; see mesh_udp_deliver()
+    uint16       offset = 4;
+    uint8        count;
+    
+    if(if_index != STATION_IF || length < 4) {
+        return;
+    }
+    
+    bench_forward.m_Datagrams++;
+    
+    if(frame[2] + 1 < bench_forward_hops) {
+        ip_addr_t       child;
+        struct timespec t0;
+        struct timespec t1;
+        
+        IP4_ADDR(&child, 192, 168, 4, 2);
+        
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        WIFI_HostUdpInject(SOFTAP_IF, &child, WIFI_MESH_PORT, data, length);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        
+        bench_forward_ns += (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000u + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+        bench_forward_count++;
+        return;
+    }
+    
+    for(count = frame[3]; count > 0 && offset + 8 <= length; count--) {
+        uint16   size = (uint16)((frame[offset + 6] << 8) | frame[offset + 7]);
+        uint64_t sent;
+        
+        memcpy(&sent, frame + offset + 8, sizeof(sent));
+        
+        if(bench_forward.m_Delivered < BENCH_FORWARD_MAX) {
+            bench_forward_samples[bench_forward.m_Delivered++] = (uint32)(done_us - sent);
+        }
+        
+        bench_forward_bytes += size;
+        offset              += 8 + size;
+    }
+    
+    bench_forward_last = done_us;
+}
+#endif
+
+#endif  /* WIFI_HOST */
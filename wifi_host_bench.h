@@ -0,0 +1,238 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+/* 
+ * Time-to-connected benchmarks for every WIFI_Mode, run against the host SDK (wifi_host.c).
+ */
+
+#ifndef WIFI_HOST_BENCH_H
+#define	WIFI_HOST_BENCH_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "wifi.h"
+
+/******************************************************************************************************************
+ * benchmarks
+ *
+ */
+
+typedef enum {
+    host_scenario_normal = 0,
+    host_scenario_wrong_password,
+    host_scenario_no_ap,
+    host_scenario_late_ap,
+    host_scenario_wake,                         // reboot/deep-sleep wake after a successful connect
+    host_scenario_dense,                        // 60 neighbouring BSSs; wake after the AP was swapped (same SSID/channel, new BSSID)
+    host_scenario_ap_reboot                     // the AP disappears at 30 s and is back at 90 s; see WIFI_HostBenchmarkStorm()
+} WIFI_HostScenario;
+
+typedef struct {
+    uint32              m_Runs;
+    uint32              m_Connected;            // runs where on_connect fired
+    uint32              m_P50;                  // time-to-connected in ms; failed runs count as the time limit
+    uint32              m_P99;
+    uint32              m_Iterations;           // WIFI_Run() calls, summed over all runs
+    uint64_t            m_InitNs;               // host CPU time in WIFI_*Initialize() / WIFI_Resume() of the measured boot, summed
+    WIFI_HostCounters   m_Counters;             // SDK calls, summed over all runs
+} WIFI_HostReport;
+
+typedef struct {
+    uint32              m_Nodes;
+    uint32              m_Reconnected;          // nodes back on the AP within the time limit
+    uint32              m_P50;                  // ms from the AP coming back to on_connect
+    uint32              m_P99;
+    uint32              m_Peak;                 // most association attempts, all nodes together, in any 100 ms after the AP is back
+    uint32              m_Attempts;             // association attempts per node, outage included
+} WIFI_HostStorm;
+
+typedef struct {
+    uint32              m_Runs;
+    uint32              m_Connected;
+    uint32              m_P50;                  // init -> on_connect in ms
+    uint32              m_RadioOnMs;            // during the hour after on_connect, average over the connected runs
+    uint32              m_Polls;                // wifi_station_get_connect_status() in that hour, average
+} WIFI_HostPower;
+
+typedef struct {
+    uint32              m_Runs;
+    uint32              m_Connected;
+    uint32              m_P50;                  // init -> on_connect in ms
+    uint32              m_BootCalls;            // WIFI_Run() calls in the first two minutes, average over all runs
+    uint32              m_HourCalls;            // ... in the hour after that, average over the connected runs
+} WIFI_HostTickless;
+
+typedef struct {
+    uint32              m_Nodes;                // the root included
+    uint32              m_Joined;
+    uint32              m_P50;                  // init -> on_connect in ms, per node; failed nodes count as the time limit
+    uint32              m_P99;
+    uint32              m_MaxDepth;             // hops from the root
+    uint32              m_Depth;                // summed over the joined nodes
+    uint32              m_Scans;                // summed over all nodes
+    uint32              m_Assocs;               // association attempts, summed; a full parent costs one more
+} WIFI_HostMesh;
+
+typedef struct {
+    uint32              m_Sent;                 // WIFI_MeshSend() calls that were accepted
+    uint32              m_Refused;              // ... and refused (all batch buffers on the air)
+    uint32              m_Delivered;            // messages out of the last hop
+    uint32              m_Datagrams;            // on the air, all hops
+    uint32              m_P50Us;                // WIFI_MeshSend() -> end of the last hop's transmission
+    uint32              m_P99Us;
+    uint32              m_Kbps;                 // payload delivered while sending
+    uint32              m_PbufAllocs;           // by the library while sending
+    uint32              m_ZeroCopy;             // datagrams forwarded in the pbuf they came in
+    uint32              m_ForwardNs;            // host CPU per forwarded datagram
+} WIFI_HostForward;
+
+typedef struct {
+    uint32              m_Events;               // stations that joined or left the softAP
+    uint32              m_Lookups;              // WIFI_MeshRoute() calls checked against the softAP
+    uint32              m_Stale;                // ... that did not match it
+    uint32              m_Routes;               // nodes WIFI_MeshRoute() found at the end, the children included
+    uint32              m_StationLists;         // wifi_softap_get_station_info() calls
+    uint32              m_LookupNs;             // host CPU per WIFI_MeshRoute()
+} WIFI_HostRoutes;
+
+/**
+ * initialize the library in 'mode' inside 'scenario' and measure init -> on_connect, 'runs' times with jittered timings
+ * 
+ * @param mode
+ * @param scenario
+ * @param runs
+ * @param report
+ * @return 
+ */
+int WIFI_HostBenchmark(WIFI_Mode mode, WIFI_HostScenario scenario, int runs, WIFI_HostReport* report);
+/**
+ * 
+ * @param mode
+ * @param scenario
+ * @param report
+ */
+void WIFI_HostBenchmarkPrint(WIFI_Mode mode, WIFI_HostScenario scenario, const WIFI_HostReport* report);
+/**
+ * ap_fixed_auto with 'aps' configured WIFI_APs among 'visible' BSSs that never match, i.e. the worst case for the lookup
+ * 
+ * @param aps
+ * @param visible
+ * @param ns        mean host CPU time per scan_done_callback()
+ * @return 
+ */
+int WIFI_HostBenchmarkScanCallback(int aps, int visible, uint32* ns);
+/**
+ * mass reconnect: 'nodes' independent nodes (own MAC, own jittered timings) sit on the same AP when it reboots;
+ * their association attempts are added up on the AP's time line
+ * 
+ * @param mode
+ * @param nodes
+ * @param storm
+ * @return 
+ */
+int WIFI_HostBenchmarkStorm(WIFI_Mode mode, int nodes, WIFI_HostStorm* storm);
+/**
+ * host_scenario_wake, booting the second time with WIFI_*Initialize() ('resume' == 0) or WIFI_Resume()
+ * 
+ * @param mode
+ * @param resume
+ * @param runs
+ * @param report
+ * @return 
+ */
+int WIFI_HostBenchmarkResume(WIFI_Mode mode, int resume, int runs, WIFI_HostReport* report);
+/**
+ * connect in 'mode' with 'policy' (host_scenario_normal) and stay connected for an hour
+ * 
+ * @param mode
+ * @param policy
+ * @param runs
+ * @param power
+ * @return 
+ */
+int WIFI_HostBenchmarkPower(WIFI_Mode mode, WIFI_PowerPolicy policy, int runs, WIFI_HostPower* power);
+/**
+ * connect in 'mode' (host_scenario_normal) and stay connected for an hour, calling WIFI_Run() every 100 ms or
+ * only when its return value or the wakeup hook asks for it
+ * 
+ * @param mode
+ * @param tickless  0: poll
+ * @param runs
+ * @param report
+ * @return 
+ */
+int WIFI_HostBenchmarkTickless(WIFI_Mode mode, int tickless, int runs, WIFI_HostTickless* report);
+/**
+ * 'nodes' nodes on a grid join the mesh one after the other, nearest to the root first; each one sees the router and
+ * the softAPs of the nodes that joined before it, with the RSSI of its distance to them. Every 4th node is a leaf.
+ * 
+ * @param nodes
+ * @param mesh
+ * @return 
+ */
+int WIFI_HostBenchmarkMesh(int nodes, WIFI_HostMesh* mesh);
+#if defined(WITH_MESH_UDP)
+/**
+ * a chain of 'hops' mesh_non_leaf nodes on one channel; the first one sends 'rate' messages of 'length' bytes a
+ * second for 2 s. The chain is one node whose transmissions to its parent are fed back in as a child's, so every
+ * hop runs the same forwarding code and takes its turn on the air.
+ * 
+ * @param hops
+ * @param batch_ms
+ * @param length
+ * @param rate
+ * @param forward
+ * @return 
+ */
+int WIFI_HostBenchmarkForward(int hops, int batch_ms, int length, int rate, WIFI_HostForward* forward);
+#endif
+/**
+ * a mesh_non_leaf node for an hour with up to 'children' stations on its softAP, one of them joining or leaving
+ * every 30 s. With WITH_MESH_UDP each child also forwards a message a second from each of 'descendants' nodes
+ * further down, spread over the children. Every 100 ms WIFI_MeshRoute() is asked about all of them.
+ * 
+ * @param children
+ * @param descendants
+ * @param routes
+ * @return 
+ */
+int WIFI_HostBenchmarkRoutes(int children, int descendants, WIFI_HostRoutes* routes);
+/**
+ * run and print every WIFI_Mode x WIFI_HostScenario combination, then the mass reconnect, resume against cold
+ * init, the power policies, the mesh join, the routing table and (WITH_MESH_UDP) forwarding
+ * 
+ * @param runs
+ * @return 
+ */
+int WIFI_HostBenchmarkSuite(int runs);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* WIFI_HOST_BENCH_H */
@@ -0,0 +1,882 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+#if defined(WIFI_HOST)
+
+#include "wifi_host_sim.h"
+#include <stdlib.h>
+
+#define SIM_MAX_NODES           1000
+#define SIM_MAX_NEIGHBOURS      48                                              // strongest softAPs a node sees; the host SDK takes 64 APs
+#define SIM_STEP_MS             20
+#define SIM_BOOT_MS             1000                                            // nodes power on within this
+#define SIM_CONVERGE_MS         300000
+#define SIM_RECONVERGE_MS       300000
+#define SIM_SPACING_M           20                                              // square metres per node: 20 x 20
+#define SIM_VISIBLE_DBM         -90
+#define SIM_FADING_DB           4                                               // fixed per pair of nodes, -4..4
+#define SIM_CHANNEL             6
+#define SIM_LEAF_EVERY          4
+
+#define SIM_ROUTER              -2                                              // SimNode.m_Ap[] and .m_Parent
+#define SIM_NONE                -1
+#define SIM_DEPTH_UNKNOWN       -2                                              // SimNode.m_Depth during sim_joined()
+
+#define SIM_PREFIX              "sim"
+#define SIM_SSID                "sim_ap"
+#define SIM_PSW                 "sim_psw"
+
+/******************************************************************************************************************
+ * local var's
+ *
+ */
+
+typedef struct SimNode
+{
+    WIFI_HostNode*          m_Host;
+    WIFI_Ctx*               m_Ctx;
+    uint8                   m_Mac[6];
+    WIFI_Mode               m_Mode;
+    int                     m_X;                                                // m from the router
+    int                     m_Y;
+    uint32                  m_BootMs;
+    uint8                   m_Booted;
+    uint8                   m_Alive;
+    
+    int                     m_ApCount;                                          // in its host AP table
+    int                     m_Ap[SIM_MAX_NEIGHBOURS + 1];                       // node behind each entry, or SIM_ROUTER
+    int                     m_SeenCount;
+    int                     m_SeenNode[SIM_MAX_NEIGHBOURS];                     // nodes that have our softAP in their table...
+    uint8                   m_SeenAp[SIM_MAX_NEIGHBOURS];                       // ... at this index
+    
+    char                    m_Ssid[33];                                         // softAP as the node set it up; "" when off
+    uint8                   m_MaxConnection;
+    uint8                   m_Stations;
+    char                    m_ShownSsid[33];                                    // as last put on the air
+    uint8                   m_Shown;                                            // 0 = off, 1 = on, 2 = on and full
+    
+    int                     m_Parent;                                           // node whose softAP we are on, SIM_ROUTER or SIM_NONE
+    uint32                  m_Ip;
+    int                     m_Depth;                                            // -1 = not joined
+    int                     m_Root;                                             // node on the router above us
+    uint8                   m_Affected;                                         // has to join in this phase
+    uint32                  m_JoinedAt;                                         // ms into the phase; 0 = not yet
+    
+    WIFI_HostCounters       m_Start;                                            // at the start of the phase
+} SimNode;
+
+static SimNode sim_nodes[SIM_MAX_NODES];
+static int     sim_count;
+static uint32  sim_seed;
+static uint32  sim_now;                                                         // ms into the phase
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param lo
+ * @param hi
+ * @return 
+ */
+static uint32 sim_rand(uint32 lo, uint32 hi);
+/**
+ * 
+ * @param dx
+ * @param dy
+ * @param fading
+ * @return 
+ */
+static sint8 sim_rssi(int dx, int dy, int fading);
+/**
+ * the same for both directions of a link
+ * 
+ * @param a
+ * @param b
+ * @return 
+ */
+static int sim_fading(int a, int b);
+/**
+ * give node 'i' its host SDK and context, and fill in its AP table: the router and the strongest other nodes,
+ * all of them off
+ * 
+ * @param i
+ * @return 
+ */
+static int sim_node_new(int i);
+/**
+ * 
+ */
+static void sim_free(void);
+/**
+ * run node 'i' for one step and put what changed on the air
+ * 
+ * @param i
+ */
+static void sim_step(int i);
+/**
+ * make the tables of the nodes that see 'i' agree with its softAP
+ * 
+ * @param i
+ */
+static void sim_publish(int i);
+/**
+ * 
+ * @param i
+ * @param parent
+ */
+static void sim_attach(int i, int parent);
+/**
+ * 
+ * @param i
+ */
+static void sim_detach(int i);
+/**
+ * work out every node's depth and root for this step
+ * 
+ * @return joined nodes
+ */
+static int sim_joined(void);
+/**
+ * 
+ * @param i
+ * @return 
+ */
+static int sim_depth(int i);
+/**
+ * run every node that is up until the affected ones have all joined or 'limit_ms' is over
+ * 
+ * @param limit_ms
+ * @param sim
+ */
+static void sim_phase(uint32 limit_ms, WIFI_HostSim* sim);
+/**
+ * 
+ * @param a
+ * @param b
+ * @return 
+ */
+static int sim_compare(const void* a, const void* b);
+
+/******************************************************************************************************************
+ * simulator
+ *
+ */
+
+/**
+ * 
+ * @param nodes
+ * @param roots
+ * @param seed
+ * @param converge
+ * @param reconverge
+ * @return 
+ */
+int WIFI_HostSimulate(int nodes, int roots, uint32 seed, WIFI_HostSim* converge, WIFI_HostSim* reconverge)
+{
+    static int order[SIM_MAX_NODES];
+    
+    int side = SIM_SPACING_M;
+    int i;
+    int j;
+    
+    if(nodes <= 0 || nodes > SIM_MAX_NODES || roots <= 0 || roots > nodes) {
+        return -1;
+    }
+    
+    while((side / SIM_SPACING_M) * (side / SIM_SPACING_M) < nodes) {
+        side += SIM_SPACING_M;
+    }
+    
+    memset(sim_nodes, 0, sizeof(sim_nodes));
+    
+    sim_count = nodes;
+    sim_seed  = seed;
+    
+    for(i = 0; i < nodes; i++) {
+        sim_nodes[i].m_X      = (int)sim_rand(0, (uint32)side) - side / 2;
+        sim_nodes[i].m_Y      = (int)sim_rand(0, (uint32)side) - side / 2;
+        sim_nodes[i].m_BootMs = sim_rand(0, SIM_BOOT_MS - 1);
+    }
+    
+    // the nearest ones to the router are the roots
+    for(i = 0; i < nodes; i++) {
+        int d = sim_nodes[i].m_X * sim_nodes[i].m_X + sim_nodes[i].m_Y * sim_nodes[i].m_Y;
+        
+        for(j = i; j > 0 && sim_nodes[order[j - 1]].m_X * sim_nodes[order[j - 1]].m_X + sim_nodes[order[j - 1]].m_Y * sim_nodes[order[j - 1]].m_Y > d; j--) {
+            order[j] = order[j - 1];
+        }
+        
+        order[j] = i;
+    }
+    
+    for(i = 0; i < nodes; i++) {
+        sim_nodes[order[i]].m_Mode = (i < roots) ? mesh_root : (order[i] % SIM_LEAF_EVERY == SIM_LEAF_EVERY - 1) ? mesh_leaf : mesh_non_leaf;
+    }
+    
+    for(i = 0; i < nodes; i++) {
+        if(sim_node_new(i) != 0) {
+            sim_free();
+            return -1;
+        }
+    }
+    
+    for(i = 0; i < nodes; i++) {
+        sim_nodes[i].m_Affected = 1;
+    }
+    
+    sim_phase(SIM_CONVERGE_MS, converge);
+    
+    if(reconverge != NULL) {
+        static uint32 below[SIM_MAX_NODES];
+        
+        int victim = -1;
+        
+        memset(below, 0, sizeof(below));
+        
+        for(i = 0; i < nodes; i++) {
+            if(sim_nodes[i].m_Depth >= 0) {
+                below[sim_nodes[i].m_Root]++;
+            }
+        }
+        
+        for(i = 0; i < nodes; i++) {
+            if(sim_nodes[i].m_Depth == 0 && (victim < 0 || below[i] > below[victim])) {
+                victim = i;
+            }
+        }
+        
+        for(i = 0; i < nodes; i++) {
+            sim_nodes[i].m_Affected = (victim >= 0 && sim_nodes[i].m_Depth >= 0 && sim_nodes[i].m_Root == victim && i != victim) ? 1 : 0;
+        }
+        
+        if(victim >= 0) {
+            sim_detach(victim);
+            
+            sim_nodes[victim].m_Alive   = 0;
+            sim_nodes[victim].m_Ssid[0] = '\0';
+            
+            sim_publish(victim);                                                // its stations notice at their next beacon
+        }
+        
+        sim_phase(SIM_RECONVERGE_MS, reconverge);
+    }
+    
+    sim_free();
+    
+    return 0;
+}
+/**
+ * 
+ * @param nodes
+ * @param roots
+ * @param phase
+ * @param sim
+ */
+void WIFI_HostSimulatePrint(int nodes, int roots, const char* phase, const WIFI_HostSim* sim)
+{
+    printf("%-7d %-6d %-12s %5u/%-5u orphans %4u  roots %2u  converged %6u ms  p50 %6u ms  p99 %6u ms  depth max %2u mean %4.1f  scans %4.1f/node  assoc %4.1f/node\n",
+            nodes,
+            roots,
+            phase,
+            sim->m_Joined,
+            sim->m_Nodes,
+            sim->m_Orphans,
+            sim->m_Roots,
+            sim->m_ConvergedMs,
+            sim->m_P50,
+            sim->m_P99,
+            sim->m_MaxDepth,
+            (sim->m_Joined != 0) ? (double)sim->m_Depth / sim->m_Joined : 0.0,
+            (sim->m_Nodes != 0) ? (double)sim->m_Scans / sim->m_Nodes : 0.0,
+            (sim->m_Nodes != 0) ? (double)sim->m_Assocs / sim->m_Nodes : 0.0);
+}
+/**
+ * 
+ * @return 
+ */
+int WIFI_HostSimulateSuite(void)
+{
+    static const int sizes[4] = { 100, 250, 500, 1000 };
+    static const int roots[2] = { 1, 4 };
+    
+    int i;
+    int j;
+    
+    printf("%-7s %-6s %-12s %11s  (random positions, 20 m x 20 m per node, router in the middle; the root with the most nodes below it is switched off)\n", "nodes", "roots", "phase", "joined");
+    
+    for(i = 0; i < 4; i++) {
+        for(j = 0; j < 2; j++) {
+            WIFI_HostSim converge;
+            WIFI_HostSim reconverge;
+            
+            if(WIFI_HostSimulate(sizes[i], roots[j], 0x5EED0000u + (uint32)sizes[i], &converge, &reconverge) != 0) {
+                return -1;
+            }
+            
+            WIFI_HostSimulatePrint(sizes[i], roots[j], "power-on", &converge);
+            WIFI_HostSimulatePrint(sizes[i], roots[j], "root killed", &reconverge);
+        }
+    }
+    
+    return 0;
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * 
+ * @param lo
+ * @param hi
+ * @return 
+ */
+static uint32 sim_rand(uint32 lo, uint32 hi)
+{
+    sim_seed = sim_seed * 1664525u + 1013904223u;
+    
+    return lo + (sim_seed >> 8) % (hi - lo + 1);
+}
+/**
+ * 
+ * @param dx
+ * @param dy
+ * @param fading
+ * @return 
+ */
+static sint8 sim_rssi(int dx, int dy, int fading)
+{
+    static const uint8 db[10] = { 0, 0, 3, 5, 6, 7, 8, 8, 9, 10 };           // 10 * log10(1..9)
+    
+    uint32 d2     = (uint32)(dx * dx + dy * dy);
+    uint32 decade = 1;
+    int    loss   = 0;                                                          // 10 * log10(d2)
+    
+    if(d2 == 0) {
+        d2 = 1;
+    }
+    
+    while(d2 >= decade * 10) {
+        decade *= 10;
+        loss   += 10;
+    }
+    
+    loss += db[d2 / decade];
+    
+    return (sint8)(-40 - loss * 3 / 2 + fading);
+}
+/**
+ * 
+ * @param a
+ * @param b
+ * @return 
+ */
+static int sim_fading(int a, int b)
+{
+    uint32 x = (a < b) ? (uint32)(a * SIM_MAX_NODES + b) : (uint32)(b * SIM_MAX_NODES + a);
+    
+    x  = (x + 1) * 0x9E3779B1u;
+    x ^= x >> 15;
+    x *= 0x85EBCA77u;
+    x ^= x >> 13;
+    
+    return (int)(x % (2 * SIM_FADING_DB + 1)) - SIM_FADING_DB;
+}
+/**
+ * 
+ * @param i
+ * @return 
+ */
+static int sim_node_new(int i)
+{
+    static const uint8 router[6] = { 0x02, 0x00, 0x00, 0x00, 0xAA, 0x01 };
+    
+    static int   near[SIM_MAX_NODES];
+    static sint8 rssi[SIM_MAX_NODES];
+    
+    SimNode*       n     = &sim_nodes[i];
+    WIFI_HostNode* prev;
+    int            count = 0;
+    int            j;
+    int            k;
+    sint8          r;
+    
+    n->m_Host = WIFI_HostNodeNew();
+    n->m_Ctx  = WIFI_CtxNew();
+    
+    if(n->m_Host == NULL || n->m_Ctx == NULL) {
+        return -1;
+    }
+    
+    n->m_Mac[0]  = 0x5c;
+    n->m_Mac[1]  = 0xcf;
+    n->m_Mac[2]  = 0x7f;
+    n->m_Mac[3]  = 0x03;
+    n->m_Mac[4]  = (uint8)(i >> 8);
+    n->m_Mac[5]  = (uint8)i;
+    n->m_Alive   = 1;
+    n->m_Parent  = SIM_NONE;
+    n->m_Depth   = -1;
+    
+    prev = WIFI_HostSelect(n->m_Host);
+    
+    WIFI_HostSetVerbose(0);
+    WIFI_HostSetMAC(n->m_Mac);
+    
+    r = sim_rssi(n->m_X, n->m_Y, sim_fading(i, SIM_MAX_NODES - 1));
+    
+    if(r >= SIM_VISIBLE_DBM) {
+        n->m_Ap[WIFI_HostAddAP(SIM_SSID, SIM_PSW, router, SIM_CHANNEL, r)] = SIM_ROUTER;
+        n->m_ApCount++;
+    }
+    
+    // the strongest others, strongest first
+    for(j = 0; j < sim_count; j++) {
+        if(j == i) {
+            continue;
+        }
+        
+        r = sim_rssi(n->m_X - sim_nodes[j].m_X, n->m_Y - sim_nodes[j].m_Y, sim_fading(i, j));
+        
+        if(r < SIM_VISIBLE_DBM) {
+            continue;
+        }
+        
+        if(count < SIM_MAX_NEIGHBOURS) {
+            k = count++;
+        }
+        else if(r > rssi[count - 1]) {
+            k = count - 1;                                                      // the weakest one makes room
+        }
+        else {
+            continue;
+        }
+        
+        for(; k > 0 && rssi[k - 1] < r; k--) {
+            near[k] = near[k - 1];
+            rssi[k] = rssi[k - 1];
+        }
+        
+        near[k] = j;
+        rssi[k] = r;
+    }
+    
+    for(k = 0; k < count; k++) {
+        SimNode* m = &sim_nodes[near[k]];
+        uint8    bssid[6];
+        int      ap;
+        
+        if(m->m_SeenCount == SIM_MAX_NEIGHBOURS) {
+            continue;                                                           // too crowded there; it is one of many
+        }
+        
+        memcpy(bssid, m->m_Mac, sizeof(bssid));
+        bssid[0] = 0x5e;                                                        // softAP MAC, locally administered
+        
+        ap = WIFI_HostAddAP("", "", bssid, SIM_CHANNEL, rssi[k]);
+        
+        WIFI_HostScheduleAP(ap, 0xFFFFFFFFu, 0);                                // off until it sets up its softAP
+        
+        n->m_Ap[ap] = near[k];
+        n->m_ApCount++;
+        
+        m->m_SeenNode[m->m_SeenCount] = i;
+        m->m_SeenAp[m->m_SeenCount]   = (uint8)ap;
+        m->m_SeenCount++;
+    }
+    
+    WIFI_HostSelect(prev);
+    
+    return 0;
+}
+/**
+ * 
+ */
+static void sim_free(void)
+{
+    int i;
+    
+    for(i = 0; i < sim_count; i++) {
+        if(sim_nodes[i].m_Ctx != NULL) {
+            WIFI_HostSelect(sim_nodes[i].m_Host);                               // its UDP pcb lives there
+            WIFI_CtxFree(sim_nodes[i].m_Ctx);
+        }
+    }
+    
+    WIFI_HostSelect(NULL);
+    
+    for(i = 0; i < sim_count; i++) {
+        WIFI_HostNodeFree(sim_nodes[i].m_Host);
+    }
+    
+    memset(sim_nodes, 0, sizeof(sim_nodes));
+    
+    sim_count = 0;
+}
+/**
+ * 
+ * @param i
+ */
+static void sim_step(int i)
+{
+    SimNode*             n = &sim_nodes[i];
+    struct softap_config config;
+    struct ip_info       info;
+    int                  ap;
+    int                  parent;
+    
+    WIFI_HostSelect(n->m_Host);
+    
+    if(n->m_Booted == 0 && sim_now >= n->m_BootMs) {
+        WIFI_CtxMeshInitialize(n->m_Ctx, n->m_Mode, SIM_SSID, SIM_PSW, SIM_PREFIX, NULL);
+        
+        n->m_Booted = 1;
+    }
+    
+    if(n->m_Booted != 0) {
+        WIFI_CtxRun(n->m_Ctx);                                                  // also makes it the context the SDK calls back into
+    }
+    
+    WIFI_HostAdvance(SIM_STEP_MS);
+    
+    wifi_softap_get_config(&config);
+    
+    memset(n->m_Ssid, 0, sizeof(n->m_Ssid));
+    
+    if((wifi_get_opmode() & SOFTAP_MODE) != 0) {
+        memcpy(n->m_Ssid, config.ssid, (config.ssid_len != 0 && config.ssid_len < sizeof(config.ssid)) ? config.ssid_len : sizeof(config.ssid));
+    }
+    
+    n->m_MaxConnection = config.max_connection;
+    n->m_Stations      = wifi_softap_get_station_num();
+    
+    wifi_get_ip_info(STATION_IF, &info);
+    
+    n->m_Ip = info.ip.addr;
+    
+    ap     = WIFI_HostConnectedAP();
+    parent = (ap >= 0) ? n->m_Ap[ap] : SIM_NONE;
+    
+    if(parent != n->m_Parent) {
+        sim_detach(i);
+        sim_attach(i, parent);
+    }
+    
+    sim_publish(i);
+}
+/**
+ * 
+ * @param i
+ */
+static void sim_publish(int i)
+{
+    SimNode*       n       = &sim_nodes[i];
+    uint8          shown   = (n->m_Alive == 0 || n->m_Ssid[0] == '\0') ? 0 : (n->m_Stations >= n->m_MaxConnection) ? 2 : 1;
+    int            renamed = (shown != 0 && strcmp(n->m_Ssid, n->m_ShownSsid) != 0) ? 1 : 0;
+    WIFI_HostNode* prev;
+    int            k;
+    
+    if(shown == n->m_Shown && renamed == 0) {
+        return;
+    }
+    
+    prev = WIFI_HostSelect(NULL);
+    
+    for(k = 0; k < n->m_SeenCount; k++) {
+        SimNode* m  = &sim_nodes[n->m_SeenNode[k]];
+        int      ap = n->m_SeenAp[k];
+        
+        if(m->m_Alive == 0) {
+            continue;
+        }
+        
+        WIFI_HostSelect(m->m_Host);
+        
+        if(renamed != 0) {
+            WIFI_HostSetAPSsid(ap, n->m_Ssid);
+        }
+        
+        if(shown != 0 && n->m_Shown == 0) {
+            WIFI_HostScheduleAP(ap, WIFI_HostElapsed(), 0);
+        }
+        else if(shown == 0 && n->m_Shown != 0) {
+            WIFI_HostScheduleAP(ap, 0, (WIFI_HostElapsed() != 0) ? WIFI_HostElapsed() : 1); // a station on it is lost at its next step
+        }
+        
+        WIFI_HostSetAPFull(ap, shown == 2);
+    }
+    
+    WIFI_HostSelect(prev);
+    
+    if(renamed != 0) {
+        memcpy(n->m_ShownSsid, n->m_Ssid, sizeof(n->m_ShownSsid));
+    }
+    
+    n->m_Shown = shown;
+}
+/**
+ * 
+ * @param i
+ * @param parent
+ */
+static void sim_attach(int i, int parent)
+{
+    SimNode*       n = &sim_nodes[i];
+    SimNode*       p;
+    WIFI_HostNode* prev;
+    
+    n->m_Parent = parent;
+    
+    if(parent < 0 || sim_nodes[parent].m_Alive == 0) {
+        return;
+    }
+    
+    p    = &sim_nodes[parent];
+    prev = WIFI_HostSelect(p->m_Host);
+    
+    WIFI_HostAddStation(n->m_Mac, n->m_Ip);
+    
+    p->m_Stations = wifi_softap_get_station_num();
+    
+    WIFI_HostSelect(prev);
+    
+    sim_publish(parent);                                                        // full now?
+}
+/**
+ * 
+ * @param i
+ */
+static void sim_detach(int i)
+{
+    SimNode*       n      = &sim_nodes[i];
+    int            parent = n->m_Parent;
+    SimNode*       p;
+    WIFI_HostNode* prev;
+    
+    n->m_Parent = SIM_NONE;
+    
+    if(parent < 0 || sim_nodes[parent].m_Alive == 0) {
+        return;
+    }
+    
+    p    = &sim_nodes[parent];
+    prev = WIFI_HostSelect(p->m_Host);
+    
+    WIFI_HostRemoveStation(n->m_Mac);                                           // already gone if its softAP went down
+    
+    p->m_Stations = wifi_softap_get_station_num();
+    
+    WIFI_HostSelect(prev);
+    
+    sim_publish(parent);
+}
+/**
+ * 
+ * @return 
+ */
+static int sim_joined(void)
+{
+    int joined = 0;
+    int i;
+    
+    for(i = 0; i < sim_count; i++) {
+        sim_nodes[i].m_Depth = SIM_DEPTH_UNKNOWN;
+    }
+    
+    for(i = 0; i < sim_count; i++) {
+        if(sim_depth(i) >= 0) {
+            joined++;
+        }
+    }
+    
+    return joined;
+}
+/**
+ * 
+ * @param i
+ * @return 
+ */
+static int sim_depth(int i)
+{
+    SimNode* n = &sim_nodes[i];
+    
+    if(n->m_Depth != SIM_DEPTH_UNKNOWN) {
+        return n->m_Depth;
+    }
+    
+    n->m_Depth = -1;                                                            // also ends a loop of nodes on each other's softAPs
+    
+    if(n->m_Alive == 0 || n->m_Ip == 0) {
+        return -1;
+    }
+    
+    if(n->m_Parent == SIM_ROUTER) {
+        n->m_Depth = 0;
+        n->m_Root  = i;
+    }
+    else if(n->m_Parent >= 0 && sim_depth(n->m_Parent) >= 0) {
+        n->m_Depth = sim_nodes[n->m_Parent].m_Depth + 1;
+        n->m_Root  = sim_nodes[n->m_Parent].m_Root;
+    }
+    
+    return n->m_Depth;
+}
+/**
+ * 
+ * @param limit_ms
+ * @param sim
+ */
+static void sim_phase(uint32 limit_ms, WIFI_HostSim* sim)
+{
+    static uint32 samples[SIM_MAX_NODES];
+    static uint8  joined[SIM_MAX_NODES];
+    
+    WIFI_HostCounters c;
+    uint32            count = 0;
+    int               i;
+    
+    memset(sim, 0, sizeof(*sim));
+    
+    for(i = 0; i < sim_count; i++) {
+        joined[i]               = (sim_nodes[i].m_Depth >= 0) ? 1 : 0;
+        sim_nodes[i].m_JoinedAt = 0;
+        
+        if(sim_nodes[i].m_Alive != 0) {
+            WIFI_HostSelect(sim_nodes[i].m_Host);
+            WIFI_HostGetCounters(&sim_nodes[i].m_Start);
+        }
+    }
+    
+    for(sim_now = 0; sim_now < limit_ms; ) {
+        int done    = 1;
+        int changed = 0;
+        
+        for(i = 0; i < sim_count; i++) {
+            if(sim_nodes[i].m_Alive != 0) {
+                sim_step(i);
+            }
+        }
+        
+        sim_now += SIM_STEP_MS;
+        
+        sim_joined();
+        
+        for(i = 0; i < sim_count; i++) {
+            SimNode* n = &sim_nodes[i];
+            uint8    j = (n->m_Depth >= 0) ? 1 : 0;
+            
+            if(n->m_Alive == 0) {
+                continue;
+            }
+            
+            if(j != joined[i]) {
+                joined[i] = j;
+                changed   = 1;
+            }
+            
+            if(j != 0 && n->m_Affected != 0 && n->m_JoinedAt == 0) {
+                n->m_JoinedAt = sim_now;
+            }
+            
+            if(j == 0) {
+                done = 0;
+            }
+        }
+        
+        if(changed != 0) {
+            sim->m_ConvergedMs = sim_now;
+        }
+        
+        if(done != 0) {
+            break;
+        }
+    }
+    
+    for(i = 0; i < sim_count; i++) {
+        SimNode* n = &sim_nodes[i];
+        
+        if(n->m_Alive == 0) {
+            continue;
+        }
+        
+        WIFI_HostSelect(n->m_Host);
+        WIFI_HostGetCounters(&c);
+        
+        sim->m_Nodes++;
+        sim->m_Scans  += c.m_Scans - n->m_Start.m_Scans;
+        sim->m_Assocs += c.m_Assocs - n->m_Start.m_Assocs;
+        
+        if(n->m_Affected != 0) {
+            samples[count++] = (n->m_JoinedAt != 0) ? n->m_JoinedAt : limit_ms;
+        }
+        
+        if(n->m_Depth < 0) {
+            sim->m_Orphans++;
+            continue;
+        }
+        
+        sim->m_Joined++;
+        sim->m_Depth += (uint32)n->m_Depth;
+        
+        if(n->m_Depth == 0) {
+            sim->m_Roots++;
+        }
+        
+        if((uint32)n->m_Depth > sim->m_MaxDepth) {
+            sim->m_MaxDepth = (uint32)n->m_Depth;
+        }
+    }
+    
+    WIFI_HostSelect(NULL);
+    
+    sim->m_Affected = count;
+    
+    if(count != 0) {
+        qsort(samples, count, sizeof(samples[0]), sim_compare);
+        
+        sim->m_P50 = samples[((count - 1) * 50) / 100];
+        sim->m_P99 = samples[((count - 1) * 99) / 100];
+    }
+}
+/**
+ * 
+ * @param a
+ * @param b
+ * @return 
+ */
+static int sim_compare(const void* a, const void* b)
+{
+    uint32 x = *(const uint32*)a;
+    uint32 y = *(const uint32*)b;
+    
+    return (x > y) - (x < y);
+}
+
+#endif  /* WIFI_HOST */
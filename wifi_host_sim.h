@@ -0,0 +1,95 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+/* 
+ * Mesh convergence simulator: hundreds of nodes, each running wifi.c on its own WIFI_Ctx and host SDK
+ * (wifi_host.c), around one shared radio medium.
+ */
+
+#ifndef WIFI_HOST_SIM_H
+#define	WIFI_HOST_SIM_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "wifi.h"
+
+/******************************************************************************************************************
+ * simulator
+ *
+ */
+
+typedef struct {
+    uint32              m_Nodes;                // powered on
+    uint32              m_Affected;             // nodes that had to join: all of them at power-on, the killed root's tree after
+    uint32              m_Joined;               // with a path to the router at the end, through nodes that are up
+    uint32              m_Orphans;              // powered on, but not joined at the end
+    uint32              m_Roots;                // nodes on the router at the end
+    uint32              m_ConvergedMs;          // when the set of joined nodes last changed
+    uint32              m_P50;                  // ms to join, per affected node; orphans count as the time limit
+    uint32              m_P99;
+    uint32              m_MaxDepth;             // hops from the router's node
+    uint32              m_Depth;                // summed over the joined nodes
+    uint32              m_Scans;                // summed over all nodes that are up
+    uint32              m_Assocs;               // association attempts, summed
+} WIFI_HostSim;
+
+/**
+ * place 'nodes' nodes at random on a square of about 20 m x 20 m per node with the router in the middle, and power
+ * them all on within a second. The 'roots' nodes nearest the router run mesh_root, every 4th of the others is a
+ * mesh_leaf and the rest are mesh_non_leaf. A node sees the router and the softAPs of the other nodes that are up,
+ * at an RSSI that falls with 30 dB per decade of distance, plus a fixed -4..4 dB per pair. With 'reconverge' set, the
+ * root with the most nodes below it is then switched off and the rest measured again.
+ * 
+ * @param nodes         up to 1000
+ * @param roots
+ * @param seed          positions and fading
+ * @param converge
+ * @param reconverge    NULL to stop after power-on
+ * @return 
+ */
+int WIFI_HostSimulate(int nodes, int roots, uint32 seed, WIFI_HostSim* converge, WIFI_HostSim* reconverge);
+/**
+ * 
+ * @param nodes
+ * @param roots
+ * @param phase
+ * @param sim
+ */
+void WIFI_HostSimulatePrint(int nodes, int roots, const char* phase, const WIFI_HostSim* sim);
+/**
+ * 100 to 1000 nodes, with one root and with several
+ * 
+ * @return 
+ */
+int WIFI_HostSimulateSuite(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* WIFI_HOST_SIM_H */
@@ -0,0 +1,483 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+#if defined(WIFI_HOST)
+
+#include "wifi_host_trace.h"
+#include <stdlib.h>
+
+#define TRACE_MAX_DUMP          (WIFI_TRACE_HEADER + 0xFFFF * WIFI_TRACE_RECORD)
+#define TRACE_MESH_LINKED       3                                               // "connect_done" in trace_mesh_states[]
+
+#define TRACE_STATION           0                                               // TraceOutage.m_Link
+#define TRACE_MESH              1
+#define TRACE_LINKS             2
+
+/******************************************************************************************************************
+ * local var's
+ *
+ */
+
+// a stretch without a link, from leaving wifi_ready or mesh_connect_done until it is entered again
+typedef struct TraceOutage
+{
+    uint32                  m_Start;                                            // ms
+    uint32                  m_End;
+    uint16                  m_Connects;
+    uint16                  m_Checks;                                           // link checks that found no IP
+    uint8                   m_Cause;                                            // disconnect reason that started it; 0 = none
+    uint8                   m_Reason;                                           // the last one while it lasted
+    uint8                   m_Link;                                             // TRACE_*
+    uint8                   m_Open;                                             // not back by the end of the trace
+} TraceOutage;
+
+// in the enum order of wifi.c; trace_states_build() leaves out what the node was built without
+static const char* const    trace_states_base[] = {
+    "none",
+    "connect",
+    "connect_in_progress",
+    "connect_done",
+    "connect_fail",
+    "connect_wait",
+    "disconnect",
+    "disconnect_in_progress",
+    "disconnect_done",
+    "scan",
+    "scan_in_progress",
+    "scan_done",
+    "scan_fail"
+};
+static const char* const    trace_states_smartlink[] = { "smartlink", "smartlink_scan_in_progress", "smartlink_in_progress", "smartlink_done", "smartlink_fail" };
+static const char* const    trace_states_smartweb[]  = { "smartweb", "smartweb_run", "smartweb_in_progress", "smartweb_done", "smartweb_fail" };
+static const char* const    trace_mesh_states[]      = { "none", "connect", "connect_in_progress", "connect_done", "connect_fail", "scan_in_progress", "scan_done", "disabled" };
+static const char* const    trace_statuses[]         = { "idle", "connecting", "wrong_password", "no_ap_found", "connect_fail", "got_ip" };
+static const char* const    trace_names[]            = { "?", "state", "mesh", "scan", "mesh scan", "connect", "got ip", "check", "disconnect" };
+
+static const char*          trace_states[WIFI_STATS_STATES];
+static uint8                trace_state_count;
+static uint8                trace_ready;                                        // "ready" in trace_states[]
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param p
+ * @param bytes
+ * @return the little endian value at 'p'
+ */
+static uint32 trace_read(const uint8* p, int bytes);
+/**
+ * 
+ * @param set       WIFI_TRACE_IP_CACHE etc.
+ */
+static void trace_states_build(uint8 set);
+/**
+ * 
+ * @param names
+ * @param count
+ */
+static void trace_states_add(const char* const* names, int count);
+/**
+ * 
+ * @param state
+ * @return 
+ */
+static const char* trace_state_name(uint32 state);
+/**
+ * 
+ * @param state
+ * @return 
+ */
+static const char* trace_mesh_name(uint32 state);
+/**
+ * 
+ * @param reason
+ */
+static void trace_print_reason(uint8 reason);
+/**
+ * 
+ * @param outage
+ */
+static void trace_print_outage(const TraceOutage* outage);
+
+/******************************************************************************************************************
+ * decoder
+ *
+ */
+
+/**
+ * 
+ * @param dump
+ * @param length
+ * @return 
+ */
+int WIFI_HostTracePrint(const uint8* dump, int length)
+{
+    if(length < WIFI_TRACE_HEADER || dump[0] != 'W' || dump[1] != 'T' || dump[2] != WIFI_TRACE_VERSION) {
+        return -1;
+    }
+    
+    uint32       count             = trace_read(dump + 4, 2);
+    uint32       size              = trace_read(dump + 6, 2);
+    uint32       lost              = trace_read(dump + 8, 4);
+    uint32       now               = trace_read(dump + 12, 4);
+    uint32       last              = 0;
+    uint8        reason            = 0;                                         // the last disconnect seen
+    int          open[TRACE_LINKS] = { -1, -1 };                                // into outages[]
+    int          found             = 0;
+    TraceOutage* outages;
+    uint32       i;
+    int          j;
+    
+    if(size < WIFI_TRACE_RECORD || (uint32)length < WIFI_TRACE_HEADER + count * size) {
+        return -1;
+    }
+    
+    outages = calloc(count + 1, sizeof(TraceOutage));                           // at most one per record
+    
+    if(outages == NULL) {
+        return -1;
+    }
+    
+    trace_states_build(dump[3]);
+    
+    printf("%u records, %u older ones lost, dumped at %u.%03u s\n\n", count, lost, now / 1000, now % 1000);
+    printf("%11s %9s  %-10s\n", "time s", "delta ms", "event");
+    
+    for(i = 0; i < count; i++) {
+        const uint8* r     = dump + WIFI_TRACE_HEADER + i * size;
+        uint32       time  = trace_read(r, 4);
+        uint8        event = r[4];
+        uint8        a     = r[5];
+        uint32       b     = trace_read(r + 6, 2);
+        int          from  = -1;                                                // TRACE_* lost, back
+        int          to    = -1;
+        
+        printf("%7u.%03u %9d  %-10s  ", time / 1000, time % 1000, (i == 0) ? 0 : (int)(time - last), (event < trace_events) ? trace_names[event] : trace_names[0]);
+        
+        switch(event) {
+            case trace_state:
+                printf("%s -> %s\n", trace_state_name(a), trace_state_name(b));
+                
+                from = (a == trace_ready && b != trace_ready) ? TRACE_STATION : -1;
+                to   = (b == trace_ready) ? TRACE_STATION : -1;
+                break;
+                
+            case trace_mesh_state:
+                printf("%s -> %s\n", trace_mesh_name(a), trace_mesh_name(b));
+                
+                from = (a == TRACE_MESH_LINKED && b != TRACE_MESH_LINKED) ? TRACE_MESH : -1;
+                to   = (b == TRACE_MESH_LINKED) ? TRACE_MESH : -1;
+                break;
+                
+            case trace_scan:
+            case trace_mesh_scan:
+                printf("%u BSSs, %u %s", a, b >> 8, (event == trace_scan) ? "ours" : "parents");
+                
+                if((b >> 8) != 0) {
+                    printf(", %s %d dBm", (event == trace_scan) ? "best" : "first choice", (sint8)(b & 0xFF));
+                }
+                printf("\n");
+                break;
+                
+            case trace_connect:
+                if(a != 0) {
+                    printf("channel %u", a);
+                }
+                else {
+                    printf("all channels");
+                }
+                printf(", %u failures before\n", b);
+                
+                for(j = 0; j < TRACE_LINKS; j++) {
+                    if(open[j] >= 0) {
+                        outages[open[j]].m_Connects++;
+                    }
+                }
+                break;
+                
+            case trace_got_ip:
+                printf("channel %u, %d dBm\n", a, (sint16)b);
+                break;
+                
+            case trace_check:
+                printf("%s, ", (a < sizeof(trace_statuses) / sizeof(trace_statuses[0])) ? trace_statuses[a] : "?");
+                trace_print_reason((uint8)b);
+                printf("\n");
+                
+                for(j = 0; j < TRACE_LINKS; j++) {
+                    if(open[j] >= 0) {
+                        outages[open[j]].m_Checks++;
+                    }
+                }
+                break;
+                
+            case trace_disconnect:
+                trace_print_reason(a);
+                printf(" in %s\n", trace_state_name(b));
+                
+                if(a == REASON_ASSOC_LEAVE) {
+                    break;                                                      // wifi.c dropping an attempt itself
+                }
+                
+                reason = a;
+                
+                for(j = 0; j < TRACE_LINKS; j++) {
+                    if(open[j] >= 0) {
+                        outages[open[j]].m_Reason = a;
+                    }
+                }
+                break;
+                
+            default:
+                printf("%u %u %u\n", event, a, b);
+                break;
+        }
+        
+        if(from >= 0 && open[from] < 0) {
+            open[from] = found++;
+            
+            outages[open[from]].m_Start  = time;
+            outages[open[from]].m_Link   = (uint8)from;
+            outages[open[from]].m_Cause  = reason;                              // the event comes before WIFI_Run() sees the change
+        }
+        
+        if(to >= 0 && open[to] >= 0) {
+            outages[open[to]].m_End = time;
+            open[to]                = -1;
+        }
+        
+        last = time;
+    }
+    
+    for(j = 0; j < TRACE_LINKS; j++) {
+        if(open[j] >= 0) {
+            outages[open[j]].m_End  = now;
+            outages[open[j]].m_Open = 1;
+        }
+    }
+    
+    printf("\noutages: %d\n", found);
+    
+    for(j = 0; j < found; j++) {
+        trace_print_outage(&outages[j]);
+    }
+    
+    free(outages);
+    
+    return (int)count;
+}
+/**
+ * 
+ * @param path
+ * @return 
+ */
+int WIFI_HostTraceDecode(const char* path)
+{
+    FILE*  f    = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+    uint8* dump;
+    size_t length;
+    int    rc;
+    
+    if(f == NULL) {
+        return -1;
+    }
+    
+    dump = malloc(TRACE_MAX_DUMP);
+    
+    if(dump == NULL) {
+        if(f != stdin) {
+            fclose(f);
+        }
+        return -1;
+    }
+    
+    length = fread(dump, 1, TRACE_MAX_DUMP, f);
+    
+    if(f != stdin) {
+        fclose(f);
+    }
+    
+    rc = WIFI_HostTracePrint(dump, (int)length);
+    
+    free(dump);
+    
+    return rc;
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * 
+ * @param p
+ * @param bytes
+ * @return 
+ */
+static uint32 trace_read(const uint8* p, int bytes)
+{
+    uint32 value = 0;
+    
+    while(bytes-- > 0) {
+        value = (value << 8) | p[bytes];
+    }
+    
+    return value;
+}
+/**
+ * 
+ * @param set
+ */
+static void trace_states_build(uint8 set)
+{
+    static const char* const verify[]   = { "connect_verify" };
+    static const char* const disabled[] = { "disabled", "ready" };
+    
+    trace_state_count = 0;
+    
+    trace_states_add(trace_states_base, sizeof(trace_states_base) / sizeof(trace_states_base[0]));
+    
+    if((set & WIFI_TRACE_IP_CACHE) != 0) {
+        trace_states_add(verify, 1);
+    }
+    
+    if((set & WIFI_TRACE_SMARTLINK) != 0) {
+        trace_states_add(trace_states_smartlink, sizeof(trace_states_smartlink) / sizeof(trace_states_smartlink[0]));
+    }
+    
+    if((set & WIFI_TRACE_SMARTWEB) != 0) {
+        trace_states_add(trace_states_smartweb, sizeof(trace_states_smartweb) / sizeof(trace_states_smartweb[0]));
+    }
+    
+    trace_states_add(disabled, 2);
+    
+    trace_ready = (uint8)(trace_state_count - 1);
+}
+/**
+ * 
+ * @param names
+ * @param count
+ */
+static void trace_states_add(const char* const* names, int count)
+{
+    while(count-- > 0 && trace_state_count < WIFI_STATS_STATES) {
+        trace_states[trace_state_count++] = *names++;
+    }
+}
+/**
+ * 
+ * @param state
+ * @return 
+ */
+static const char* trace_state_name(uint32 state)
+{
+    return (state < trace_state_count) ? trace_states[state] : "?";
+}
+/**
+ * 
+ * @param state
+ * @return 
+ */
+static const char* trace_mesh_name(uint32 state)
+{
+    return (state < sizeof(trace_mesh_states) / sizeof(trace_mesh_states[0])) ? trace_mesh_states[state] : "?";
+}
+/**
+ * 
+ * @param reason
+ */
+static void trace_print_reason(uint8 reason)
+{
+    static const struct {
+        uint8       m_Reason;
+        const char* m_Name;
+    } names[] = {
+        { REASON_UNSPECIFIED,            "unspecified" },
+        { REASON_AUTH_EXPIRE,            "auth_expire" },
+        { REASON_AUTH_LEAVE,             "auth_leave" },
+        { REASON_ASSOC_EXPIRE,           "assoc_expire" },
+        { REASON_ASSOC_TOOMANY,          "assoc_toomany" },
+        { REASON_NOT_AUTHED,             "not_authed" },
+        { REASON_NOT_ASSOCED,            "not_assoced" },
+        { REASON_ASSOC_LEAVE,            "assoc_leave" },
+        { REASON_ASSOC_NOT_AUTHED,       "assoc_not_authed" },
+        { REASON_4WAY_HANDSHAKE_TIMEOUT, "4way_handshake_timeout" },
+        { REASON_BEACON_TIMEOUT,         "beacon_timeout" },
+        { REASON_NO_AP_FOUND,            "no_ap_found" },
+        { REASON_AUTH_FAIL,              "auth_fail" },
+        { REASON_ASSOC_FAIL,             "assoc_fail" },
+        { REASON_HANDSHAKE_TIMEOUT,      "handshake_timeout" }
+    };
+    
+    size_t i;
+    
+    if(reason == 0) {
+        printf("no reason");
+        return;
+    }
+    
+    for(i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if(names[i].m_Reason == reason) {
+            printf("reason %s", names[i].m_Name);
+            return;
+        }
+    }
+    
+    printf("reason %u", reason);
+}
+/**
+ * 
+ * @param outage
+ */
+static void trace_print_outage(const TraceOutage* outage)
+{
+    uint32 ms = outage->m_End - outage->m_Start;
+    
+    printf("%-7s lost at %7u.%03u s, %s %5u.%03u s: %u connects, %u failed checks, lost on ",
+            (outage->m_Link == TRACE_STATION) ? "station" : "mesh",
+            outage->m_Start / 1000,
+            outage->m_Start % 1000,
+            (outage->m_Open != 0) ? "still down after" : "back after",
+            ms / 1000,
+            ms % 1000,
+            outage->m_Connects,
+            outage->m_Checks);
+    
+    trace_print_reason(outage->m_Cause);
+    
+    if(outage->m_Reason != 0) {
+        printf(", then ");
+        trace_print_reason(outage->m_Reason);
+    }
+    printf("\n");
+}
+
+#endif  /* WIFI_HOST */
@@ -0,0 +1,66 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * 
+ */
+
+/* 
+ * Decoder for WIFI_TraceDump() output (WITH_TRACE): prints the records as a timeline, then the outages they show.
+ */
+
+#ifndef WIFI_HOST_TRACE_H
+#define	WIFI_HOST_TRACE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "wifi.h"
+
+/******************************************************************************************************************
+ * decoder
+ *
+ */
+
+/**
+ * print a dump as one line per record, with state and reason names, then every time the node lost its link (left
+ * wifi_ready or mesh_connect_done): how long until it was back, how many connects it took and why they failed
+ * 
+ * @param dump      as written by WIFI_TraceDump()
+ * @param length
+ * @return number of records, -1 if 'dump' is not a trace
+ */
+int WIFI_HostTracePrint(const uint8* dump, int length);
+/**
+ * WIFI_HostTracePrint() on a file, e.g. one written from the bytes a node sent
+ * 
+ * @param path      "-" = stdin
+ * @return number of records, -1 if the file can not be read or is not a trace
+ */
+int WIFI_HostTraceDecode(const char* path);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* WIFI_HOST_TRACE_H */